@@ -2,8 +2,15 @@
 [bits 16]
 
 ; Constants
-KERNEL_OFFSET equ 0x1000
+KERNEL_OFFSET equ 0x10000
+KERNEL_SEGMENT equ 0x1000      ; KERNEL_OFFSET as a real-mode segment
+KERNEL_SECTORS equ 256         ; 128KB, kernel.bin must fit in this
+%ifndef INITRD_SECTORS
+INITRD_SECTORS equ 0           ; The Makefile passes the initrd's size
+%endif
+SECTORS_PER_TRACK equ 18       ; 1.44MB floppy geometry
 STACK_BASE equ 0x9000
+KERNEL_STACK equ 0x90000
 
 start:
     ; Set up segments and stack
@@ -28,17 +35,41 @@ start:
     int 0x13
     jc disk_error
 
-    ; Load kernel
-    mov bx, KERNEL_OFFSET
+    ; Load kernel one sector at a time so no read crosses a track. The
+    ; initrd follows it on the disk, so it lands right after the
+    ; kernel's 128KB (INITRD_ADDRESS in fs/initrd.h).
+    mov ax, KERNEL_SEGMENT
+    mov es, ax
+load_sector:
+    xor bx, bx
     mov ah, 0x02           ; BIOS read sector function
-    mov al, 32             ; Number of sectors to read
-    mov ch, 0              ; Cylinder number
-    mov cl, 2              ; Sector number (1 is boot sector)
-    mov dh, 0              ; Head number
+    mov al, 1              ; Number of sectors to read
+    mov ch, [cylinder]     ; Cylinder number
+    mov cl, [sector]       ; Sector number (1 is boot sector)
+    mov dh, [head]         ; Head number
     mov dl, [boot_drive]   ; Drive number
     int 0x13
     jc disk_error
 
+    ; Advance destination by 512 bytes
+    mov ax, es
+    add ax, 0x20
+    mov es, ax
+
+    ; Advance CHS position
+    inc byte [sector]
+    cmp byte [sector], SECTORS_PER_TRACK + 1
+    jne .next
+    mov byte [sector], 1
+    inc byte [head]
+    cmp byte [head], 2
+    jne .next
+    mov byte [head], 0
+    inc byte [cylinder]
+.next:
+    dec word [sectors_left]
+    jnz load_sector
+
     ; Switch to protected mode
     cli                     ; 1. Disable interrupts
     lgdt [gdt_descriptor]   ; 2. Load GDT descriptor
@@ -77,7 +108,7 @@ init_pm:
     mov gs, ax
 
     ; Set up stack
-    mov ebp, STACK_BASE
+    mov ebp, KERNEL_STACK
     mov esp, ebp
 
     ; Clear screen
@@ -86,7 +117,10 @@ init_pm:
     mov ax, 0x0720
     rep stosw
 
-    ; Jump to kernel
+    ; Jump to kernel. eax and ebx are zero rather than the multiboot
+    ; magic and info pointer, so it knows the initrd is at INITRD_ADDRESS.
+    xor eax, eax
+    xor ebx, ebx
     call KERNEL_OFFSET
     
     ; Should never get here
@@ -94,6 +128,10 @@ init_pm:
 
 ; Data
 boot_drive: db 0
+sector: db 2
+head: db 0
+cylinder: db 0
+sectors_left: dw KERNEL_SECTORS + INITRD_SECTORS
 msg_loading: db 'Loading kernel...', 13, 10, 0
 msg_disk_error: db 'Disk error!', 13, 10, 0
 
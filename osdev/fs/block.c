@@ -0,0 +1,248 @@
+#include "block.h"
+#include "../include/kernel.h"
+
+static BlockDevice* block_device = NULL;
+static int block_reads = 0;          // Device transfers
+static int block_writes = 0;
+static int submitted = 0;            // Requests
+static int merged = 0;               // Requests that shared a transfer
+
+// Pending requests sorted by block. The elevator sweeps upward from the
+// last block transferred, then starts again from the lowest (C-LOOK).
+static BlockRequest* queue = NULL;
+static uint32_t head_position = 0;
+static uint32_t dispatches = 0;
+
+// Merged transfers go through here
+static char bounce[BLOCK_MAX_MERGE * BLOCK_SIZE] __attribute__((aligned(4096)));
+
+// Drivers register the disks they find; the first one backs the fs
+void register_block_device(BlockDevice* device) {
+    if (block_device == NULL) {
+        block_device = device;
+    }
+}
+
+BlockDevice* get_block_device(void) {
+    return block_device;
+}
+
+void submit_block_io(BlockRequest* request) {
+    request->status = BLOCK_PENDING;
+    request->expires = dispatches + BLOCK_EXPIRE;
+    submitted++;
+
+    BlockRequest** link = &queue;
+    while (*link != NULL && (*link)->block <= request->block) {
+        link = &(*link)->next;
+    }
+    request->next = *link;
+    *link = request;
+}
+
+// The request to dispatch next: one that has waited too long, else the
+// first at or past the head, else the lowest
+static BlockRequest* pick_request(void) {
+    BlockRequest* ahead = NULL;
+    for (BlockRequest* r = queue; r != NULL; r = r->next) {
+        if ((int32_t)(dispatches - r->expires) >= 0) {
+            return r;
+        }
+        if (ahead == NULL && r->block >= head_position) {
+            ahead = r;
+        }
+    }
+    return ahead != NULL ? ahead : queue;
+}
+
+static void complete(BlockRequest* request, int status) {
+    request->status = status;
+    if (request->done != NULL) {
+        request->done(request);
+    }
+}
+
+// The next run to transfer: the request pick_request chooses and the
+// queued requests of the same direction that continue it block for block
+static void find_run(BlockTransfer* transfer) {
+    BlockRequest* first = pick_request();
+    BlockRequest* last = first;
+    uint32_t count = first->count;
+    while (last->next != NULL && last->next->write == first->write &&
+           last->next->block == last->block + last->count &&
+           count + last->next->count <= BLOCK_MAX_MERGE) {
+        last = last->next;
+        count += last->count;
+    }
+    transfer->lba = first->block * SECTORS_PER_BLOCK;
+    transfer->sectors = count * SECTORS_PER_BLOCK;
+    transfer->write = first->write;
+    transfer->first = first;
+    transfer->end = last->next;
+    transfer->status = 0;
+}
+
+// Unlink the run from the queue before completing any of it, since a
+// completion may submit more requests
+static void take_run(const BlockTransfer* transfer) {
+    BlockRequest** link = &queue;
+    while (*link != transfer->first) {
+        link = &(*link)->next;
+    }
+    *link = transfer->end;
+    head_position = (transfer->lba + transfer->sectors) / SECTORS_PER_BLOCK;
+    dispatches++;
+}
+
+// Whether two transfers touch a common block and one of them writes; the
+// disk may finish a batch in any order, so such a pair must not share one
+static int conflicts(const BlockTransfer* a, const BlockTransfer* b) {
+    return (a->write || b->write) &&
+           a->lba < b->lba + b->sectors && b->lba < a->lba + a->sectors;
+}
+
+// One run through the driver's read and write, merged runs by way of
+// the bounce buffer
+static void transfer_run(BlockTransfer* transfer) {
+    BlockRequest* first = transfer->first;
+    int status;
+    if (first->next == transfer->end) {
+        status = first->write ? block_device->write(transfer->lba, transfer->sectors, first->buffer)
+                              : block_device->read(transfer->lba, transfer->sectors, first->buffer);
+    } else if (first->write) {
+        char* out = bounce;
+        for (BlockRequest* r = first; r != transfer->end; r = r->next) {
+            memcpy(out, r->buffer, r->count * BLOCK_SIZE);
+            out += r->count * BLOCK_SIZE;
+        }
+        status = block_device->write(transfer->lba, transfer->sectors, bounce);
+    } else {
+        status = block_device->read(transfer->lba, transfer->sectors, bounce);
+        char* in = bounce;
+        for (BlockRequest* r = first; r != transfer->end && status == 0; r = r->next) {
+            memcpy(r->buffer, in, r->count * BLOCK_SIZE);
+            in += r->count * BLOCK_SIZE;
+        }
+    }
+    transfer->status = status != 0 ? -1 : 0;
+}
+
+static void finish_run(const BlockTransfer* transfer) {
+    if (transfer->write) {
+        block_writes++;
+    } else {
+        block_reads++;
+    }
+    BlockRequest* r = transfer->first;
+    while (r != transfer->end) {
+        BlockRequest* next = r->next;
+        if (r != transfer->first) {
+            merged++;
+        }
+        complete(r, transfer->status);
+        r = next;
+    }
+}
+
+// Send the next run to the disk; a driver with a request queue gets up to
+// BLOCK_BATCH of them at once. Returns -1 if any transfer failed.
+static int dispatch(void) {
+    BlockTransfer batch[BLOCK_BATCH];
+    int count = 0;
+    if (block_device->transfer_batch == NULL) {
+        find_run(&batch[0]);
+        take_run(&batch[0]);
+        transfer_run(&batch[0]);
+        count = 1;
+    } else {
+        while (queue != NULL && count < BLOCK_BATCH) {
+            find_run(&batch[count]);
+            int clash = 0;
+            for (int i = 0; i < count; i++) {
+                if (conflicts(&batch[i], &batch[count])) {
+                    clash = 1;
+                }
+            }
+            if (clash) {
+                break;
+            }
+            take_run(&batch[count]);
+            count++;
+        }
+        block_device->transfer_batch(batch, count);
+    }
+
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        finish_run(&batch[i]);
+        if (batch[i].status != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+// Dispatch until the request completes. Returns its status.
+int wait_block_io(BlockRequest* request) {
+    while (request->status == BLOCK_PENDING) {
+        dispatch();
+    }
+    return request->status;
+}
+
+// Dispatch everything queued. Returns -1 if any transfer failed.
+int run_block_queue(void) {
+    int result = 0;
+    while (queue != NULL) {
+        if (dispatch() != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+// Idle work: one dispatch, so a waiting keyboard stays responsive
+void poll_block_queue(void) {
+    if (queue != NULL) {
+        dispatch();
+    }
+}
+
+// Queue a request and wait for it
+static int transfer(uint32_t block, void* buffer, int write) {
+    BlockRequest request;
+    request.block = block;
+    request.count = 1;
+    request.buffer = buffer;
+    request.write = write;
+    request.done = NULL;
+    submit_block_io(&request);
+    return wait_block_io(&request);
+}
+
+int read_block(uint32_t block, void* buffer) {
+    return transfer(block, buffer, 0);
+}
+
+int write_block(uint32_t block, const void* buffer) {
+    return transfer(block, (void*)buffer, 1);
+}
+
+// Everything queued goes to the disk before the cache flush
+int flush_blocks(void) {
+    int result = run_block_queue();
+    if (block_device->flush() != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+void get_block_stats(int* reads, int* writes) {
+    *reads = block_reads;
+    *writes = block_writes;
+}
+
+void get_queue_stats(int* requests, int* merged_requests) {
+    *requests = submitted;
+    *merged_requests = merged;
+}
@@ -0,0 +1,75 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+
+#define SECTOR_SIZE 512
+#define BLOCK_SIZE 4096          // File system block, one page
+#define SECTORS_PER_BLOCK (BLOCK_SIZE / SECTOR_SIZE)
+
+#define BLOCK_MAX_MERGE 32       // Blocks per merged transfer
+#define BLOCK_BATCH 16           // Transfers per transfer_batch call
+#define BLOCK_EXPIRE 64          // Dispatches a request may be passed over
+#define BLOCK_PENDING 1          // Request status until it completes
+
+// An I/O request. The caller owns it, and its buffer, until it completes:
+// status then changes from BLOCK_PENDING to 0 or -1 and done, if set, is
+// called with it.
+typedef struct BlockRequest {
+    uint32_t block;
+    uint32_t count;                // Blocks
+    void* buffer;
+    int write;
+    volatile int status;
+    void (*done)(struct BlockRequest* request);
+    void* context;                 // For done
+    uint32_t expires;              // Dispatch count it must go by
+    struct BlockRequest* next;
+} BlockRequest;
+
+// One transfer of a batch: sectors at lba, gathered from (or scattered
+// to) the buffers of the queued requests first up to end, in order
+typedef struct {
+    uint32_t lba;
+    uint32_t sectors;
+    int write;
+    BlockRequest* first;
+    BlockRequest* end;
+    int status;                    // Set by the driver, 0 or -1
+} BlockTransfer;
+
+// A disk driver. Transfers are whole 512-byte sectors; each call returns
+// 0 on success or -1 on a device error.
+typedef struct {
+    const char* name;
+    uint32_t sectors;
+    int (*read)(uint32_t lba, uint32_t count, void* buffer);
+    int (*write)(uint32_t lba, uint32_t count, const void* buffer);
+    int (*flush)(void);    // Make completed writes durable
+    // Optional, for disks with a request queue: start all the transfers
+    // at once and return when every one has completed
+    void (*transfer_batch)(BlockTransfer* transfers, int count);
+} BlockDevice;
+
+// The disk backing the file system, NULL if there is none
+void register_block_device(BlockDevice* device);
+BlockDevice* get_block_device(void);
+
+// Queued requests. They go to the disk in block order, with adjacent
+// ones of the same direction merged into one transfer, only when someone
+// waits, on a flush, or from the idle loop's poll. Each of those runs the
+// queue to completion on the calling thread; nothing is scheduled in the
+// meantime, so queueing buys merging and ordering, not overlap.
+void submit_block_io(BlockRequest* request);
+int wait_block_io(BlockRequest* request);
+int run_block_queue(void);
+void poll_block_queue(void);
+
+// Whole-block transfers on that disk, waiting for them to complete
+int read_block(uint32_t block, void* buffer);
+int write_block(uint32_t block, const void* buffer);
+int flush_blocks(void);
+void get_block_stats(int* reads, int* writes);
+void get_queue_stats(int* requests, int* merged);
+
+#endif
@@ -1,119 +1,1778 @@
 #include "fs.h"
+#include "layout.h"
+#include "block.h"
+#include "journal.h"
+#include "pagecache.h"
+#include "lz4.h"
+#include "initrd.h"
 #include "../include/kernel.h"
+#include "../mm/memory.h"
 #include <stddef.h>
+#include <stdint.h>
+
+static Inode inodes[MAX_INODES];
+
+// File contents live in the page cache. Indirect blocks are metadata:
+// read in when first needed and journaled like the inode table.
+static uint32_t* indirect_blocks[MAX_INODES];
+static uint8_t indirect_dirty[MAX_INODES];
+
+// Files from the initrd are read straight out of the loaded image. The
+// first write copies one into the page cache and it becomes an ordinary
+// file, kept on the disk from then on; untouched ones are never written
+// there and are added afresh each boot.
+static const char* image_data[MAX_INODES];
+
+// Mappings of each file (hold_file) and its pages lent out by
+// get_file_page. A mapped file's pages must stay where the mappings
+// point, and its inode must stay the same file for pages not touched
+// yet, so it cannot be deleted, rewritten or dropped from the cache
+// until every mapping is gone.
+static uint16_t file_mappings[MAX_INODES];
+static uint16_t mapped_pages[MAX_INODES];
+
+// Sequential readahead. A reader that keeps asking for the page after
+// the one it last read gets windows that double up to READAHEAD_MAX
+// pages, queued together so the block layer can merge them into as few
+// disk transfers as the block layout allows. Reaching the marked page in
+// the middle of a window starts the next one, so the reader keeps
+// finding its pages already cached.
+#define READAHEAD_INIT 4
+#define READAHEAD_MAX 32
 
-// File system data structures
 typedef struct {
-    char name[MAX_FILENAME];
-    char content[MAX_CONTENT];
-    int used;
-} File;
+    uint32_t next;      // Page a sequential reader asks for next
+    uint32_t ahead;     // First page past the last window read
+    uint32_t window;
+} Readahead;
 
-static File files[MAX_FILES];
+static Readahead readahead[MAX_INODES];
+static int page_hits = 0;
+static int page_misses = 0;
+static int readahead_pages = 0;
 
-// Initialize file system
-void init_fs(void) {
-    // Initialize all file slots as unused
-    for (int i = 0; i < MAX_FILES; i++) {
-        files[i].used = 0;
-        files[i].name[0] = '\0';
-        files[i].content[0] = '\0';
+#define JOURNAL_CAPACITY (JOURNAL_BLOCKS - 2)   // Images per transaction
+#define MAX_UPDATE_BLOCKS 3     // Bitmap, inode table and indirect block
+
+// Disk state. Metadata changes only mark their block dirty; sync_fs
+// commits every dirty block as one journal transaction, so a burst of
+// creates, writes and deletes costs one sequential journal write.
+static BlockDevice* disk = NULL;
+static uint32_t block_count = 0;
+static uint8_t block_bitmap[BLOCK_SIZE];
+static uint8_t freed_blocks[BLOCK_SIZE];  // Not reused until the free commits
+static uint32_t next_block = DATA_BLOCK;
+static uint8_t meta_dirty[JOURNAL_BLOCK];
+static int dirty_blocks = 0;              // Metadata blocks awaiting commit
+
+// Inodes of every entry except the root, sorted by (parent, name). Each
+// directory's contents are one run of the index, so listing is in name
+// order and prefix searches (tab completion) are a binary search.
+static int sorted[MAX_INODES];
+static int sorted_count = 0;
+
+// Dentry cache: (parent, name) -> inode, direct mapped on a hash of both.
+// A hit is checked against the inode's own name and parent, so entries
+// for deleted or renamed inodes simply miss and need no invalidation.
+typedef struct {
+    uint32_t hash;
+    int inode;
+} Dentry;
+
+static Dentry dcache[DCACHE_SIZE];
+static int dcache_hits = 0;
+static int dcache_misses = 0;
+
+static int cwd = ROOT_INODE;
+
+// FNV-1a over the name, seeded with the parent inode
+static uint32_t dentry_hash(int parent, const char* name) {
+    uint32_t hash = 2166136261u ^ (uint32_t)parent;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
     }
+    return hash;
 }
 
-// Create a new file
-void create_file(const char* name) {
-    // Find free slot
+// Order of inode i against (parent, name)
+static int compare_entry(int i, int parent, const char* name) {
+    if (inodes[i].parent != parent) {
+        return inodes[i].parent < parent ? -1 : 1;
+    }
+    return strcmp(inodes[i].name, name);
+}
+
+// Position of the first sorted entry that is >= (parent, name)
+static int lower_bound(int parent, const char* name) {
+    int low = 0;
+    int high = sorted_count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (compare_entry(sorted[mid], parent, name) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Inode of name inside directory parent, or -1
+static int lookup(int parent, const char* name) {
+    uint32_t hash = dentry_hash(parent, name);
+    Dentry* dentry = &dcache[hash & (DCACHE_SIZE - 1)];
+    int i = dentry->inode;
+    if (dentry->hash == hash && i >= 0 && inodes[i].type != INODE_FREE &&
+        compare_entry(i, parent, name) == 0) {
+        dcache_hits++;
+        return i;
+    }
+    dcache_misses++;
+
+    int pos = lower_bound(parent, name);
+    if (pos < sorted_count && compare_entry(sorted[pos], parent, name) == 0) {
+        dentry->hash = hash;
+        dentry->inode = sorted[pos];
+        return sorted[pos];
+    }
+    return -1;
+}
+
+// Walk a path from the root or the current directory. Returns the inode
+// it names, or with want_parent the directory that would hold its last
+// component, which is copied into name. -1 if any step does not exist or
+// is not a directory.
+static int walk(const char* path, int want_parent, char* name) {
+    int dir = (path[0] == '/') ? ROOT_INODE : cwd;
+    char component[MAX_FILENAME];
+
+    while (1) {
+        while (*path == '/') path++;
+        if (*path == '\0') {
+            return want_parent ? -1 : dir;
+        }
+
+        // Over-long components are truncated, as names are on create
+        int length = 0;
+        while (*path != '\0' && *path != '/') {
+            if (length < MAX_FILENAME - 1) {
+                component[length++] = *path;
+            }
+            path++;
+        }
+        component[length] = '\0';
+        while (*path == '/') path++;
+        int last = (*path == '\0');
+
+        if (last && want_parent) {
+            strcpy(name, component);
+            return dir;
+        }
+
+        int next;
+        if (strcmp(component, ".") == 0) {
+            next = dir;
+        } else if (strcmp(component, "..") == 0) {
+            next = inodes[dir].parent;
+        } else {
+            next = lookup(dir, component);
+        }
+        if (next < 0 || (!last && inodes[next].type != INODE_DIR)) {
+            return -1;
+        }
+        if (last) {
+            return next;
+        }
+        dir = next;
+    }
+}
+
+// Inode of the regular file at path, or -1
+static int find_file(const char* path) {
+    int i = walk(path, 0, NULL);
+    if (i < 0 || inodes[i].type != INODE_FILE) {
+        return -1;
+    }
+    return i;
+}
+
+// 1, after printing why, if a file is mapped (see file_mappings)
+static int is_mapped(int i) {
+    if (file_mappings[i] == 0 && mapped_pages[i] == 0) {
+        return 0;
+    }
+    print_string("Error: File is mapped\n");
+    return 1;
+}
+
+// Add a metadata block to the running transaction
+static void mark_dirty(uint8_t* flag) {
+    if (!*flag) {
+        *flag = 1;
+        dirty_blocks++;
+    }
+}
+
+// Note that inode i changed, so its table block goes in the next commit
+static void mark_inode(int i) {
+    mark_dirty(&meta_dirty[INODE_BLOCK + i / INODES_PER_BLOCK]);
+}
+
+static int test_bit(const uint8_t* bitmap, uint32_t bit) {
+    return bitmap[bit / 8] & (1 << (bit % 8));
+}
+
+// Allocate a data block, moving on from the last one handed out so a
+// batch of new files lands in consecutive blocks. 0 if the disk is full.
+static uint32_t alloc_block(void) {
+    for (uint32_t n = DATA_BLOCK; n < block_count; n++) {
+        uint32_t block = next_block;
+        next_block = (next_block + 1 < block_count) ? next_block + 1 : DATA_BLOCK;
+        if (!test_bit(block_bitmap, block) && !test_bit(freed_blocks, block)) {
+            block_bitmap[block / 8] |= 1 << (block % 8);
+            mark_dirty(&meta_dirty[BITMAP_BLOCK]);
+            return block;
+        }
+    }
+    return 0;
+}
+
+// Release a data block. Until the free commits the old inode may still
+// point at it on disk, so it is not handed out again before then.
+static void free_block(uint32_t block) {
+    block_bitmap[block / 8] &= ~(1 << (block % 8));
+    freed_blocks[block / 8] |= 1 << (block % 8);
+    mark_dirty(&meta_dirty[BITMAP_BLOCK]);
+}
+
+// Block numbers of file i's pages past the direct ones. Read in on first
+// use, or with allocate created empty. NULL if the file has none (or on
+// failure, after printing why).
+static uint32_t* indirect_table(int i, int allocate) {
+    if (indirect_blocks[i] != NULL) {
+        return indirect_blocks[i];
+    }
+    if (inodes[i].indirect == 0 && !allocate) {
+        return NULL;
+    }
+
+    uint32_t* table = (uint32_t*)alloc_frame();
+    if (table == NULL) {
+        print_string("Error: Out of memory\n");
+        return NULL;
+    }
+    if (inodes[i].indirect != 0) {
+        if (read_block(inodes[i].indirect, table) != 0) {
+            print_string("Error: Disk read failed\n");
+            free_frame((uint32_t)table);
+            return NULL;
+        }
+    } else {
+        inodes[i].indirect = alloc_block();
+        if (inodes[i].indirect == 0) {
+            free_frame((uint32_t)table);
+            return NULL;
+        }
+        memset(table, 0, BLOCK_SIZE);
+        mark_inode(i);
+        mark_dirty(&indirect_dirty[i]);
+    }
+    indirect_blocks[i] = table;
+    return table;
+}
+
+// Block map slot of page index of file i. NULL if the file has no
+// indirect block for it and allocate is not set (or on failure).
+static uint32_t* map_entry(int i, uint32_t index, int allocate) {
+    if (index < DIRECT_BLOCKS) {
+        return &inodes[i].direct[index];
+    }
+    uint32_t* table = indirect_table(i, allocate);
+    return table != NULL ? &table[index - DIRECT_BLOCKS] : NULL;
+}
+
+// Note that the block map slot of page index changed
+static void mark_map(int i, uint32_t index) {
+    if (index < DIRECT_BLOCKS) {
+        mark_inode(i);
+    } else {
+        mark_dirty(&indirect_dirty[i]);
+    }
+}
+
+// Disk block holding page index of file i, allocating one with allocate.
+// 0 if there is none: a hole, or a page not written back yet.
+static uint32_t map_block(int i, uint32_t index, int allocate) {
+    uint32_t* entry = map_entry(i, index, allocate);
+    if (entry == NULL) {
+        return 0;
+    }
+    if (*entry == 0 && allocate) {
+        *entry = alloc_block();
+        if (*entry != 0) {
+            mark_map(i, index);
+        }
+    }
+    return *entry;
+}
+
+// Whether the cluster holding page index of file i is stored compressed
+static int cluster_compressed(int i, uint32_t index) {
+    uint32_t* entry = map_entry(i, index - index % CLUSTER_PAGES, 0);
+    return entry != NULL && *entry == COMPRESSED_CLUSTER;
+}
+
+// Read the cluster starting at page first of file i into out as it is on
+// disk: decompressed if stored compressed, with zeros for holes
+static int read_cluster(int i, uint32_t first, char* out) {
+    static char packed[CLUSTER_SIZE];
+    BlockRequest io[CLUSTER_PAGES];
+    int compressed = cluster_compressed(i, first);
+    char* target = compressed ? packed : out;
+    int count = 0;
+
+    memset(out, 0, CLUSTER_SIZE);
+    for (int k = 0; k < CLUSTER_PAGES; k++) {
+        uint32_t* entry = map_entry(i, first + k, 0);
+        if (entry == NULL || *entry == 0 || *entry == COMPRESSED_CLUSTER) {
+            continue;
+        }
+        io[count].block = *entry;
+        io[count].count = 1;
+        io[count].buffer = target + k * BLOCK_SIZE;
+        io[count].write = 0;
+        io[count].done = NULL;
+        submit_block_io(&io[count]);
+        count++;
+    }
+    int result = 0;
+    for (int n = 0; n < count; n++) {
+        if (wait_block_io(&io[n]) != 0) {
+            result = -1;
+        }
+    }
+    if (result != 0) {
+        print_string("Error: Disk read failed\n");
+        return -1;
+    }
+
+    if (compressed) {
+        // The slot after the marker starts with the compressed length
+        uint32_t length = *(uint32_t*)(packed + BLOCK_SIZE);
+        if (length > CLUSTER_SIZE - BLOCK_SIZE - 4 ||
+            lz4_decompress(packed + BLOCK_SIZE + 4, length, out, CLUSTER_SIZE) < 0) {
+            print_string("Error: Corrupt compressed data\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Commit the dirty bitmap, inode table and indirect blocks as one
+// journal transaction, once the data they point at is on disk
+static int commit_metadata(void) {
+    uint32_t homes[JOURNAL_CAPACITY];
+    const void* images[JOURNAL_CAPACITY];
+    int count = 0;
+    int result = run_block_queue();
+
+    for (int b = BITMAP_BLOCK; b < JOURNAL_BLOCK; b++) {
+        if (meta_dirty[b]) {
+            meta_dirty[b] = 0;
+            homes[count] = b;
+            if (b == BITMAP_BLOCK) {
+                images[count] = block_bitmap;
+            } else {
+                images[count] = &inodes[(b - INODE_BLOCK) * INODES_PER_BLOCK];
+            }
+            count++;
+        }
+    }
+    for (int i = 0; i < MAX_INODES; i++) {
+        if (!indirect_dirty[i]) {
+            continue;
+        }
+        indirect_dirty[i] = 0;
+        // begin_update keeps a transaction within the journal; should it
+        // ever overflow, commit what is collected so far first
+        if (count == JOURNAL_CAPACITY) {
+            result |= commit_journal(homes, images, count);
+            count = 0;
+        }
+        homes[count] = inodes[i].indirect;
+        images[count] = indirect_blocks[i];
+        count++;
+    }
+
+    if (count > 0) {
+        result |= commit_journal(homes, images, count);
+        memset(freed_blocks, 0, BLOCK_SIZE);
+    }
+    dirty_blocks = 0;
+    return result;
+}
+
+static int wait_page(CachePage* page);
+
+// Write the cluster starting at page first of file i to new blocks,
+// compressed if the file asks for it and that saves a block. The old
+// blocks are freed, so a crash before the commit leaves the old cluster.
+static int write_cluster(int i, uint32_t first) {
+    static char cluster[CLUSTER_SIZE];
+    static char packed[CLUSTER_SIZE];
+    static BlockRequest io[CLUSTER_PAGES];
+    uint32_t start = first * BLOCK_SIZE;
+    int length = inodes[i].size - start < CLUSTER_SIZE ? inodes[i].size - start : CLUSTER_SIZE;
+    int pages = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    // Pages that are not cached keep what the disk has
+    CachePage* cached[CLUSTER_PAGES] = { NULL };
+    int missing = 0;
+    for (int k = 0; k < pages; k++) {
+        cached[k] = find_page(i, first + k);
+        if (cached[k] != NULL && wait_page(cached[k]) != 0) {
+            cached[k] = NULL;
+        }
+        if (cached[k] == NULL) {
+            missing = 1;
+        }
+    }
+    if (missing && read_cluster(i, first, cluster) != 0) {
+        return -1;
+    }
+    for (int k = 0; k < pages; k++) {
+        if (cached[k] != NULL) {
+            memcpy(cluster + k * BLOCK_SIZE, cached[k]->data, BLOCK_SIZE);
+        }
+    }
+
+    int blocks = pages;
+    char* source = cluster;
+    if (inodes[i].flags & INODE_COMPRESSED) {
+        int packed_length = lz4_compress(cluster, length, packed + 4,
+                                         CLUSTER_SIZE - BLOCK_SIZE - 4);
+        if (packed_length > 0 && (packed_length + 4 + BLOCK_SIZE - 1) / BLOCK_SIZE < pages) {
+            *(uint32_t*)packed = packed_length;
+            blocks = (packed_length + 4 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            source = packed;
+        }
+    }
+
+    // Room for the new blocks and the indirect block in this transaction
+    if (dirty_blocks + MAX_UPDATE_BLOCKS > JOURNAL_CAPACITY && commit_metadata() != 0) {
+        return -1;
+    }
+    uint32_t* slots[CLUSTER_PAGES];
+    for (int k = 0; k < CLUSTER_PAGES; k++) {
+        slots[k] = map_entry(i, first + k, 1);
+        if (slots[k] == NULL) {
+            return -1;
+        }
+    }
+    uint32_t new_blocks[CLUSTER_PAGES];
+    for (int n = 0; n < blocks; n++) {
+        new_blocks[n] = alloc_block();
+        if (new_blocks[n] == 0) {
+            while (n-- > 0) {
+                free_block(new_blocks[n]);
+            }
+            print_string("Error: Disk full\n");
+            return -1;
+        }
+    }
+
+    for (int k = 0; k < CLUSTER_PAGES; k++) {
+        if (*slots[k] != 0 && *slots[k] != COMPRESSED_CLUSTER) {
+            free_block(*slots[k]);
+        }
+        *slots[k] = 0;
+    }
+    if (source == packed) {
+        *slots[0] = COMPRESSED_CLUSTER;
+    }
+    int offset = (source == packed) ? 1 : 0;
+    for (int n = 0; n < blocks; n++) {
+        *slots[n + offset] = new_blocks[n];
+        io[n].block = new_blocks[n];
+        io[n].count = 1;
+        io[n].buffer = source + n * BLOCK_SIZE;
+        io[n].write = 1;
+        io[n].done = NULL;
+        submit_block_io(&io[n]);
+    }
+    mark_map(i, first);
+    run_block_queue();
+
+    int result = 0;
+    for (int n = 0; n < blocks; n++) {
+        if (io[n].status != 0) {
+            result = -1;
+        }
+    }
+    for (int k = 0; k < pages; k++) {
+        if (cached[k] != NULL) {
+            cached[k]->io.write = 1;
+            cached[k]->io.status = result;
+            if (result == 0) {
+                cached[k]->dirty = 0;
+            }
+        }
+    }
+    return result;
+}
+
+// Page cache writeback: queue a write of a page to its block. Only a
+// sync (allocate) gives blocks to new pages, so the allocations are made
+// in file order and land in the running transaction.
+static int write_page_back(CachePage* page, int allocate) {
+    if (disk == NULL) {
+        return -1;
+    }
+    if (!page->dirty) {
+        return 0;      // Already written with the rest of its cluster
+    }
+    int i = page->inode;
+    if ((inodes[i].flags & INODE_COMPRESSED) || cluster_compressed(i, page->index)) {
+        return allocate ? write_cluster(i, page->index - page->index % CLUSTER_PAGES) : -1;
+    }
+    uint32_t block = map_block(i, page->index, 0);
+    if (block == 0) {
+        if (!allocate) {
+            return -1;
+        }
+        // Commit early if the allocation might not fit in the running
+        // transaction (the pages queued so far go to disk first)
+        if (dirty_blocks + MAX_UPDATE_BLOCKS > JOURNAL_CAPACITY && commit_metadata() != 0) {
+            return -1;
+        }
+        block = map_block(i, page->index, 1);
+        if (block == 0) {
+            print_string("Error: Disk full\n");
+            return -1;
+        }
+    }
+    page->io.block = block;
+    page->io.count = 1;
+    page->io.buffer = page->data;
+    page->io.write = 1;
+    page->io.done = NULL;
+    submit_block_io(&page->io);
+    return 0;
+}
+
+// Start a metadata update, committing first if it might not fit in the
+// running transaction
+static void begin_update(void) {
+    if (disk != NULL && dirty_blocks + MAX_UPDATE_BLOCKS > JOURNAL_CAPACITY) {
+        sync_fs();
+    }
+}
+
+// Empty in-memory tables: just the root directory
+static void init_fs_tables(void) {
+    memset(inodes, 0, sizeof(inodes));
+    for (int i = 0; i < MAX_INODES; i++) {
+        indirect_blocks[i] = NULL;
+        image_data[i] = NULL;
+        file_mappings[i] = 0;
+        mapped_pages[i] = 0;
+    }
+    for (int i = 0; i < DCACHE_SIZE; i++) {
+        dcache[i].inode = -1;
+    }
+    memset(meta_dirty, 0, sizeof(meta_dirty));
+    memset(indirect_dirty, 0, sizeof(indirect_dirty));
+    memset(readahead, 0, sizeof(readahead));
+    dirty_blocks = 0;
+    init_page_cache(write_page_back);
+
+    inodes[ROOT_INODE].type = INODE_DIR;
+    inodes[ROOT_INODE].parent = ROOT_INODE;
+    strcpy(inodes[ROOT_INODE].name, "/");
+    sorted_count = 0;
+    cwd = ROOT_INODE;
+}
+
+// Write an empty file system: superblock, bitmap with the metadata
+// blocks taken, the inode table holding just the root, and no journal
+static int format_disk(void) {
+    memset(block_bitmap, 0, BLOCK_SIZE);
+    for (uint32_t block = 0; block < DATA_BLOCK; block++) {
+        block_bitmap[block / 8] |= 1 << (block % 8);
+    }
+
+    uint32_t* super = (uint32_t*)alloc_frame();
+    if (super == NULL) {
+        return -1;
+    }
+    memset(super, 0, BLOCK_SIZE);
+    SuperBlock* sb = (SuperBlock*)super;
+    sb->magic = FS_MAGIC;
+    sb->version = FS_VERSION;
+    sb->blocks = block_count;
+    sb->inodes = MAX_INODES;
+
+    int result = 0;
+    clear_journal();
+    for (int b = 0; b < INODE_BLOCKS && result == 0; b++) {
+        result = write_block(INODE_BLOCK + b, &inodes[b * INODES_PER_BLOCK]);
+    }
+    if (result == 0) {
+        result = write_block(BITMAP_BLOCK, block_bitmap);
+    }
+    // The superblock goes last so a format cut short is redone next boot
+    if (result == 0 && flush_blocks() == 0) {
+        result = write_block(SUPER_BLOCK, super);
+    }
+    if (result == 0) {
+        result = flush_blocks();
+    }
+    free_frame((uint32_t)super);
+    return result;
+}
+
+// Replay the journal, then read the bitmap and inode table and rebuild
+// the name index. File contents are read when first used.
+static int load_disk(void) {
+    int restored = replay_journal();
+    if (restored < 0) {
+        return -1;
+    }
+    if (restored > 0) {
+        print_string("fs: journal replayed, ");
+        print_int(restored);
+        print_string(" blocks restored\n");
+    }
+
+    if (read_block(BITMAP_BLOCK, block_bitmap) != 0) {
+        return -1;
+    }
+    for (int b = 0; b < INODE_BLOCKS; b++) {
+        if (read_block(INODE_BLOCK + b, &inodes[b * INODES_PER_BLOCK]) != 0) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < MAX_INODES; i++) {
+        // An initrd file that went out with a neighbour's inode block
+        if (inodes[i].flags & INODE_INITRD) {
+            memset(&inodes[i], 0, sizeof(Inode));
+        }
+        if (i == ROOT_INODE || inodes[i].type == INODE_FREE) {
+            continue;
+        }
+        int pos = lower_bound(inodes[i].parent, inodes[i].name);
+        memmove(&sorted[pos + 1], &sorted[pos], (sorted_count - pos) * sizeof(int));
+        sorted[pos] = i;
+        sorted_count++;
+    }
+    return 0;
+}
+
+// Back the file system with a disk, formatting it if it holds none
+static void mount_disk(BlockDevice* device) {
+    disk = device;
+    block_count = device->sectors / SECTORS_PER_BLOCK;
+    if (block_count > MAX_BLOCKS) {
+        block_count = MAX_BLOCKS;
+    }
+    if (block_count <= DATA_BLOCK) {
+        print_string("fs: disk too small, files are kept in memory only\n");
+        disk = NULL;
+        return;
+    }
+    init_journal(JOURNAL_BLOCK);
+
+    SuperBlock sb;
+    uint32_t* super = (uint32_t*)alloc_frame();
+    int result = (super != NULL) ? read_block(SUPER_BLOCK, super) : -1;
+    if (result == 0) {
+        sb = *(SuperBlock*)super;
+    }
+    if (super != NULL) {
+        free_frame((uint32_t)super);
+    }
+
+    if (result == 0 && sb.magic == FS_MAGIC && sb.version == FS_VERSION &&
+        sb.inodes == MAX_INODES && sb.blocks <= block_count) {
+        block_count = sb.blocks;
+        result = load_disk();
+    } else if (result == 0) {
+        print_string("fs: formatting ");
+        print_string(device->name);
+        print_char('\n');
+        result = format_disk();
+    }
+
+    if (result != 0) {
+        print_string("fs: disk error, files are kept in memory only\n");
+        disk = NULL;
+        init_fs_tables();
+        return;
+    }
+    print_string("fs: mounted ");
+    print_string(device->name);
+    print_string(", ");
+    print_int(sorted_count);
+    print_string(" entries\n");
+}
+
+// Commit everything changed since the last sync. Dirty pages go to
+// their blocks first, in file order, with new ones allocated as they
+// go; then the metadata that points at them is committed through the
+// journal.
+int sync_fs(void) {
+    if (disk == NULL) {
+        return 0;
+    }
+    int result = writeback_pages();
+    if (commit_metadata() != 0) {
+        result = -1;
+    }
+    if (result != 0) {
+        print_string("Error: Disk write failed\n");
+    }
+    return result;
+}
+
+void get_disk_stats(const char** name, int* blocks, int* used) {
+    *name = disk != NULL ? disk->name : NULL;
+    *blocks = block_count;
+    *used = 0;
+    for (uint32_t block = 0; block < block_count; block++) {
+        if (test_bit(block_bitmap, block)) {
+            (*used)++;
+        }
+    }
+}
+
+// Put a new inode of the given type at sorted position pos, which
+// lower_bound found free for (parent, name). Returns it, or -1 if the
+// table is full.
+static int add_inode(int parent, int pos, const char* name, int type) {
     int slot = -1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (!files[i].used) {
+    for (int i = 0; i < MAX_INODES; i++) {
+        if (inodes[i].type == INODE_FREE) {
             slot = i;
             break;
         }
     }
-    
     if (slot == -1) {
-        print_string("Error: No free file slots\n");
-        return;
+        return -1;
+    }
+
+    memset(&inodes[slot], 0, sizeof(Inode));
+    strcpy(inodes[slot].name, name);
+    inodes[slot].type = type;
+    inodes[slot].parent = parent;
+
+    // Insert into the name index
+    for (int i = sorted_count; i > pos; i--) {
+        sorted[i] = sorted[i - 1];
+    }
+    sorted[pos] = slot;
+    sorted_count++;
+    return slot;
+}
+
+// Allocate an inode of the given type at path. Returns it, or -1 after
+// printing why not.
+static int new_inode(const char* path, int type) {
+    begin_update();
+    char name[MAX_FILENAME];
+    int parent = walk(path, 1, name);
+    if (parent < 0 || inodes[parent].type != INODE_DIR) {
+        print_string("Error: No such directory\n");
+        return -1;
+    }
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        print_string("Error: Invalid name\n");
+        return -1;
+    }
+
+    int pos = lower_bound(parent, name);
+    if (pos < sorted_count && compare_entry(sorted[pos], parent, name) == 0) {
+        print_string("Error: File already exists\n");
+        return -1;
+    }
+
+    int slot = add_inode(parent, pos, name, type);
+    if (slot == -1) {
+        print_string("Error: No free inodes\n");
+        return -1;
+    }
+    mark_inode(slot);
+    return slot;
+}
+
+// Add the initrd's files, and the directories they need, to the tree.
+// A name the disk already has is left alone: it is a copy written
+// since, or the user's own file. The directories are ordinary ones.
+static void mount_initrd(void) {
+    int count = get_initrd_count();
+    int added = 0;
+    for (int e = 0; e < count; e++) {
+        const InitrdEntry* entry = get_initrd_entry(e);
+        const char* path = entry->path;
+        int dir = ROOT_INODE;
+        while (dir >= 0) {
+            char name[MAX_FILENAME];
+            int length = 0;
+            while (*path == '/') path++;
+            while (*path != '\0' && *path != '/') {
+                if (length < MAX_FILENAME - 1) {
+                    name[length++] = *path;
+                }
+                path++;
+            }
+            name[length] = '\0';
+            int last = (*path == '\0');
+            if (length == 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                break;
+            }
+
+            int pos = lower_bound(dir, name);
+            if (pos < sorted_count && compare_entry(sorted[pos], dir, name) == 0) {
+                int next = sorted[pos];
+                dir = (!last && inodes[next].type == INODE_DIR) ? next : -1;
+                continue;
+            }
+            if (!last) {
+                dir = add_inode(dir, pos, name, INODE_DIR);
+                if (dir >= 0) {
+                    mark_inode(dir);
+                }
+                continue;
+            }
+            int i = add_inode(dir, pos, name, INODE_FILE);
+            if (i >= 0) {
+                inodes[i].flags = INODE_INITRD;
+                inodes[i].size = entry->size;
+                image_data[i] = get_initrd_data(entry);
+                added++;
+            }
+            break;
+        }
+    }
+    if (count > 0) {
+        print_string("fs: initrd, ");
+        print_int(added);
+        print_string(" files\n");
+    }
+}
+
+// Initialize file system
+void init_fs(void) {
+    init_fs_tables();
+    if (get_block_device() != NULL) {
+        mount_disk(get_block_device());
+    } else {
+        print_string("fs: no disk, files are kept in memory only\n");
+    }
+    mount_initrd();
+}
+
+// Empty a file: drop its cached pages and free its blocks
+static void release_blocks(int i) {
+    drop_pages(i, 0);
+    inodes[i].flags &= ~INODE_INITRD;
+    image_data[i] = NULL;
+    for (int d = 0; d < DIRECT_BLOCKS; d++) {
+        if (inodes[i].direct[d] != 0 && inodes[i].direct[d] != COMPRESSED_CLUSTER) {
+            free_block(inodes[i].direct[d]);
+        }
+        inodes[i].direct[d] = 0;
+    }
+    if (inodes[i].indirect != 0) {
+        uint32_t* table = indirect_table(i, 0);
+        for (int e = 0; table != NULL && e < INDIRECT_ENTRIES; e++) {
+            if (table[e] != 0 && table[e] != COMPRESSED_CLUSTER) {
+                free_block(table[e]);
+            }
+        }
+        free_block(inodes[i].indirect);
+        inodes[i].indirect = 0;
+    }
+    if (indirect_blocks[i] != NULL) {
+        free_frame((uint32_t)indirect_blocks[i]);
+        indirect_blocks[i] = NULL;
+    }
+    if (indirect_dirty[i]) {
+        indirect_dirty[i] = 0;
+        dirty_blocks--;
+    }
+    inodes[i].size = 0;
+    memset(&readahead[i], 0, sizeof(Readahead));
+    mark_inode(i);
+}
+
+// Drop an inode from the name index and release its blocks
+static void free_inode(int i) {
+    int pos = lower_bound(inodes[i].parent, inodes[i].name);
+    sorted_count--;
+    for (int j = pos; j < sorted_count; j++) {
+        sorted[j] = sorted[j + 1];
+    }
+    release_blocks(i);
+    memset(&inodes[i], 0, sizeof(Inode));
+}
+
+// Add page index of file i to the cache, contents unset. NULL, after
+// printing why, if no page can be had.
+static CachePage* new_page(int i, uint32_t index) {
+    CachePage* page = add_page(i, index);
+    if (page == NULL && disk != NULL) {
+        // Everything left is dirty with no block yet: sync to free some
+        sync_fs();
+        page = add_page(i, index);
+    }
+    if (page == NULL) {
+        print_string("Error: Out of memory\n");
+    }
+    return page;
+}
+
+// Wait for a page's readahead to arrive. A page whose read failed is
+// dropped. Returns 0, or -1 after printing why.
+static int wait_page(CachePage* page) {
+    if (page->io.write || wait_block_io(&page->io) == 0) {
+        return 0;
+    }
+    print_string("Error: Disk read failed\n");
+    discard_page(page);
+    return -1;
+}
+
+// Keep whatever a file's last block holds past its end out of the cache
+static void clear_tail(CachePage* page) {
+    uint32_t start = page->index * BLOCK_SIZE;
+    uint32_t size = inodes[page->inode].size;
+    if (start >= size) {
+        memset(page->data, 0, BLOCK_SIZE);
+    } else if (start + BLOCK_SIZE > size) {
+        memset(page->data + size - start, 0, start + BLOCK_SIZE - size);
+    }
+}
+
+// Readahead completion
+static void page_read_done(BlockRequest* request) {
+    if (request->status == 0) {
+        clear_tail(request->context);
+    }
+}
+
+// Bring the pages of a compressed cluster that are not cached yet into
+// the cache. Decompression needs the whole cluster, so it is read at once.
+static int load_cluster(int i, uint32_t first) {
+    static char cluster[CLUSTER_SIZE];
+    if (read_cluster(i, first, cluster) != 0) {
+        return -1;
+    }
+    uint32_t pages = (inodes[i].size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (uint32_t index = first; index < first + CLUSTER_PAGES && index < pages; index++) {
+        if (find_page(i, index) != NULL) {
+            continue;
+        }
+        CachePage* page = new_page(i, index);
+        if (page == NULL) {
+            return -1;
+        }
+        memcpy(page->data, cluster + (index - first) * BLOCK_SIZE, BLOCK_SIZE);
+        clear_tail(page);
+        readahead_pages++;
+    }
+    return 0;
+}
+
+// Cached page index of file i for writing, read from disk first with load
+// (a write that covers every byte it keeps skips that). NULL, after
+// printing why, if memory or the disk fails.
+static CachePage* get_page(int i, uint32_t index, int load) {
+    CachePage* page = find_page(i, index);
+    if (page != NULL) {
+        return wait_page(page) == 0 ? page : NULL;
+    }
+
+    if (load && cluster_compressed(i, index)) {
+        if (load_cluster(i, index - index % CLUSTER_PAGES) != 0) {
+            return NULL;
+        }
+        return find_page(i, index);
+    }
+
+    page = new_page(i, index);
+    if (page == NULL) {
+        return NULL;
+    }
+
+    uint32_t block = load ? map_block(i, index, 0) : 0;
+    if (block != 0 && read_block(block, page->data) != 0) {
+        print_string("Error: Disk read failed\n");
+        discard_page(page);
+        return NULL;
+    }
+    if (block == 0) {
+        memset(page->data, 0, BLOCK_SIZE);
+    } else {
+        clear_tail(page);
+    }
+    return page;
+}
+
+// Queue reads of pages [start, start + count) of file i. The block
+// layer merges the ones on consecutive blocks into one transfer; readers
+// wait for a page with wait_page.
+static int read_window(int i, uint32_t start, uint32_t count) {
+    uint32_t pages = (inodes[i].size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t end = start + count < pages ? start + count : pages;
+    readahead[i].ahead = end;
+
+    for (uint32_t index = start; index < end; index++) {
+        if (find_page(i, index) != NULL) {
+            continue;
+        }
+        // Compressed clusters are read and decompressed right away
+        if (cluster_compressed(i, index)) {
+            if (load_cluster(i, index - index % CLUSTER_PAGES) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        uint32_t block = map_block(i, index, 0);
+        CachePage* page = new_page(i, index);
+        if (page == NULL) {
+            return -1;
+        }
+        if (block == 0) {
+            memset(page->data, 0, BLOCK_SIZE);
+            continue;
+        }
+        page->io.block = block;
+        page->io.count = 1;
+        page->io.buffer = page->data;
+        page->io.write = 0;
+        page->io.done = page_read_done;
+        page->io.context = page;
+        submit_block_io(&page->io);
+        readahead_pages++;
+    }
+
+    if (end > start + 1) {
+        CachePage* mark = find_page(i, start + (end - start) / 2);
+        if (mark != NULL) {
+            mark->readahead = 1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t grow_window(uint32_t window) {
+    if (window < READAHEAD_INIT) {
+        return READAHEAD_INIT;
+    }
+    return window * 2 < READAHEAD_MAX ? window * 2 : READAHEAD_MAX;
+}
+
+// Cached page index of file i for reading, with readahead
+static CachePage* read_page(int i, uint32_t index) {
+    Readahead* ra = &readahead[i];
+    int sequential = (index == ra->next);
+    ra->next = index + 1;
+
+    CachePage* page = find_page(i, index);
+    if (page != NULL) {
+        page_hits++;
+        if (page->readahead) {
+            page->readahead = 0;
+            if (sequential) {
+                ra->window = grow_window(ra->window);
+                read_window(i, ra->ahead, ra->window);
+                page = find_page(i, index);   // Still there unless the cache is all pinned
+            }
+        }
+        if (page != NULL) {
+            return wait_page(page) == 0 ? page : NULL;
+        }
+    } else {
+        page_misses++;
+    }
+
+    // A sequential reader gets a bigger window each time; a random one
+    // only the page it asked for
+    ra->window = sequential ? grow_window(ra->window) : 1;
+    if (read_window(i, index, ra->window) != 0) {
+        return NULL;
+    }
+    page = find_page(i, index);
+    return page != NULL && wait_page(page) == 0 ? page : NULL;
+}
+
+// Copy up to count bytes of file i from offset. Returns how many.
+static int read_pages(int i, uint32_t offset, char* buffer, int count) {
+    uint32_t size = inodes[i].size;
+    if (offset >= size || count <= 0) {
+        return 0;
+    }
+    if ((uint32_t)count > size - offset) {
+        count = size - offset;
+    }
+    if (inodes[i].flags & INODE_INITRD) {
+        memcpy(buffer, image_data[i] + offset, count);
+        return count;
+    }
+
+    int done = 0;
+    while (done < count) {
+        uint32_t within = offset % BLOCK_SIZE;
+        int n = BLOCK_SIZE - within < (uint32_t)(count - done) ? (int)(BLOCK_SIZE - within)
+                                                               : count - done;
+        CachePage* page = read_page(i, offset / BLOCK_SIZE);
+        if (page == NULL) {
+            return -1;
+        }
+        memcpy(buffer + done, page->data + within, n);
+        done += n;
+        offset += n;
+    }
+    return done;
+}
+
+// Move an initrd file's contents into dirty cache pages, so it can be
+// written like any other and goes to the disk on the next sync
+static int copy_up(int i) {
+    uint32_t size = inodes[i].size;
+    for (uint32_t index = 0; index * BLOCK_SIZE < size; index++) {
+        // Pages lent out read-only (get_file_page) are already filled
+        CachePage* page = find_page(i, index);
+        if (page == NULL) {
+            page = new_page(i, index);
+        }
+        if (page == NULL) {
+            drop_pages(i, 0);
+            return -1;
+        }
+        uint32_t start = index * BLOCK_SIZE;
+        uint32_t n = size - start < BLOCK_SIZE ? size - start : BLOCK_SIZE;
+        memcpy(page->data, image_data[i] + start, n);
+        clear_tail(page);
+        page->dirty = 1;
+    }
+    inodes[i].flags &= ~INODE_INITRD;
+    image_data[i] = NULL;
+    mark_inode(i);
+    return 0;
+}
+
+// Copy count bytes into file i at offset, growing it as needed (up to
+// MAX_FILE_SIZE). Returns how many bytes were written, or -1.
+static int write_pages(int i, uint32_t offset, const char* data, int count) {
+    if ((inodes[i].flags & INODE_INITRD) && copy_up(i) != 0) {
+        return -1;
+    }
+    int done = 0;
+    while (done < count && offset < MAX_FILE_SIZE) {
+        uint32_t index = offset / BLOCK_SIZE;
+        uint32_t within = offset % BLOCK_SIZE;
+        int n = BLOCK_SIZE - within < (uint32_t)(count - done) ? (int)(BLOCK_SIZE - within)
+                                                               : count - done;
+        uint32_t size = inodes[i].size;
+
+        // No need to read a page whose kept bytes are all overwritten
+        int covered = index * BLOCK_SIZE >= size ||
+                      (within == 0 && (n == BLOCK_SIZE || offset + n >= size));
+        CachePage* page = get_page(i, index, !covered);
+        if (page == NULL) {
+            return -1;
+        }
+        memcpy(page->data + within, data + done, n);
+        page->dirty = 1;
+        done += n;
+        offset += n;
+        if (offset > size) {
+            inodes[i].size = offset;
+            mark_inode(i);
+        }
+    }
+    return done;
+}
+
+// Create a new file
+int create_file(const char* name) {
+    if (new_inode(name, INODE_FILE) < 0) {
+        return -1;
     }
-    
-    // Check if file already exists
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && strcmp(files[i].name, name) == 0) {
-            print_string("Error: File already exists\n");
-            return;
-        }
-    }
-    
-    // Initialize new file
-    strncpy(files[slot].name, name, MAX_FILENAME - 1);
-    files[slot].name[MAX_FILENAME - 1] = '\0';
-    files[slot].content[0] = '\0';
-    files[slot].used = 1;
-    
     print_string("Created file: ");
     print_string(name);
     print_char('\n');
+    return 0;
 }
 
 // Delete a file
-void delete_file(const char* name) {
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && strcmp(files[i].name, name) == 0) {
-            files[i].used = 0;
-            files[i].name[0] = '\0';
-            files[i].content[0] = '\0';
-            print_string("Deleted file: ");
-            print_string(name);
-            print_char('\n');
-            return;
+int delete_file(const char* name) {
+    int i = walk(name, 0, NULL);
+    if (i < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    if (inodes[i].type == INODE_DIR) {
+        print_string("Error: Is a directory\n");
+        return -1;
+    }
+    if (is_mapped(i)) {
+        return -1;
+    }
+    begin_update();
+    free_inode(i);
+    print_string("Deleted file: ");
+    print_string(name);
+    print_char('\n');
+    return 0;
+}
+
+// Create a new directory
+int make_directory(const char* name) {
+    if (new_inode(name, INODE_DIR) < 0) {
+        return -1;
+    }
+    print_string("Created directory: ");
+    print_string(name);
+    print_char('\n');
+    return 0;
+}
+
+// Remove an empty directory
+int remove_directory(const char* name) {
+    int i = walk(name, 0, NULL);
+    if (i < 0) {
+        print_string("Error: Directory not found\n");
+        return -1;
+    }
+    if (inodes[i].type != INODE_DIR) {
+        print_string("Error: Not a directory\n");
+        return -1;
+    }
+
+    // The root, the current directory and its ancestors stay
+    for (int j = cwd; ; j = inodes[j].parent) {
+        if (j == i) {
+            print_string("Error: Directory is in use\n");
+            return -1;
         }
+        if (j == ROOT_INODE) {
+            break;
+        }
+    }
+
+    int pos = lower_bound(i, "");
+    if (pos < sorted_count && inodes[sorted[pos]].parent == i) {
+        print_string("Error: Directory not empty\n");
+        return -1;
+    }
+
+    begin_update();
+    free_inode(i);
+    print_string("Removed directory: ");
+    print_string(name);
+    print_char('\n');
+    return 0;
+}
+
+// Make a directory the current one
+int change_directory(const char* name) {
+    int i = walk(name, 0, NULL);
+    if (i < 0) {
+        print_string("Error: Directory not found\n");
+        return -1;
+    }
+    if (inodes[i].type != INODE_DIR) {
+        print_string("Error: Not a directory\n");
+        return -1;
     }
-    print_string("Error: File not found\n");
+    cwd = i;
+    return 0;
+}
+
+int is_directory(const char* name) {
+    int i = walk(name, 0, NULL);
+    return i >= 0 && inodes[i].type == INODE_DIR;
+}
+
+// Absolute path of the current directory
+void get_cwd(char* buffer, int size) {
+    // Built backwards, from the current directory up to the root
+    char path[MAX_PATH];
+    int start = MAX_PATH - 1;
+    path[start] = '\0';
+    for (int i = cwd; i != ROOT_INODE; i = inodes[i].parent) {
+        int length = strlen(inodes[i].name);
+        if (start < length + 1) {
+            break;
+        }
+        start -= length;
+        memcpy(&path[start], inodes[i].name, length);
+        path[--start] = '/';
+    }
+    if (path[start] == '\0') {
+        path[--start] = '/';
+    }
+    strncpy(buffer, &path[start], size - 1);
+    buffer[size - 1] = '\0';
+}
+
+void get_dcache_stats(int* hits, int* misses) {
+    *hits = dcache_hits;
+    *misses = dcache_misses;
 }
 
 // Write content to a file
 int write_file(const char* name, const char* content) {
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && strcmp(files[i].name, name) == 0) {
-            strncpy(files[i].content, content, MAX_CONTENT - 1);
-            files[i].content[MAX_CONTENT - 1] = '\0';
-            print_string("Wrote to file: ");
-            print_string(name);
-            print_char('\n');
-            return 0;
-        }
+    int i = find_file(name);
+    if (i < 0) {
+        print_string("Error: File not found\n");
+        return -1;
     }
-    print_string("Error: File not found\n");
-    return -1;
+    if (is_mapped(i)) {
+        return -1;
+    }
+    begin_update();
+    release_blocks(i);
+    if (write_pages(i, 0, content, strlen(content)) < 0) {
+        return -1;
+    }
+    print_string("Wrote to file: ");
+    print_string(name);
+    print_char('\n');
+    return 0;
 }
 
-// Read content from a file
+// Read content from a file: its first MAX_CONTENT - 1 bytes, NUL
+// terminated (use read_file_at for the rest)
 int read_file(const char* name, char* buffer) {
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && strcmp(files[i].name, name) == 0) {
-            strcpy(buffer, files[i].content);
+    int i = find_file(name);
+    if (i < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    int count = read_pages(i, 0, buffer, MAX_CONTENT - 1);
+    if (count < 0) {
+        return -1;
+    }
+    buffer[count] = '\0';
+    return 0;
+}
+
+// Replace a file's content with raw bytes, which may include NULs
+int write_file_data(const char* name, const void* data, int size) {
+    if (size < 0 || size > MAX_FILE_SIZE) {
+        print_string("Error: File too large\n");
+        return -1;
+    }
+    int i = find_file(name);
+    if (i < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    if (is_mapped(i)) {
+        return -1;
+    }
+    begin_update();
+    release_blocks(i);
+    return write_pages(i, 0, data, size) == size ? 0 : -1;
+}
+
+// Append raw bytes to a file. Prints nothing, so it can back output
+// redirection; returns -1 if the file is missing or the data did not all
+// fit (whatever fits is still written)
+int append_file_data(const char* name, const void* data, int size) {
+    int i = find_file(name);
+    if (i < 0) {
+        return -1;
+    }
+    begin_update();
+    return write_pages(i, inodes[i].size, data, size) == size ? 0 : -1;
+}
+
+// Read up to count bytes from offset. Returns how many (0 at the end of
+// the file), or -1.
+int read_file_at(const char* name, int offset, void* buffer, int count) {
+    int i = find_file(name);
+    if (i < 0 || offset < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    return read_pages(i, offset, buffer, count);
+}
+
+// Write count bytes at offset, growing the file if needed. Returns how
+// many were written, or -1.
+int write_file_at(const char* name, int offset, const void* data, int count) {
+    int i = find_file(name);
+    if (i < 0 || offset < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    begin_update();
+    return write_pages(i, offset, data, count);
+}
+
+// Size of a file in bytes, -1 if there is no such file
+int get_file_size(const char* name) {
+    int i = find_file(name);
+    return i < 0 ? -1 : inodes[i].size;
+}
+
+// Write back a file's pages and drop them from the cache, so the next
+// read comes from the disk (for measuring it)
+int drop_file_cache(const char* name) {
+    int i = find_file(name);
+    if (i < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    if (disk == NULL) {
+        return 0;     // The cache is the only copy
+    }
+    if (is_mapped(i)) {
+        return -1;
+    }
+    if (sync_fs() != 0) {
+        return -1;
+    }
+    drop_pages(i, 0);
+    memset(&readahead[i], 0, sizeof(Readahead));
+    return 0;
+}
+
+// Turn compression of a file's data on or off. Clusters are stored the
+// new way as they are next written.
+int set_file_compression(const char* name, int on) {
+    int i = find_file(name);
+    if (i < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    begin_update();
+    if (on) {
+        inodes[i].flags |= INODE_COMPRESSED;
+    } else {
+        inodes[i].flags &= ~INODE_COMPRESSED;
+    }
+    mark_inode(i);
+    return 0;
+}
+
+// 1 if a file's data is written compressed, 0 if not, -1 if it is missing
+int get_file_compression(const char* name) {
+    int i = find_file(name);
+    return i < 0 ? -1 : (inodes[i].flags & INODE_COMPRESSED) != 0;
+}
+
+void get_read_stats(int* hits, int* misses, int* readahead_count) {
+    *hits = page_hits;
+    *misses = page_misses;
+    *readahead_count = readahead_pages;
+}
+
+// Names in a directory starting with a prefix, in name order. The prefix
+// is a path; its last component is matched inside the directory named by
+// the rest. The first max are stored in names and the last in *last.
+// Returns how many match in all.
+int complete_filename(const char* prefix, const char* names[], int max, const char** last) {
+    const char* base = prefix;
+    for (const char* p = prefix; *p; p++) {
+        if (*p == '/') base = p + 1;
+    }
+
+    int dir = cwd;
+    if (base != prefix) {
+        char path[MAX_PATH];
+        int length = base - prefix;
+        if (length >= MAX_PATH) {
+            return 0;
+        }
+        memcpy(path, prefix, length);
+        path[length] = '\0';
+        dir = walk(path, 0, NULL);
+        if (dir < 0 || inodes[dir].type != INODE_DIR) {
             return 0;
         }
     }
-    print_string("Error: File not found\n");
-    return -1;
-}
 
-// List all files
-void list_files(void) {
     int found = 0;
+    for (int i = lower_bound(dir, base); i < sorted_count; i++) {
+        const Inode* inode = &inodes[sorted[i]];
+        int j = 0;
+        while (base[j] && inode->name[j] == base[j]) j++;
+        if (inode->parent != dir || base[j] != '\0') {
+            break;
+        }
+        if (found < max) {
+            names[found] = inode->name;
+        }
+        *last = inode->name;
+        found++;
+    }
+    return found;
+}
+
+// Borrow a pointer to a file's bytes without copying them. Only for
+// files that fit in one page, which stays pinned in the cache until
+// put_file_data, or that are still in the initrd image; NULL if the file
+// is missing or larger.
+const char* get_file_data(const char* name, int* size) {
+    int i = find_file(name);
+    if (i >= 0 && (inodes[i].flags & INODE_INITRD)) {
+        *size = inodes[i].size;
+        return image_data[i];
+    }
+    if (i < 0 || inodes[i].size > MAX_CONTENT) {
+        return NULL;
+    }
+    CachePage* page = get_page(i, 0, 1);
+    if (page == NULL) {
+        return NULL;
+    }
+    page->pinned++;
+    *size = inodes[i].size;
+    return page->data;
+}
+
+// Return bytes borrowed with get_file_data. If the file was deleted or
+// rewritten meanwhile, its old page is freed now.
+void put_file_data(const char* data) {
+    CachePage* page = find_page_data(data);
+    if (page == NULL || !page->pinned) {
+        return;    // Initrd bytes are not pinned
+    }
+    page->pinned--;
+    release_page(page);
+}
+
+// Inode number of a file, for the page functions below; -1, after
+// printing why, if there is no such file
+int open_file(const char* name) {
+    int i = find_file(name);
+    if (i < 0) {
+        print_string("Error: File not found\n");
+    }
+    return i;
+}
+
+// Take and drop a reference for a mapping of an open file; the file
+// stays put while any is held
+void hold_file(int file) {
+    if (file >= 0 && file < MAX_INODES) {
+        file_mappings[file]++;
+    }
+}
+
+void release_file(int file) {
+    if (file >= 0 && file < MAX_INODES && file_mappings[file] > 0) {
+        file_mappings[file]--;
+    }
+}
+
+// Clean cache page index of an initrd file, filled from the image. Only
+// lenders use these; readers go to the image and copy_up takes them over.
+static CachePage* image_page(int i, uint32_t index) {
+    CachePage* page = find_page(i, index);
+    if (page != NULL) {
+        return page;
+    }
+    page = new_page(i, index);
+    if (page == NULL) {
+        return NULL;
+    }
+    uint32_t start = index * BLOCK_SIZE;
+    uint32_t size = inodes[i].size;
+    memset(page->data, 0, BLOCK_SIZE);
+    if (start < size) {
+        uint32_t length = size - start < BLOCK_SIZE ? size - start : BLOCK_SIZE;
+        memcpy(page->data, image_data[i] + start, length);
+    }
+    return page;
+}
+
+// Lend out page index of an open file, for mapping it into an address
+// space. The page is read in if needed and stays cached until
+// put_file_page. An initrd file is copied into the cache first if the
+// page may be written; read-only pages are filled from the image and the
+// file stays in the initrd. NULL, after printing why, if it cannot be had.
+char* get_file_page(int file, int index, int write) {
+    if (file < 0 || file >= MAX_INODES || inodes[file].type != INODE_FILE ||
+        index < 0 || index >= MAX_FILE_PAGES) {
+        return NULL;
+    }
+    CachePage* page;
+    if ((inodes[file].flags & INODE_INITRD) && !write) {
+        page = image_page(file, index);
+    } else {
+        if (inodes[file].flags & INODE_INITRD) {
+            begin_update();
+            if (copy_up(file) != 0) {
+                return NULL;
+            }
+        }
+        page = get_page(file, index, 1);
+    }
+    if (page == NULL) {
+        return NULL;
+    }
+    page->mapped++;
+    mapped_pages[file]++;
+    return page->data;
+}
+
+// Return page index of a file, lent out by get_file_page as data. A
+// page dropped from the cache meanwhile is found by its frame and freed.
+void put_file_page(int file, int index, const char* data) {
+    CachePage* page = find_page(file, index);
+    if (page == NULL || page->data != data) {
+        page = find_page_data(data);
+    }
+    if (page == NULL || page->mapped == 0) {
+        return;
+    }
+    page->mapped--;
+    mapped_pages[file]--;
+    release_page(page);
+}
+
+// A lent-out page was written through a mapping: the next sync writes it
+void dirty_file_page(int file, int index) {
+    CachePage* page = find_page(file, index);
+    if (page != NULL && page->mapped > 0) {
+        page->dirty = 1;
+    }
+}
+
+// Hand up to count bytes of file i from offset to sink, straight out of
+// the cache pages (or the initrd image) without copying them. Each page
+// is held in the cache while the sink has it, so a sink that fills the
+// cache itself cannot evict it. Returns how many bytes the sink took.
+static int send_pages(int i, uint32_t offset, int count, file_sink sink, void* context) {
+    uint32_t size = inodes[i].size;
+    if (offset >= size || count <= 0) {
+        return 0;
+    }
+    if ((uint32_t)count > size - offset) {
+        count = size - offset;
+    }
+    if (inodes[i].flags & INODE_INITRD) {
+        return sink(image_data[i] + offset, count, context);
+    }
+
+    int done = 0;
+    while (done < count) {
+        uint32_t index = offset / BLOCK_SIZE;
+        uint32_t within = offset % BLOCK_SIZE;
+        int n = BLOCK_SIZE - within < (uint32_t)(count - done) ? (int)(BLOCK_SIZE - within)
+                                                               : count - done;
+        CachePage* page = read_page(i, index);
+        if (page == NULL) {
+            return -1;
+        }
+        page->mapped++;
+        int taken = sink(page->data + within, n, context);
+        page->mapped--;
+        release_page(page);
+        if (taken < 0) {
+            return -1;
+        }
+        done += taken;
+        offset += taken;
+        if (taken < n) {
+            break;
+        }
+    }
+    return done;
+}
+
+// Send up to count bytes of a file from offset to sink. Returns how many
+// the sink took (0 at the end of the file), or -1.
+int send_file(const char* name, int offset, int count, file_sink sink, void* context) {
+    int i = find_file(name);
+    if (i < 0 || offset < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    return send_pages(i, offset, count, sink, context);
+}
+
+// send_pages sink for copy_file: appends to the target file, whose pages
+// are fully overwritten and so never read in
+static int append_sink(const char* data, int length, void* context) {
+    int target = *(int*)context;
+    return write_pages(target, inodes[target].size, data, length);
+}
+
+// Copy a file's contents to target, creating it (with the source's
+// compression setting) or replacing what it holds. Each page goes from
+// the source's cache page into the target's in one copy.
+int copy_file(const char* source, const char* target) {
+    int i = find_file(source);
+    if (i < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    int t = walk(target, 0, NULL);
+    if (t == i) {
+        print_string("Error: Source and target are the same file\n");
+        return -1;
+    }
+    if (t >= 0 && inodes[t].type == INODE_DIR) {
+        print_string("Error: Is a directory\n");
+        return -1;
+    }
+    if (t >= 0 && is_mapped(t)) {
+        return -1;
+    }
+
+    begin_update();
+    if (t < 0) {
+        t = new_inode(target, INODE_FILE);
+        if (t < 0) {
+            return -1;
+        }
+        inodes[t].flags |= inodes[i].flags & INODE_COMPRESSED;
+    } else {
+        release_blocks(t);
+    }
+    uint32_t size = inodes[i].size;
+    if (send_pages(i, 0, size, append_sink, &t) != (int)size) {
+        print_string("Error: Copy failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+// List a directory (the current one if name is NULL), in name order.
+// Subdirectories are shown with a trailing '/'.
+int list_directory(const char* name) {
+    int dir = name != NULL ? walk(name, 0, NULL) : cwd;
+    if (dir < 0 || inodes[dir].type != INODE_DIR) {
+        print_string("Error: Directory not found\n");
+        return -1;
+    }
+
     print_string("=== Files ===\n");
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used) {
-            files[i].name[MAX_FILENAME - 1] = '\0'; // Defensive null-termination
-            print_string(files[i].name);
-            print_char('\n');
-            found = 1;
+    int count = 0;
+    for (int i = lower_bound(dir, ""); i < sorted_count; i++) {
+        const Inode* inode = &inodes[sorted[i]];
+        if (inode->parent != dir) {
+            break;
+        }
+        print_string(inode->name);
+        if (inode->type == INODE_DIR) {
+            print_char('/');
         }
+        print_char('\n');
+        count++;
     }
-    if (!found) {
+    if (count == 0) {
         print_string("No files.\n");
     }
     print_string("============\n");
-} 
\ No newline at end of file
+    return 0;
+}
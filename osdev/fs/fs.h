@@ -1,30 +1,70 @@
 #ifndef FS_H
 #define FS_H
 
-#define MAX_FILES 32
+#define MAX_INODES 2048
 #define MAX_FILENAME 32
-#define MAX_CONTENT 512
-
-// Simple file structure
-struct File {
-    char name[MAX_FILENAME];
-    char content[MAX_CONTENT];
-    int size;
-    int is_used;
-};
-
-// Simple directory structure (single directory for simplicity)
-struct Directory {
-    struct File files[MAX_FILES];
-    int file_count;
-};
-
-// File system functions
+#define MAX_CONTENT 4096         // One page from the frame allocator
+#define MAX_FILE_PAGES (4 + 1024)  // Direct blocks plus one indirect block
+#define MAX_FILE_SIZE (MAX_FILE_PAGES * MAX_CONTENT)
+#define ROOT_INODE 0
+#define DCACHE_SIZE 256          // Dentry cache slots, a power of two
+#define MAX_PATH 256
+
+// Inode types
+#define INODE_FREE 0
+#define INODE_FILE 1
+#define INODE_DIR  2
+
+// File system functions. Every name argument is a path: absolute from
+// '/', or relative to the current directory, and may use "." and "..".
 void init_fs(void);
-void create_file(const char* name);
-void delete_file(const char* name);
+int create_file(const char* name);
+int delete_file(const char* name);
 int write_file(const char* name, const char* content);
 int read_file(const char* name, char* buffer);
-void list_files(void);
+int write_file_data(const char* name, const void* data, int size);
+int append_file_data(const char* name, const void* data, int size);
+const char* get_file_data(const char* name, int* size);
+void put_file_data(const char* data);
+int read_file_at(const char* name, int offset, void* buffer, int count);
+int write_file_at(const char* name, int offset, const void* data, int count);
+int get_file_size(const char* name);
+int set_file_compression(const char* name, int on);
+int get_file_compression(const char* name);
+int list_directory(const char* name);
+int complete_filename(const char* prefix, const char* names[], int max, const char** last);
+
+// Directories
+int make_directory(const char* name);
+int remove_directory(const char* name);
+int change_directory(const char* name);
+int is_directory(const char* name);
+void get_cwd(char* buffer, int size);
+void get_dcache_stats(int* hits, int* misses);
+
+// Disk backing: changes are kept in memory until sync_fs commits them
+// through the journal
+int sync_fs(void);
+void get_disk_stats(const char** name, int* blocks, int* used);
+
+// Page cache: file contents are read through it with sequential readahead
+int drop_file_cache(const char* name);
+void get_read_stats(int* hits, int* misses, int* readahead);
+
+// Mapped files: page-cache pages lent out by inode number (open_file),
+// kept cached until returned; used by mmap and exec (mm/paging.c)
+int open_file(const char* name);
+void hold_file(int file);
+void release_file(int file);
+char* get_file_page(int file, int index, int write);
+void put_file_page(int file, int index, const char* data);
+void dirty_file_page(int file, int index);
+
+// Zero-copy transfer: a file's bytes are handed to a sink a page-cache
+// page at a time, with no buffer in between. The sink returns how many
+// bytes it took (fewer stops the transfer), or -1.
+typedef int (*file_sink)(const char* data, int length, void* context);
+int send_file(const char* name, int offset, int count, file_sink sink, void* context);
+int copy_file(const char* source, const char* target);
 
-#endif 
\ No newline at end of file
+#endif
@@ -0,0 +1,43 @@
+#include "initrd.h"
+#include "../include/kernel.h"
+#include <stddef.h>
+
+static const InitrdHeader* initrd = NULL;
+
+int init_initrd(const void* address, uint32_t length) {
+    const InitrdHeader* header = address;
+    initrd = NULL;
+    if (length < sizeof(InitrdHeader)) {
+        return -1;
+    }
+    if (header->magic != INITRD_MAGIC || header->size < sizeof(InitrdHeader) || header->size > length ||
+        header->count > (header->size - sizeof(InitrdHeader)) / sizeof(InitrdEntry)) {
+        return -1;
+    }
+
+    // Whatever the boot loader left past the image is not trusted either
+    const InitrdEntry* entries = (const InitrdEntry*)(header + 1);
+    uint32_t data_start = sizeof(InitrdHeader) + header->count * sizeof(InitrdEntry);
+    for (uint32_t i = 0; i < header->count; i++) {
+        const InitrdEntry* entry = &entries[i];
+        if (entry->path[INITRD_PATH - 1] != '\0' || entry->offset < data_start ||
+            entry->offset > header->size || entry->size > header->size - entry->offset) {
+            print_string("Error: initrd is corrupt\n");
+            return -1;
+        }
+    }
+    initrd = header;
+    return header->count;
+}
+
+int get_initrd_count(void) {
+    return initrd != NULL ? (int)initrd->count : 0;
+}
+
+const InitrdEntry* get_initrd_entry(int index) {
+    return &((const InitrdEntry*)(initrd + 1))[index];
+}
+
+const char* get_initrd_data(const InitrdEntry* entry) {
+    return (const char*)initrd + entry->offset;
+}
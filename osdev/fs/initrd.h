@@ -0,0 +1,39 @@
+#ifndef INITRD_H
+#define INITRD_H
+
+#include <stdint.h>
+
+// Where boot.asm loads the initrd: the sectors after the kernel's 256 go
+// on from the end of its 128KB, up to the boot stack's last 64KB
+#define INITRD_ADDRESS 0x30000
+#define INITRD_MAX_SIZE (0x80000 - INITRD_ADDRESS)
+
+#define INITRD_MAGIC 0x44524E49  // "INRD"
+#define INITRD_PATH 56           // Bytes, NUL included
+#define INITRD_ALIGN 16          // Of each file's data
+
+// Image layout, built by tools/mkinitrd: the header, count entries, then
+// the file data. Paths are relative to the root, with '/' between
+// directories; offsets are from the start of the image.
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t size;               // Of the whole image
+    uint32_t reserved;
+} InitrdHeader;
+
+typedef struct {
+    char path[INITRD_PATH];
+    uint32_t offset;
+    uint32_t size;
+} InitrdEntry;
+
+// Check the image at address, which the loader gave length bytes, and
+// keep it if it is sound. Returns the number of files in it, or -1 if
+// there is none.
+int init_initrd(const void* address, uint32_t length);
+int get_initrd_count(void);
+const InitrdEntry* get_initrd_entry(int index);
+const char* get_initrd_data(const InitrdEntry* entry);
+
+#endif
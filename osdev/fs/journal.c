@@ -0,0 +1,213 @@
+#include "journal.h"
+#include "block.h"
+#include "../include/kernel.h"
+#include "../mm/memory.h"
+
+#define JOURNAL_MAX_IMAGES (JOURNAL_BLOCKS - 2)
+
+// Descriptor and commit blocks share this header
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t count;
+    uint32_t checksum;                    // Commit block only
+    uint32_t homes[JOURNAL_MAX_IMAGES];   // Descriptor block only
+} JournalHeader;
+
+static uint32_t journal_start = 0;
+static uint32_t sequence = 1;
+static uint32_t header_block[BLOCK_SIZE / 4];
+static uint32_t commit_block[BLOCK_SIZE / 4];
+static BlockRequest requests[JOURNAL_MAX_IMAGES + 2];
+static int commits = 0;
+static int journaled_blocks = 0;
+
+// FNV-1a, a word at a time
+static uint32_t checksum_block(uint32_t hash, const void* block) {
+    const uint32_t* words = block;
+    for (int i = 0; i < BLOCK_SIZE / 4; i++) {
+        hash = (hash ^ words[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void init_journal(uint32_t start) {
+    journal_start = start;
+}
+
+static void queue_write(BlockRequest* request, uint32_t block, const void* buffer) {
+    request->block = block;
+    request->count = 1;
+    request->buffer = (void*)buffer;
+    request->write = 1;
+    request->done = NULL;
+    submit_block_io(request);
+}
+
+// Flush the requests queued for this commit. Returns 0 if every one of
+// them made it to disk, else -1.
+static int flush_requests(int count) {
+    int result = flush_blocks();
+    for (int i = 0; i < count; i++) {
+        if (requests[i].status != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+// Write a transaction to the journal, make it durable, then write each
+// image to its home block. A crash before the commit block is on disk
+// leaves the previous state; after it, replay_journal finishes the job.
+int commit_journal(const uint32_t homes[], const void* const images[], int count) {
+    if (count <= 0 || count > JOURNAL_MAX_IMAGES) {
+        return -1;
+    }
+
+    JournalHeader* header = (JournalHeader*)header_block;
+    memset(header_block, 0, BLOCK_SIZE);
+    header->magic = JOURNAL_MAGIC;
+    header->sequence = sequence;
+    header->count = count;
+    for (int i = 0; i < count; i++) {
+        header->homes[i] = homes[i];
+    }
+    uint32_t checksum = checksum_block(2166136261u, header_block);
+    for (int i = 0; i < count; i++) {
+        checksum = checksum_block(checksum, images[i]);
+    }
+
+    JournalHeader* commit = (JournalHeader*)commit_block;
+    memset(commit_block, 0, BLOCK_SIZE);
+    commit->magic = JOURNAL_COMMIT_MAGIC;
+    commit->sequence = sequence;
+    commit->count = count;
+    commit->checksum = checksum;
+
+    // One sequential run, which the block queue merges into a single
+    // transfer: descriptor, images, commit block. The checksum catches a
+    // commit block that reached the disk before the rest.
+    queue_write(&requests[0], journal_start, header_block);
+    for (int i = 0; i < count; i++) {
+        queue_write(&requests[1 + i], journal_start + 1 + i, images[i]);
+    }
+    queue_write(&requests[1 + count], journal_start + 1 + count, commit_block);
+    if (flush_requests(count + 2) != 0) {
+        return -1;
+    }
+
+    // Checkpoint, in block order whatever order the images came in
+    for (int i = 0; i < count; i++) {
+        queue_write(&requests[i], homes[i], images[i]);
+    }
+    if (flush_requests(count) != 0) {
+        return -1;
+    }
+
+    sequence++;
+    commits++;
+    journaled_blocks += count;
+    return 0;
+}
+
+// 1 if the transaction in the journal committed (its commit block is
+// there and the checksum matches), 0 if its write was torn, -1 on a disk
+// error
+static int check_transaction(uint32_t transaction, uint32_t count, uint32_t* image) {
+    JournalHeader* header = (JournalHeader*)header_block;
+    uint32_t checksum = checksum_block(2166136261u, header_block);
+    for (uint32_t i = 0; i < count; i++) {
+        if (read_block(journal_start + 1 + i, image) != 0) {
+            return -1;
+        }
+        checksum = checksum_block(checksum, image);
+    }
+    if (read_block(journal_start + 1 + count, header_block) != 0) {
+        return -1;
+    }
+    return header->magic == JOURNAL_COMMIT_MAGIC && header->sequence == transaction &&
+           header->count == count && header->checksum == checksum;
+}
+
+// Write back each image whose home block differs. Returns how many did,
+// or -1 on a disk error.
+static int restore_images(const uint32_t homes[], uint32_t count,
+                          uint32_t* image, uint32_t* home) {
+    int restored = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (read_block(journal_start + 1 + i, image) != 0 ||
+            read_block(homes[i], home) != 0) {
+            return -1;
+        }
+        int same = 1;
+        for (int j = 0; j < BLOCK_SIZE / 4; j++) {
+            if (image[j] != home[j]) {
+                same = 0;
+                break;
+            }
+        }
+        if (!same) {
+            if (write_block(homes[i], image) != 0) {
+                return -1;
+            }
+            restored++;
+        }
+    }
+    if (restored > 0 && flush_blocks() != 0) {
+        return -1;
+    }
+    return restored;
+}
+
+// Redo the last committed transaction. Only the newest one is ever in
+// the journal and every earlier one was checkpointed before it was
+// written, so replaying it is always safe. Returns how many home blocks
+// differed from their journal image (0 after a clean shutdown), or -1 on
+// a disk error.
+int replay_journal(void) {
+    JournalHeader* header = (JournalHeader*)header_block;
+    if (read_block(journal_start, header_block) != 0) {
+        return -1;
+    }
+    if (header->magic != JOURNAL_MAGIC || header->count == 0 ||
+        header->count > JOURNAL_MAX_IMAGES) {
+        return 0;
+    }
+
+    uint32_t homes[JOURNAL_MAX_IMAGES];
+    uint32_t count = header->count;
+    uint32_t transaction = header->sequence;
+    for (uint32_t i = 0; i < count; i++) {
+        homes[i] = header->homes[i];
+    }
+    sequence = transaction + 1;
+
+    uint32_t* image = (uint32_t*)alloc_frame();
+    uint32_t* home = (uint32_t*)alloc_frame();
+    int restored = -1;
+    if (image != NULL && home != NULL) {
+        restored = check_transaction(transaction, count, image);
+        if (restored > 0) {
+            restored = restore_images(homes, count, image, home);
+        }
+    }
+    if (image != NULL) {
+        free_frame((uint32_t)image);
+    }
+    if (home != NULL) {
+        free_frame((uint32_t)home);
+    }
+    return restored;
+}
+
+// Forget whatever an earlier file system left in the journal area
+void clear_journal(void) {
+    memset(header_block, 0, BLOCK_SIZE);
+    write_block(journal_start, header_block);
+    sequence = 1;
+}
+
+void get_journal_stats(int* count, int* blocks) {
+    *count = commits;
+    *blocks = journaled_blocks;
+}
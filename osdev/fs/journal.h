@@ -0,0 +1,20 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+#define JOURNAL_BLOCKS 64
+#define JOURNAL_MAGIC 0x4C4E524A          // "JRNL", descriptor block
+#define JOURNAL_COMMIT_MAGIC 0x54494D43   // "CMIT", commit block
+
+// Write-ahead journal for metadata blocks, kept in JOURNAL_BLOCKS blocks
+// starting at start. A transaction is a descriptor block listing the
+// home block of each image, the images, and a commit block whose
+// checksum covers the rest.
+void init_journal(uint32_t start);
+int replay_journal(void);
+int commit_journal(const uint32_t homes[], const void* const images[], int count);
+void clear_journal(void);
+void get_journal_stats(int* commits, int* blocks);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+// On-disk format of the file system, shared by fs.c and the host tools
+// (tools/mkfs, tools/fsck)
+
+#include <stdint.h>
+#include "fs.h"
+#include "block.h"
+#include "journal.h"
+
+#define DIRECT_BLOCKS 4
+#define INDIRECT_ENTRIES (BLOCK_SIZE / 4)
+
+// Inode flags
+#define INODE_COMPRESSED 0x0001  // Write clusters compressed
+#define INODE_INITRD 0x0002      // Contents are in the initrd image; such an
+                                 // inode found on disk is stale and free
+
+// Compressed files are stored in clusters of pages, each compressed as a
+// whole. A cluster that compresses into fewer blocks than it has pages
+// is marked in its first block map slot; the following slots hold the
+// blocks with the compressed length and data. Others are stored as is.
+#define CLUSTER_PAGES 4
+#define CLUSTER_SIZE (CLUSTER_PAGES * BLOCK_SIZE)
+#define COMPRESSED_CLUSTER 0xFFFFFFFF
+
+// File system data structures. An inode carries its own name and parent
+// since every entry lives in exactly one directory. The table is also
+// the on-disk format, so a dirty block of it is journaled as is.
+typedef struct {
+    char name[MAX_FILENAME];
+    uint16_t type;
+    uint16_t flags;
+    int parent;     // Directory holding the entry (the root is its own parent)
+    int size;
+    uint32_t direct[DIRECT_BLOCKS];  // Blocks of the first pages, 0 for none
+    uint32_t indirect;               // Block listing the blocks of the rest
+} Inode;
+
+_Static_assert(sizeof(Inode) == 64, "inode table blocks must hold whole inodes");
+_Static_assert(DIRECT_BLOCKS + INDIRECT_ENTRIES == MAX_FILE_PAGES, "MAX_FILE_PAGES is out of date");
+_Static_assert(DIRECT_BLOCKS % CLUSTER_PAGES == 0, "clusters must not straddle the indirect block");
+
+// Layout, in BLOCK_SIZE blocks: superblock, bitmap, inode table,
+// journal, then data
+#define FS_MAGIC 0x53464741      // "AGFS"
+#define FS_VERSION 2
+#define SUPER_BLOCK 0
+#define BITMAP_BLOCK 1
+#define INODE_BLOCK 2
+#define INODES_PER_BLOCK (BLOCK_SIZE / (int)sizeof(Inode))
+#define INODE_BLOCKS (MAX_INODES / INODES_PER_BLOCK)
+#define JOURNAL_BLOCK (INODE_BLOCK + INODE_BLOCKS)
+#define DATA_BLOCK (JOURNAL_BLOCK + JOURNAL_BLOCKS)
+#define MAX_BLOCKS (BLOCK_SIZE * 8)      // What one bitmap block covers
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blocks;
+    uint32_t inodes;
+} SuperBlock;
+
+#endif
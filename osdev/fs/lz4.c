@@ -0,0 +1,170 @@
+#include "lz4.h"
+#include "../include/kernel.h"
+#include <stdint.h>
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5          // The format ends every block with literals
+#define MATCH_LIMIT 12           // No match may start closer to the end
+#define HASH_BITS 12
+#define MAX_OFFSET 65535
+
+// Latest position of each hashed 4-byte sequence
+static uint16_t hash_table[1 << HASH_BITS];
+
+static uint32_t read32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Append a length continuation: 255s then the remainder. Returns the new
+// output position, or -1 if it does not fit.
+static int put_length(uint8_t* out, int op, int capacity, int length) {
+    while (length >= 255) {
+        if (op >= capacity) {
+            return -1;
+        }
+        out[op++] = 255;
+        length -= 255;
+    }
+    if (op >= capacity) {
+        return -1;
+    }
+    out[op++] = length;
+    return op;
+}
+
+// Append a sequence: literals, then (unless match is 0) a match
+static int put_sequence(uint8_t* out, int op, int capacity, const uint8_t* literals,
+                        int literal_length, int offset, int match_length) {
+    if (op >= capacity) {
+        return -1;
+    }
+    int token = op++;
+    int match_code = match_length > 0 ? match_length - MIN_MATCH : 0;
+    out[token] = ((literal_length < 15 ? literal_length : 15) << 4) |
+                 (match_code < 15 ? match_code : 15);
+
+    if (literal_length >= 15 && (op = put_length(out, op, capacity, literal_length - 15)) < 0) {
+        return -1;
+    }
+    if (op + literal_length > capacity) {
+        return -1;
+    }
+    memcpy(&out[op], literals, literal_length);
+    op += literal_length;
+
+    if (match_length > 0) {
+        if (op + 2 > capacity) {
+            return -1;
+        }
+        out[op++] = offset & 0xFF;
+        out[op++] = offset >> 8;
+        if (match_code >= 15 && (op = put_length(out, op, capacity, match_code - 15)) < 0) {
+            return -1;
+        }
+    }
+    return op;
+}
+
+// Greedy single-pass matching against a hash of the last position of
+// each sequence. Runs without a match are skipped faster the longer they
+// get, so incompressible data costs little.
+int lz4_compress(const void* source, int size, void* dest, int capacity) {
+    const uint8_t* in = source;
+    uint8_t* out = dest;
+    int ip = 0;
+    int anchor = 0;
+    int op = 0;
+
+    if (size > LZ4_MAX_INPUT) {
+        return 0;
+    }
+    memset(hash_table, 0, sizeof(hash_table));
+
+    while (ip < size - MATCH_LIMIT) {
+        uint32_t sequence = read32(&in[ip]);
+        uint32_t h = hash4(sequence);
+        int ref = hash_table[h];
+        hash_table[h] = ip;
+
+        if (ref >= ip || ip - ref > MAX_OFFSET || read32(&in[ref]) != sequence) {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        int length = MIN_MATCH;
+        while (ip + length < size - LAST_LITERALS && in[ref + length] == in[ip + length]) {
+            length++;
+        }
+        op = put_sequence(out, op, capacity, &in[anchor], ip - anchor, ip - ref, length);
+        if (op < 0) {
+            return 0;
+        }
+        ip += length;
+        anchor = ip;
+    }
+
+    op = put_sequence(out, op, capacity, &in[anchor], size - anchor, 0, 0);
+    return op < 0 ? 0 : op;
+}
+
+// Read a length continuation. Returns the new input position, or -1 if
+// the input ends first.
+static int get_length(const uint8_t* in, int ip, int size, int* length) {
+    int byte;
+    do {
+        if (ip >= size) {
+            return -1;
+        }
+        byte = in[ip++];
+        *length += byte;
+    } while (byte == 255);
+    return ip;
+}
+
+int lz4_decompress(const void* source, int size, void* dest, int capacity) {
+    const uint8_t* in = source;
+    uint8_t* out = dest;
+    int ip = 0;
+    int op = 0;
+
+    while (ip < size) {
+        int token = in[ip++];
+
+        int literals = token >> 4;
+        if (literals == 15 && (ip = get_length(in, ip, size, &literals)) < 0) {
+            return -1;
+        }
+        if (ip + literals > size || op + literals > capacity) {
+            return -1;
+        }
+        memcpy(&out[op], &in[ip], literals);
+        ip += literals;
+        op += literals;
+        if (ip == size) {
+            break;       // The last sequence has no match
+        }
+
+        if (ip + 2 > size) {
+            return -1;
+        }
+        int offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        int length = token & 15;
+        if (length == 15 && (ip = get_length(in, ip, size, &length)) < 0) {
+            return -1;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > op || op + length > capacity) {
+            return -1;
+        }
+        // Byte by byte: the match may overlap what it is copying
+        for (int i = 0; i < length; i++, op++) {
+            out[op] = out[op - offset];
+        }
+    }
+    return op;
+}
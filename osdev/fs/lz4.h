@@ -0,0 +1,15 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+// LZ4 block format, for inputs up to 64 KB
+#define LZ4_MAX_INPUT 65536
+
+// Compress size bytes. Returns the compressed size, or 0 if it would not
+// fit in capacity bytes.
+int lz4_compress(const void* source, int size, void* dest, int capacity);
+
+// Decompress size bytes. Returns the decompressed size, or -1 if the
+// input is malformed or does not fit in capacity bytes.
+int lz4_decompress(const void* source, int size, void* dest, int capacity);
+
+#endif
@@ -0,0 +1,258 @@
+#include "pagecache.h"
+#include "../include/kernel.h"
+#include "../mm/memory.h"
+
+static CachePage cache[PAGE_CACHE_PAGES];
+static int buckets[PAGE_HASH_SIZE];
+static int lru_head = -1;        // Most recently used
+static int lru_tail = -1;
+static int free_slots[PAGE_CACHE_PAGES];
+static int free_count = 0;
+static int cached_pages = 0;
+static int evictions = 0;
+static writeback_fn write_back = NULL;
+
+static uint32_t page_hash(int inode, uint32_t index) {
+    return ((uint32_t)inode * 2654435761u ^ index * 40503u) & (PAGE_HASH_SIZE - 1);
+}
+
+static void lru_unlink(int slot) {
+    CachePage* page = &cache[slot];
+    if (page->lru_prev >= 0) {
+        cache[page->lru_prev].lru_next = page->lru_next;
+    } else {
+        lru_head = page->lru_next;
+    }
+    if (page->lru_next >= 0) {
+        cache[page->lru_next].lru_prev = page->lru_prev;
+    } else {
+        lru_tail = page->lru_prev;
+    }
+}
+
+static void lru_push(int slot) {
+    cache[slot].lru_prev = -1;
+    cache[slot].lru_next = lru_head;
+    if (lru_head >= 0) {
+        cache[lru_head].lru_prev = slot;
+    } else {
+        lru_tail = slot;
+    }
+    lru_head = slot;
+}
+
+static void hash_remove(int slot) {
+    int* link = &buckets[page_hash(cache[slot].inode, cache[slot].index)];
+    while (*link != slot) {
+        link = &cache[*link].hash_next;
+    }
+    *link = cache[slot].hash_next;
+}
+
+// Take a page out of the cache, keeping its slot's frame for reuse
+static void remove_page(int slot) {
+    hash_remove(slot);
+    lru_unlink(slot);
+    cache[slot].inode = -1;
+    cached_pages--;
+}
+
+// Free the least recently used page that can go. Dirty pages are written
+// back first; pinned or mapped ones, ones still being read, and dirty
+// ones the fs cannot write without allocating stay. Returns the slot, or -1.
+static int evict_page(void) {
+    for (int slot = lru_tail; slot >= 0; slot = cache[slot].lru_prev) {
+        CachePage* page = &cache[slot];
+        if (page->pinned || page->mapped > 0 || page->io.status == BLOCK_PENDING) {
+            continue;
+        }
+        if (page->dirty) {
+            if (write_back == NULL || write_back(page, 0) != 0 ||
+                wait_block_io(&page->io) != 0) {
+                continue;
+            }
+            page->dirty = 0;
+        }
+        remove_page(slot);
+        evictions++;
+        return slot;
+    }
+    return -1;
+}
+
+void init_page_cache(writeback_fn writeback) {
+    write_back = writeback;
+    for (int i = 0; i < PAGE_HASH_SIZE; i++) {
+        buckets[i] = -1;
+    }
+    // Hand out low slots first
+    free_count = 0;
+    for (int slot = PAGE_CACHE_PAGES - 1; slot >= 0; slot--) {
+        cache[slot].inode = -1;
+        cache[slot].data = NULL;
+        free_slots[free_count++] = slot;
+    }
+    lru_head = -1;
+    lru_tail = -1;
+    cached_pages = 0;
+    evictions = 0;
+}
+
+// Cached page index of inode, marked most recently used; NULL on a miss
+CachePage* find_page(int inode, uint32_t index) {
+    for (int slot = buckets[page_hash(inode, index)]; slot >= 0; slot = cache[slot].hash_next) {
+        if (cache[slot].inode == inode && cache[slot].index == index) {
+            lru_unlink(slot);
+            lru_push(slot);
+            return &cache[slot];
+        }
+    }
+    return NULL;
+}
+
+// Add a page for (inode, index), which must not be cached yet. Its
+// contents are left for the caller to fill. NULL if memory is exhausted
+// and nothing can be evicted.
+CachePage* add_page(int inode, uint32_t index) {
+    int slot = -1;
+    if (free_count > 0) {
+        slot = free_slots[free_count - 1];
+        if (cache[slot].data == NULL) {
+            cache[slot].data = (char*)alloc_frame();
+        }
+        if (cache[slot].data != NULL) {
+            free_count--;
+        } else {
+            slot = -1;
+        }
+    }
+    if (slot < 0) {
+        slot = evict_page();
+        if (slot < 0) {
+            return NULL;
+        }
+    }
+
+    CachePage* page = &cache[slot];
+    page->inode = inode;
+    page->index = index;
+    page->dirty = 0;
+    page->pinned = 0;
+    page->mapped = 0;
+    page->readahead = 0;
+    page->io.status = 0;
+    page->io.write = 0;
+    uint32_t bucket = page_hash(inode, index);
+    page->hash_next = buckets[bucket];
+    buckets[bucket] = slot;
+    lru_push(slot);
+    cached_pages++;
+    return page;
+}
+
+// Give a dropped page's frame back
+static void free_page(int slot) {
+    free_frame((uint32_t)cache[slot].data);
+    cache[slot].data = NULL;
+    free_slots[free_count++] = slot;
+}
+
+// Discard an inode's pages from index from on, dirty or not, and give
+// their frames back (the file was deleted or truncated). Pages still
+// pinned or mapped only leave the cache; their frames go when the last
+// holder lets go (release_page).
+void drop_pages(int inode, uint32_t from) {
+    for (int slot = 0; slot < PAGE_CACHE_PAGES; slot++) {
+        if (cache[slot].inode != inode || cache[slot].index < from) {
+            continue;
+        }
+        wait_block_io(&cache[slot].io);    // The frame is still being read into
+        remove_page(slot);
+        if (!cache[slot].pinned && cache[slot].mapped == 0) {
+            free_page(slot);
+        }
+    }
+}
+
+// The page, cached or dropped, whose frame holds data; NULL if none.
+// Searches every slot, for holders whose page may have been dropped.
+CachePage* find_page_data(const char* data) {
+    for (int slot = 0; slot < PAGE_CACHE_PAGES; slot++) {
+        if (cache[slot].data == data && (cache[slot].inode >= 0 ||
+                                         cache[slot].pinned || cache[slot].mapped > 0)) {
+            return &cache[slot];
+        }
+    }
+    return NULL;
+}
+
+// Called after a holder unpins or unmaps a page: frees it if it was
+// dropped meanwhile and nobody else holds it
+void release_page(CachePage* page) {
+    if (page->inode < 0 && !page->pinned && page->mapped == 0) {
+        free_page(page - cache);
+    }
+}
+
+// Take back a page whose contents could not be filled in
+void discard_page(CachePage* page) {
+    remove_page(page - cache);
+    free_slots[free_count++] = page - cache;
+}
+
+// Write every dirty page back, in (inode, index) order so the blocks
+// allocated for a file's new pages come out consecutive and the block
+// queue can merge their writes. Returns 0, or -1 if any page could not
+// be written.
+int writeback_pages(void) {
+    static int order[PAGE_CACHE_PAGES];
+    int count = 0;
+    for (int slot = 0; slot < PAGE_CACHE_PAGES; slot++) {
+        if (cache[slot].inode < 0 || !cache[slot].dirty) {
+            continue;
+        }
+        // Insertion sort: pages are mostly dirtied in file order already
+        int j = count++;
+        while (j > 0) {
+            const CachePage* before = &cache[order[j - 1]];
+            if (before->inode < cache[slot].inode ||
+                (before->inode == cache[slot].inode && before->index < cache[slot].index)) {
+                break;
+            }
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = slot;
+    }
+
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        if (write_back(&cache[order[i]], 1) != 0) {
+            order[i] = -1;
+            result = -1;
+        }
+    }
+    run_block_queue();
+    for (int i = 0; i < count; i++) {
+        if (order[i] < 0) {
+            continue;
+        }
+        if (cache[order[i]].io.status == 0) {
+            cache[order[i]].dirty = 0;
+        } else {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+void get_page_cache_stats(int* pages, int* dirty, int* evicted) {
+    *pages = cached_pages;
+    *dirty = 0;
+    for (int slot = 0; slot < PAGE_CACHE_PAGES; slot++) {
+        if (cache[slot].inode >= 0 && cache[slot].dirty) {
+            (*dirty)++;
+        }
+    }
+    *evicted = evictions;
+}
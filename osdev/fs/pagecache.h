@@ -0,0 +1,41 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include "block.h"
+
+#define PAGE_CACHE_PAGES 2048    // 8MB of file data at most
+#define PAGE_HASH_SIZE 1024      // Buckets, a power of two
+
+// A cached page of file contents, keyed by (inode, page index)
+typedef struct {
+    int inode;            // -1 while the slot is free
+    uint32_t index;       // Page within the file
+    char* data;           // A frame from the frame allocator
+    uint8_t dirty;
+    uint8_t pinned;       // Lent out by get_file_data, not evicted while any
+    uint16_t mapped;      // Mappings and transfers using it, not evicted while any
+    uint8_t readahead;    // A reader reaching this page starts the next readahead
+    BlockRequest io;      // Last transfer; a page being read is pending here
+    int hash_next;
+    int lru_prev;
+    int lru_next;
+} CachePage;
+
+// Queues a write of a page to disk through its io request. Called in
+// (inode, index) order by writeback_pages with allocate set, and on
+// eviction without it, when a page with no block yet must stay cached.
+// Returns 0 if the write was queued, else -1.
+typedef int (*writeback_fn)(CachePage* page, int allocate);
+
+void init_page_cache(writeback_fn writeback);
+CachePage* find_page(int inode, uint32_t index);
+CachePage* add_page(int inode, uint32_t index);
+void drop_pages(int inode, uint32_t from);
+CachePage* find_page_data(const char* data);
+void release_page(CachePage* page);
+void discard_page(CachePage* page);
+int writeback_pages(void);
+void get_page_cache_stats(int* pages, int* dirty, int* evictions);
+
+#endif
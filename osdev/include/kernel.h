@@ -24,17 +24,22 @@ int strcmp(const char* s1, const char* s2);
 size_t strlen(const char* str);
 char* strcpy(char* dest, const char* src);
 char* strncpy(char* dest, const char* src, size_t n);
+void* memset(void* s, int c, size_t n);
+void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
 
 // System control functions
 void shutdown(void);
 void reboot(void);
+void qemu_exit(int code);
 
 // Shell functions
 void init_shell(void);
 void run_shell(void);
 
-// Kernel functions
-void kmain(void) __attribute__((section(".text.boot")));
+// Kernel functions; entered from _start (kernel/multiboot.c) with the
+// multiboot magic and info, or zeros when boot.asm loaded the kernel
+void kmain(uint32_t magic, uint32_t boot_info);
 
 // Utility functions
 void int_to_string(int num, char* str);
@@ -0,0 +1,62 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+
+// System call numbers
+#define SYS_EXIT 0
+#define SYS_WRITE 1           // (const char* str)
+#define SYS_GETPID 2
+#define SYS_CREATE 3          // (const char* name)
+#define SYS_WRITE_FILE 4      // (const char* name, const char* content)
+#define SYS_READ_FILE 5       // (const char* name, char* buffer, int size)
+#define SYS_DELETE 6          // (const char* name)
+#define SYS_SPAWN 7           // (const char* name, int burst_time)
+#define SYS_KILL 8            // (int pid)
+#define SYS_YIELD 9
+#define SYS_SEND 10           // (int to, const Message* msg, int flags)
+#define SYS_RECV 11           // (Message* msg, int flags)
+#define SYS_FORK 12           // int 0x80 only
+#define SYS_MMAP 13           // (const char* name, int writable, int* size), 0 on failure
+#define SYS_MSYNC 14          // (void* addr)
+#define SYS_MUNMAP 15         // (void* addr), the address SYS_MMAP returned
+#define SYSCALL_COUNT 16
+
+#define SYSCALL_VECTOR 0x80
+
+// Calling convention for both entry paths:
+// eax = number, ebx/esi/edi = arguments, eax = return value.
+// sysenter additionally takes the return ESP in ecx and EIP in edx.
+
+// Slow path through the int 0x80 gate
+static inline int syscall3(int num, uint32_t a1, uint32_t a2, uint32_t a3) {
+    int ret;
+    asm volatile ("int $0x80"
+                  : "=a"(ret)
+                  : "a"(num), "b"(a1), "S"(a2), "D"(a3)
+                  : "memory");
+    return ret;
+}
+
+// Fast path through sysenter/sysexit
+static inline int fast_syscall3(int num, uint32_t a1, uint32_t a2, uint32_t a3) {
+    int ret;
+    asm volatile ("mov %%esp, %%ecx\n"
+                  "movl $1f, %%edx\n"
+                  "sysenter\n"
+                  "1:\n"
+                  : "=a"(ret)
+                  : "a"(num), "b"(a1), "S"(a2), "D"(a3)
+                  : "ecx", "edx", "memory");
+    return ret;
+}
+
+#define syscall0(num) syscall3((num), 0, 0, 0)
+#define syscall1(num, a1) syscall3((num), (uint32_t)(a1), 0, 0)
+#define syscall2(num, a1, a2) syscall3((num), (uint32_t)(a1), (uint32_t)(a2), 0)
+
+// Kernel side
+void init_syscalls(void);
+int syscall_dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3);
+
+#endif
@@ -0,0 +1,163 @@
+#include "ata.h"
+#include "io.h"
+#include "../include/kernel.h"
+#include "../fs/block.h"
+
+// Primary ATA bus registers
+#define ATA_DATA 0x1F0
+#define ATA_ERROR 0x1F1
+#define ATA_SECTOR_COUNT 0x1F2
+#define ATA_LBA_LOW 0x1F3
+#define ATA_LBA_MID 0x1F4
+#define ATA_LBA_HIGH 0x1F5
+#define ATA_DRIVE 0x1F6
+#define ATA_STATUS 0x1F7
+#define ATA_COMMAND 0x1F7
+#define ATA_CONTROL 0x3F6
+
+// Status bits
+#define ATA_BSY 0x80
+#define ATA_DF  0x20
+#define ATA_DRQ 0x08
+#define ATA_ERR 0x01
+
+// Commands
+#define ATA_CMD_READ 0x20
+#define ATA_CMD_WRITE 0x30
+#define ATA_CMD_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY 0xEC
+
+#define ATA_MAX_SECTORS 256      // Per command; a count of 0 means 256
+#define ATA_TIMEOUT 10000000
+
+// Reading the alternate status four times gives the drive the 400ns it
+// needs to update status after a command or drive select
+static void ata_delay(void) {
+    for (int i = 0; i < 4; i++) {
+        inb(ATA_CONTROL);
+    }
+}
+
+// Wait for BSY to clear; with want_drq also for data to be ready.
+// Returns -1 on an error, a device fault or a timeout.
+static int ata_wait(int want_drq) {
+    ata_delay();
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
+        uint8_t status = inb(ATA_STATUS);
+        if (status & ATA_BSY) {
+            continue;
+        }
+        if (status & (ATA_ERR | ATA_DF)) {
+            return -1;
+        }
+        if (!want_drq || (status & ATA_DRQ)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Select the master drive and program an LBA28 transfer
+static void ata_setup(uint32_t lba, uint32_t count, uint8_t command) {
+    outb(ATA_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
+    outb(ATA_SECTOR_COUNT, (uint8_t)count);
+    outb(ATA_LBA_LOW, (uint8_t)lba);
+    outb(ATA_LBA_MID, (uint8_t)(lba >> 8));
+    outb(ATA_LBA_HIGH, (uint8_t)(lba >> 16));
+    outb(ATA_COMMAND, command);
+}
+
+static int ata_read(uint32_t lba, uint32_t count, void* buffer) {
+    uint8_t* out = buffer;
+    while (count > 0) {
+        uint32_t chunk = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        if (ata_wait(0) != 0) {
+            return -1;
+        }
+        ata_setup(lba, chunk, ATA_CMD_READ);
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (ata_wait(1) != 0) {
+                return -1;
+            }
+            insw(ATA_DATA, out, SECTOR_SIZE / 2);
+            out += SECTOR_SIZE;
+        }
+        lba += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+static int ata_write(uint32_t lba, uint32_t count, const void* buffer) {
+    const uint8_t* in = buffer;
+    while (count > 0) {
+        uint32_t chunk = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        if (ata_wait(0) != 0) {
+            return -1;
+        }
+        ata_setup(lba, chunk, ATA_CMD_WRITE);
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (ata_wait(1) != 0) {
+                return -1;
+            }
+            outsw(ATA_DATA, in, SECTOR_SIZE / 2);
+            in += SECTOR_SIZE;
+        }
+        lba += chunk;
+        count -= chunk;
+    }
+    return ata_wait(0);
+}
+
+static int ata_flush(void) {
+    if (ata_wait(0) != 0) {
+        return -1;
+    }
+    outb(ATA_DRIVE, 0xE0);
+    outb(ATA_COMMAND, ATA_CMD_FLUSH);
+    return ata_wait(0);
+}
+
+static BlockDevice ata_device = {
+    .name = "ata0",
+    .read = ata_read,
+    .write = ata_write,
+    .flush = ata_flush,
+};
+
+void init_ata(void) {
+    // Polled I/O: keep the drive from raising IRQ 14
+    outb(ATA_CONTROL, 0x02);
+
+    // A floating bus reads 0xFF
+    if (inb(ATA_STATUS) == 0xFF) {
+        return;
+    }
+
+    outb(ATA_DRIVE, 0xA0);
+    ata_delay();
+    outb(ATA_SECTOR_COUNT, 0);
+    outb(ATA_LBA_LOW, 0);
+    outb(ATA_LBA_MID, 0);
+    outb(ATA_LBA_HIGH, 0);
+    outb(ATA_COMMAND, ATA_CMD_IDENTIFY);
+    if (inb(ATA_STATUS) == 0) {
+        return;    // No drive
+    }
+    if (ata_wait(0) != 0 || inb(ATA_LBA_MID) != 0 || inb(ATA_LBA_HIGH) != 0) {
+        return;    // Not an ATA disk (ATAPI drives answer with a signature)
+    }
+    if (ata_wait(1) != 0) {
+        return;
+    }
+
+    uint16_t identify[256];
+    insw(ATA_DATA, identify, 256);
+
+    // Words 60-61: sectors addressable with LBA28
+    ata_device.sectors = identify[60] | ((uint32_t)identify[61] << 16);
+    if (ata_device.sectors == 0) {
+        return;
+    }
+    register_block_device(&ata_device);
+}
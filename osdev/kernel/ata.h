@@ -0,0 +1,7 @@
+#ifndef ATA_H
+#define ATA_H
+
+// Probe the primary IDE master and register it as a block device
+void init_ata(void);
+
+#endif
@@ -0,0 +1,386 @@
+#include "cpu.h"
+#include "io.h"
+#include "../include/kernel.h"
+
+#define GDT_ENTRIES 6
+#define IDT_ENTRIES 256
+#define EXCEPTION_COUNT 32
+#define HANDLER_COUNT (IRQ_BASE + IRQ_COUNT)
+#define KERNEL_STACK_SIZE 8192
+
+// GDT entry
+typedef struct {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t granularity;
+    uint8_t base_high;
+} __attribute__((packed)) GdtEntry;
+
+// IDT entry
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t flags;
+    uint16_t offset_high;
+} __attribute__((packed)) IdtEntry;
+
+// Descriptor table pointer for lgdt/lidt
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) TablePointer;
+
+// Task state segment, only used for the ring 3 -> 0 stack switch
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap, iomap_base;
+} __attribute__((packed)) Tss;
+
+static GdtEntry gdt[GDT_ENTRIES];
+static IdtEntry idt[IDT_ENTRIES];
+static Tss tss;
+static interrupt_handler handlers[HANDLER_COUNT];
+
+// Stack used whenever ring 3 enters the kernel
+static uint8_t kernel_stack[KERNEL_STACK_SIZE] __attribute__((aligned(16)));
+
+// 8259 PICs
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA 0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI 0x20
+#define PIC_INIT 0x11            // ICW1: edge triggered, cascade, ICW4 follows
+#define PIC_8086 0x01            // ICW4
+
+// Kernel stack pointer saved by enter_user_mode()
+uint32_t user_return_esp;
+
+// Flags the kernel entered ring 3 with. sysenter clears IF and sysexit
+// leaves it clear, so the sysenter return sets it again from these.
+uint32_t user_flags;
+
+// Exception stubs push a dummy error code where the CPU does not
+#define EXCEPTION_STUB(n) \
+    asm(".globl exception_stub_" #n "\n" \
+        "exception_stub_" #n ":\n" \
+        "    pushl $0\n" \
+        "    pushl $" #n "\n" \
+        "    jmp interrupt_common\n"); \
+    void exception_stub_##n(void);
+
+#define EXCEPTION_STUB_ERR(n) \
+    asm(".globl exception_stub_" #n "\n" \
+        "exception_stub_" #n ":\n" \
+        "    pushl $" #n "\n" \
+        "    jmp interrupt_common\n"); \
+    void exception_stub_##n(void);
+
+EXCEPTION_STUB(0) EXCEPTION_STUB(1) EXCEPTION_STUB(2) EXCEPTION_STUB(3)
+EXCEPTION_STUB(4) EXCEPTION_STUB(5) EXCEPTION_STUB(6) EXCEPTION_STUB(7)
+EXCEPTION_STUB_ERR(8) EXCEPTION_STUB(9) EXCEPTION_STUB_ERR(10) EXCEPTION_STUB_ERR(11)
+EXCEPTION_STUB_ERR(12) EXCEPTION_STUB_ERR(13) EXCEPTION_STUB_ERR(14) EXCEPTION_STUB(15)
+EXCEPTION_STUB(16) EXCEPTION_STUB_ERR(17) EXCEPTION_STUB(18) EXCEPTION_STUB(19)
+EXCEPTION_STUB(20) EXCEPTION_STUB_ERR(21) EXCEPTION_STUB(22) EXCEPTION_STUB(23)
+EXCEPTION_STUB(24) EXCEPTION_STUB(25) EXCEPTION_STUB(26) EXCEPTION_STUB(27)
+EXCEPTION_STUB(28) EXCEPTION_STUB(29) EXCEPTION_STUB_ERR(30) EXCEPTION_STUB(31)
+
+static void (*const exception_stubs[EXCEPTION_COUNT])(void) = {
+    exception_stub_0, exception_stub_1, exception_stub_2, exception_stub_3,
+    exception_stub_4, exception_stub_5, exception_stub_6, exception_stub_7,
+    exception_stub_8, exception_stub_9, exception_stub_10, exception_stub_11,
+    exception_stub_12, exception_stub_13, exception_stub_14, exception_stub_15,
+    exception_stub_16, exception_stub_17, exception_stub_18, exception_stub_19,
+    exception_stub_20, exception_stub_21, exception_stub_22, exception_stub_23,
+    exception_stub_24, exception_stub_25, exception_stub_26, exception_stub_27,
+    exception_stub_28, exception_stub_29, exception_stub_30, exception_stub_31
+};
+
+// Hardware interrupts arrive remapped to IRQ_BASE and up
+#define IRQ_STUB(n, vector) \
+    asm(".globl irq_stub_" #n "\n" \
+        "irq_stub_" #n ":\n" \
+        "    pushl $0\n" \
+        "    pushl $" #vector "\n" \
+        "    jmp interrupt_common\n"); \
+    void irq_stub_##n(void);
+
+IRQ_STUB(0, 32) IRQ_STUB(1, 33) IRQ_STUB(2, 34) IRQ_STUB(3, 35)
+IRQ_STUB(4, 36) IRQ_STUB(5, 37) IRQ_STUB(6, 38) IRQ_STUB(7, 39)
+IRQ_STUB(8, 40) IRQ_STUB(9, 41) IRQ_STUB(10, 42) IRQ_STUB(11, 43)
+IRQ_STUB(12, 44) IRQ_STUB(13, 45) IRQ_STUB(14, 46) IRQ_STUB(15, 47)
+
+static void (*const irq_stubs[IRQ_COUNT])(void) = {
+    irq_stub_0, irq_stub_1, irq_stub_2, irq_stub_3,
+    irq_stub_4, irq_stub_5, irq_stub_6, irq_stub_7,
+    irq_stub_8, irq_stub_9, irq_stub_10, irq_stub_11,
+    irq_stub_12, irq_stub_13, irq_stub_14, irq_stub_15
+};
+
+// Save registers, switch to kernel data segments and build an InterruptFrame
+asm(".globl interrupt_common\n"
+    "interrupt_common:\n"
+    "    pusha\n"
+    "    mov %ds, %eax\n"
+    "    push %eax\n"
+    "    mov $0x10, %ax\n"
+    "    mov %ax, %ds\n"
+    "    mov %ax, %es\n"
+    "    mov %ax, %fs\n"
+    "    mov %ax, %gs\n"
+    "    push %esp\n"
+    "    call interrupt_dispatch\n"
+    "    add $4, %esp\n"
+    "    pop %eax\n"
+    "    mov %ax, %ds\n"
+    "    mov %ax, %es\n"
+    "    mov %ax, %fs\n"
+    "    mov %ax, %gs\n"
+    "    popa\n"
+    "    add $8, %esp\n"
+    "    iret\n");
+
+// Save callee-saved registers and iret into ring 3
+asm(".globl enter_user_mode\n"
+    "enter_user_mode:\n"
+    "    push %ebp\n"
+    "    push %ebx\n"
+    "    push %esi\n"
+    "    push %edi\n"
+    "    mov %esp, user_return_esp\n"
+    "    pushf\n"
+    "    popl user_flags\n"
+    "    mov 20(%esp), %eax\n"
+    "    mov 24(%esp), %ecx\n"
+    "    mov $0x23, %dx\n"
+    "    mov %dx, %ds\n"
+    "    mov %dx, %es\n"
+    "    mov %dx, %fs\n"
+    "    mov %dx, %gs\n"
+    "    push $0x23\n"
+    "    push %ecx\n"
+    "    pushf\n"
+    "    push $0x1B\n"
+    "    push %eax\n"
+    "    iret\n");
+
+// Like enter_user_mode(), but restore every register from a UserContext
+asm(".globl resume_user_mode\n"
+    "resume_user_mode:\n"
+    "    push %ebp\n"
+    "    push %ebx\n"
+    "    push %esi\n"
+    "    push %edi\n"
+    "    mov %esp, user_return_esp\n"
+    "    pushf\n"
+    "    popl user_flags\n"
+    "    mov 20(%esp), %esp\n"
+    "    mov $0x23, %ax\n"
+    "    mov %ax, %fs\n"
+    "    mov %ax, %gs\n"
+    "    popa\n"
+    "    pop %es\n"
+    "    pop %ds\n"
+    "    iret\n");
+
+// Drop the ring 0 stack we are on and return from enter_user_mode()
+// or resume_user_mode()
+asm(".globl leave_user_mode\n"
+    "leave_user_mode:\n"
+    "    mov 4(%esp), %eax\n"
+    "    mov user_return_esp, %esp\n"
+    "    mov $0x10, %dx\n"
+    "    mov %dx, %ds\n"
+    "    mov %dx, %es\n"
+    "    mov %dx, %fs\n"
+    "    mov %dx, %gs\n"
+    "    pop %edi\n"
+    "    pop %esi\n"
+    "    pop %ebx\n"
+    "    pop %ebp\n"
+    "    ret\n");
+
+static void gdt_set_entry(int i, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    gdt[i].limit_low = limit & 0xFFFF;
+    gdt[i].base_low = base & 0xFFFF;
+    gdt[i].base_mid = (base >> 16) & 0xFF;
+    gdt[i].access = access;
+    gdt[i].granularity = ((limit >> 16) & 0x0F) | (flags << 4);
+    gdt[i].base_high = (base >> 24) & 0xFF;
+}
+
+void idt_set_gate(int vector, void (*handler)(void), uint8_t flags) {
+    uint32_t offset = (uint32_t)handler;
+    idt[vector].offset_low = offset & 0xFFFF;
+    idt[vector].selector = KERNEL_CODE_SEG;
+    idt[vector].zero = 0;
+    idt[vector].flags = flags;
+    idt[vector].offset_high = offset >> 16;
+}
+
+void register_interrupt_handler(int vector, interrupt_handler handler) {
+    if (vector >= 0 && vector < EXCEPTION_COUNT) {
+        handlers[vector] = handler;
+    }
+}
+
+// Remap the PICs so IRQs do not collide with CPU exceptions, every line
+// masked. The keyboard and disk are polled; drivers unmask what they use.
+static void init_pic(void) {
+    outb(PIC1_COMMAND, PIC_INIT);
+    outb(PIC2_COMMAND, PIC_INIT);
+    outb(PIC1_DATA, IRQ_BASE);
+    outb(PIC2_DATA, IRQ_BASE + 8);
+    outb(PIC1_DATA, 0x04);       // Slave on IRQ2
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, PIC_8086);
+    outb(PIC2_DATA, PIC_8086);
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+// Handler runs with interrupts off; the EOI is sent after it returns
+void register_irq_handler(int irq, interrupt_handler handler) {
+    if (irq >= 0 && irq < IRQ_COUNT) {
+        handlers[IRQ_BASE + irq] = handler;
+    }
+}
+
+void enable_irq(int irq) {
+    if (irq < 8) {
+        outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+    } else {
+        outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << 2));
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (irq - 8)));
+    }
+}
+
+void disable_irq(int irq) {
+    if (irq < 8) {
+        outb(PIC1_DATA, inb(PIC1_DATA) | (1 << irq));
+    } else {
+        outb(PIC2_DATA, inb(PIC2_DATA) | (1 << (irq - 8)));
+    }
+}
+
+// Spurious IRQ 7 and 15 show up with their ISR bit clear and get no EOI
+static int irq_spurious(int irq) {
+    if (irq != 7 && irq != 15) {
+        return 0;
+    }
+    uint16_t port = irq == 7 ? PIC1_COMMAND : PIC2_COMMAND;
+    outb(port, 0x0B);            // OCW3: read the in-service register
+    if (inb(port) & 0x80) {
+        return 0;
+    }
+    if (irq == 15) {
+        outb(PIC1_COMMAND, PIC_EOI);     // The master did see the cascade
+    }
+    return 1;
+}
+
+static void irq_dispatch(InterruptFrame* frame) {
+    int irq = frame->vector - IRQ_BASE;
+    if (irq_spurious(irq)) {
+        return;
+    }
+    if (handlers[frame->vector]) {
+        handlers[frame->vector](frame);
+    }
+    if (irq >= 8) {
+        outb(PIC2_COMMAND, PIC_EOI);
+    }
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
+// Stack the CPU switches to on entry from ring 3
+void set_kernel_stack(uint32_t esp) {
+    tss.esp0 = esp;
+}
+
+int cpu_has_sysenter(void) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx >> 11) & 1;
+}
+
+// Called from interrupt_common for CPU exceptions and IRQs
+void interrupt_dispatch(InterruptFrame* frame) {
+    if (frame->vector >= IRQ_BASE && frame->vector < HANDLER_COUNT) {
+        irq_dispatch(frame);
+        return;
+    }
+    if (frame->vector < EXCEPTION_COUNT && handlers[frame->vector]) {
+        handlers[frame->vector](frame);
+        return;
+    }
+
+    // A faulting user program is stopped, the kernel carries on
+    if ((frame->cs & 3) == 3) {
+        print_string("\nUser program fault: exception ");
+        print_int(frame->vector);
+        print_string(" at EIP ");
+        print_int(frame->eip);
+        print_char('\n');
+        leave_user_mode(-1);
+    }
+
+    print_string("\nKernel panic: exception ");
+    print_int(frame->vector);
+    print_string(" at EIP ");
+    print_int(frame->eip);
+    print_string("\nSystem halted.\n");
+    while (1) {
+        asm volatile ("cli; hlt");
+    }
+}
+
+// Initialize GDT, TSS and IDT
+void init_cpu(void) {
+    // Flat 4GB segments for ring 0 and ring 3
+    gdt_set_entry(0, 0, 0, 0, 0);
+    gdt_set_entry(1, 0, 0xFFFFF, 0x9A, 0xC);   // Kernel code
+    gdt_set_entry(2, 0, 0xFFFFF, 0x92, 0xC);   // Kernel data
+    gdt_set_entry(3, 0, 0xFFFFF, 0xFA, 0xC);   // User code
+    gdt_set_entry(4, 0, 0xFFFFF, 0xF2, 0xC);   // User data
+    gdt_set_entry(5, (uint32_t)&tss, sizeof(Tss) - 1, 0x89, 0x0);
+
+    tss.ss0 = KERNEL_DATA_SEG;
+    tss.esp0 = (uint32_t)&kernel_stack[KERNEL_STACK_SIZE];
+    tss.iomap_base = sizeof(Tss);
+
+    TablePointer gdt_ptr = { sizeof(gdt) - 1, (uint32_t)gdt };
+    asm volatile (
+        "lgdt %0\n"
+        "ljmp $0x08, $1f\n"
+        "1:\n"
+        "mov $0x10, %%ax\n"
+        "mov %%ax, %%ds\n"
+        "mov %%ax, %%es\n"
+        "mov %%ax, %%fs\n"
+        "mov %%ax, %%gs\n"
+        "mov %%ax, %%ss\n"
+        : : "m"(gdt_ptr) : "eax", "memory");
+    asm volatile ("ltr %%ax" : : "a"(TSS_SEG));
+
+    for (int i = 0; i < EXCEPTION_COUNT; i++) {
+        idt_set_gate(i, exception_stubs[i], IDT_KERNEL_GATE);
+    }
+    init_pic();
+    for (int i = 0; i < IRQ_COUNT; i++) {
+        idt_set_gate(IRQ_BASE + i, irq_stubs[i], IDT_KERNEL_GATE);
+    }
+
+    TablePointer idt_ptr = { sizeof(idt) - 1, (uint32_t)idt };
+    asm volatile ("lidt %0" : : "m"(idt_ptr));
+}
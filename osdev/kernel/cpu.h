@@ -0,0 +1,59 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+// Segment selectors (order is fixed by sysenter/sysexit)
+#define KERNEL_CODE_SEG 0x08
+#define KERNEL_DATA_SEG 0x10
+#define USER_CODE_SEG 0x1B
+#define USER_DATA_SEG 0x23
+#define TSS_SEG 0x28
+
+// IDT gate types
+#define IDT_KERNEL_GATE 0x8E     // Present, DPL 0, 32-bit interrupt gate
+#define IDT_USER_GATE 0xEE       // Present, DPL 3, 32-bit interrupt gate
+
+// Hardware interrupts, remapped past the CPU exceptions
+#define IRQ_BASE 32
+#define IRQ_COUNT 16
+#define IRQ_TIMER 0
+
+// Register state pushed by the interrupt stubs
+typedef struct {
+    uint32_t ds;
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+    uint32_t vector, error_code;
+    uint32_t eip, cs, eflags, user_esp, user_ss;
+} InterruptFrame;
+
+typedef void (*interrupt_handler)(InterruptFrame* frame);
+
+// User registers saved by the int 0x80 entry, enough to resume a process
+typedef struct {
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+    uint32_t es, ds;
+    uint32_t eip, cs, eflags, user_esp, user_ss;
+} UserContext;
+
+// CPU setup
+void init_cpu(void);
+void idt_set_gate(int vector, void (*handler)(void), uint8_t flags);
+void register_interrupt_handler(int vector, interrupt_handler handler);
+void register_irq_handler(int irq, interrupt_handler handler);
+void enable_irq(int irq);
+void disable_irq(int irq);
+void set_kernel_stack(uint32_t esp);
+int cpu_has_sysenter(void);
+
+// Run code in ring 3 until it calls leave_user_mode()
+int enter_user_mode(void (*entry)(void), void* user_stack);
+int resume_user_mode(const UserContext* context);
+void leave_user_mode(int code) __attribute__((noreturn));
+
+// Model-specific registers
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "fwcfg.h"
+#include "io.h"
+#include "../include/kernel.h"
+
+// Legacy I/O port interface
+#define FW_CFG_SELECTOR 0x510
+#define FW_CFG_DATA 0x511
+
+// Well-known items
+#define FW_CFG_SIGNATURE 0x0000
+#define FW_CFG_FILE_DIR 0x0019
+
+#define FW_CFG_NAME_SIZE 56
+
+// Directory entry; the device stores numbers big-endian
+typedef struct {
+    uint32_t size;
+    uint16_t select;
+    uint16_t reserved;
+    char name[FW_CFG_NAME_SIZE];
+} __attribute__((packed)) FwCfgFile;
+
+static void fw_cfg_select(uint16_t item) {
+    outw(FW_CFG_SELECTOR, item);
+}
+
+// Read the next bytes of the selected item
+static void fw_cfg_read(void* buffer, uint32_t size) {
+    uint8_t* out = buffer;
+    for (uint32_t i = 0; i < size; i++) {
+        out[i] = inb(FW_CFG_DATA);
+    }
+}
+
+static uint32_t be32(uint32_t value) {
+    return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+}
+
+static uint16_t be16(uint16_t value) {
+    return (uint16_t)((value >> 8) | (value << 8));
+}
+
+int fw_cfg_present(void) {
+    char signature[4];
+    fw_cfg_select(FW_CFG_SIGNATURE);
+    fw_cfg_read(signature, sizeof(signature));
+    return signature[0] == 'Q' && signature[1] == 'E' && signature[2] == 'M' && signature[3] == 'U';
+}
+
+int fw_cfg_read_file(const char* name, void* buffer, uint32_t size) {
+    if (!fw_cfg_present()) {
+        return -1;
+    }
+
+    uint32_t count;
+    fw_cfg_select(FW_CFG_FILE_DIR);
+    fw_cfg_read(&count, sizeof(count));
+    count = be32(count);
+
+    // The directory is read in one pass; stop at the entry we want
+    for (uint32_t i = 0; i < count; i++) {
+        FwCfgFile file;
+        fw_cfg_read(&file, sizeof(file));
+        file.name[FW_CFG_NAME_SIZE - 1] = '\0';
+        if (strcmp(file.name, name) != 0) {
+            continue;
+        }
+        uint32_t length = be32(file.size);
+        if (length > size) {
+            length = size;
+        }
+        fw_cfg_select(be16(file.select));
+        fw_cfg_read(buffer, length);
+        return length;
+    }
+    return -1;
+}
@@ -0,0 +1,14 @@
+#ifndef FWCFG_H
+#define FWCFG_H
+
+#include <stdint.h>
+
+// QEMU's firmware configuration device. Files given with
+// -fw_cfg name=opt/...,file=... can be read by name.
+int fw_cfg_present(void);
+
+// Copy up to size bytes of the named file into buffer. Returns the
+// number of bytes copied, or -1 if there is no such file.
+int fw_cfg_read_file(const char* name, void* buffer, uint32_t size);
+
+#endif
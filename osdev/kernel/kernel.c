@@ -1,11 +1,34 @@
 #include "kernel.h"
 #include "screen.h"
 #include "keyboard.h"
+#include "timer.h"
+#include "cpu.h"
+#include "io.h"
+#include "ata.h"
+#include "virtio_blk.h"
+#include "serial.h"
+#include "fwcfg.h"
+#include "multiboot.h"
+#include "../include/syscall.h"
 #include "../process/process.h"
+#include "../process/ipc.h"
 #include "../shell/shell.h"
+#include "../shell/commands.h"
 #include "../fs/fs.h"
+#include "../fs/block.h"
+#include "../fs/initrd.h"
+#include "../mm/memory.h"
+#include "../mm/paging.h"
 #include <stddef.h>
 
+// Sample user programs embedded by the Makefile (*_elf.o)
+extern const char _binary_hello_elf_start[];
+extern const char _binary_hello_elf_end[];
+extern const char _binary_forktest_elf_start[];
+extern const char _binary_forktest_elf_end[];
+extern const char _binary_maptest_elf_start[];
+extern const char _binary_maptest_elf_end[];
+
 // Video memory constants
 #define VIDEO_MEMORY 0xB8000
 #define VGA_WIDTH 80
@@ -21,10 +44,15 @@ static int buffer_size = 0;   // Current size of buffer content
 static int cursor_x = 0;
 static int cursor_y = 0;
 static int shift_pressed = 0;  // Track shift key state
+static int ctrl_pressed = 0;   // Track control key state
+static output_sink current_sink = NULL;  // Where print_* output goes, NULL for the screen
+static int serial_mirror = 0;            // Copy screen output to COM1
 
 // Function declarations (only for static functions)
 static void scroll_screen(void);
+static void put_char(char c);
 static void display_boot_logo(void);
+static void install_program(const char* name, const char* start, const char* end);
 
 // Keyboard ports
 #define KEYBOARD_DATA_PORT 0x60
@@ -33,15 +61,29 @@ static void display_boot_logo(void);
 // QEMU/Bochs shutdown ports
 #define QEMU_SHUTDOWN_PORT 0x604
 #define BOCHS_SHUTDOWN_PORT 0x8900
+#define QEMU_DEBUG_EXIT_PORT 0xF4        // -device isa-debug-exit,iobase=0xf4
+
+// Script QEMU passes in for unattended runs (make bench)
+#define BOOT_SCRIPT "opt/agran/script"
 
 // Keyboard scancodes
 #define SCANCODE_PAGE_UP 0x49
 #define SCANCODE_PAGE_DOWN 0x51
 #define SCANCODE_SHIFT 0x2A
 #define SCANCODE_SHIFT_RELEASE 0xAA
+#define SCANCODE_RIGHT_SHIFT 0x36
+#define SCANCODE_RIGHT_SHIFT_RELEASE 0xB6
+#define SCANCODE_CTRL 0x1D
+#define SCANCODE_CTRL_RELEASE 0x9D
+#define SCANCODE_ESCAPE 0x01
 #define SCANCODE_EXTENDED 0xE0
 #define SCANCODE_UP_ARROW 0x48
 #define SCANCODE_DOWN_ARROW 0x50
+#define SCANCODE_LEFT_ARROW 0x4B
+#define SCANCODE_RIGHT_ARROW 0x4D
+#define SCANCODE_HOME 0x47
+#define SCANCODE_END 0x4F
+#define SCANCODE_DELETE 0x53
 
 // Boot logo
 static const char* BOOT_LOGO[] = {
@@ -63,20 +105,14 @@ static const char scancode_to_ascii[] = {
     '*', 0, ' '
 };
 
-// I/O functions
-static inline uint8_t inb(uint16_t port) {
-    uint8_t ret;
-    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
-    return ret;
-}
-
-static inline void outb(uint16_t port, uint8_t val) {
-    asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
-}
-
-static inline void outw(uint16_t port, uint16_t val) {
-    asm volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
-}
+// The same keys with shift held
+static const char scancode_to_ascii_shift[] = {
+    0, 0, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', '\b',
+    '\t', 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',
+    0, 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~',
+    0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0,
+    '*', 0, ' '
+};
 
 // Update hardware cursor position
 void update_cursor(void) {
@@ -169,99 +205,111 @@ void scroll_up() {
 }
 
 void print_string(const char* str) {
+    if (current_sink != NULL) {
+        current_sink(str, strlen(str));
+        return;
+    }
+
+    // The hardware cursor is moved once per string, not per character
     for(int i = 0; str[i] != '\0'; i++) {
-        if(str[i] == '\n') {
-            cursor_x = 0;
-            cursor_y++;
-            if(cursor_y >= VGA_HEIGHT) {
-                scroll_screen();
-                cursor_y = VGA_HEIGHT - 1;
-            }
-            update_cursor();
-            continue;
-        }
-        
-        if(str[i] == '\b') {
-            backspace();
-            continue;
-        }
-        
-        if(cursor_x >= VGA_WIDTH) {
-            cursor_x = 0;
-            cursor_y++;
-            if(cursor_y >= VGA_HEIGHT) {
-                scroll_screen();
-                cursor_y = VGA_HEIGHT - 1;
-            }
-        }
-        
-        const int index = cursor_y * VGA_WIDTH + cursor_x;
-        video_memory[index] = (uint16_t)str[i] | (uint16_t)VGA_WHITE_ON_BLACK << 8;
-        cursor_x++;
-        update_cursor();
+        put_char(str[i]);
     }
+    update_cursor();
 }
 
-char getchar(void) {
+// Next key typed, or 0 if there is none yet
+char poll_key(void) {
     static int extended = 0;
-    while(1) {
-        if((inb(KEYBOARD_STATUS_PORT) & 1) != 0) {
-            uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+    while((inb(KEYBOARD_STATUS_PORT) & 1) != 0) {
+        uint8_t scancode = inb(KEYBOARD_DATA_PORT);
 
-            if(scancode == SCANCODE_EXTENDED) {
-                extended = 1;
-                continue;
-            }
+        if(scancode == SCANCODE_EXTENDED) {
+            extended = 1;
+            continue;
+        }
 
-            if(extended) {
-                extended = 0;
-                if(scancode == SCANCODE_UP_ARROW) return 0x80;   // Up arrow
-                if(scancode == SCANCODE_DOWN_ARROW) return 0x81; // Down arrow
-                continue;
-            }
+        if(extended) {
+            extended = 0;
+            if(scancode == SCANCODE_UP_ARROW) return KEY_UP;
+            if(scancode == SCANCODE_DOWN_ARROW) return KEY_DOWN;
+            if(scancode == SCANCODE_LEFT_ARROW) return KEY_LEFT;
+            if(scancode == SCANCODE_RIGHT_ARROW) return KEY_RIGHT;
+            if(scancode == SCANCODE_HOME) return KEY_HOME;
+            if(scancode == SCANCODE_END) return KEY_END;
+            if(scancode == SCANCODE_DELETE) return KEY_DELETE;
+            if(scancode == SCANCODE_CTRL) ctrl_pressed = 1;          // Right ctrl
+            if(scancode == SCANCODE_CTRL_RELEASE) ctrl_pressed = 0;
+            continue;
+        }
+
+        // Modifier releases, before other releases are dropped
+        if(scancode == SCANCODE_SHIFT_RELEASE || scancode == SCANCODE_RIGHT_SHIFT_RELEASE) {
+            shift_pressed = 0;
+            continue;
+        }
+        if(scancode == SCANCODE_CTRL_RELEASE) {
+            ctrl_pressed = 0;
+            continue;
+        }
 
-            // Ignore key releases (when the highest bit is set)
-            if(scancode & 0x80) {
+        // Ignore key releases (when the highest bit is set)
+        if(scancode & 0x80) {
+            continue;
+        }
+        
+        // Handle special keys
+        switch(scancode) {
+            case SCANCODE_SHIFT:
+            case SCANCODE_RIGHT_SHIFT:
+                shift_pressed = 1;
                 continue;
-            }
-            
-            // Handle special keys
-            switch(scancode) {
-                case SCANCODE_SHIFT:
-                    shift_pressed = 1;
+            case SCANCODE_CTRL:
+                ctrl_pressed = 1;
+                continue;
+            case SCANCODE_ESCAPE:
+                return KEY_ESCAPE;
+            case SCANCODE_PAGE_UP:
+            case SCANCODE_UP_ARROW:
+                if(shift_pressed) {
+                    scroll_up();
                     continue;
-                case SCANCODE_SHIFT_RELEASE:
-                    shift_pressed = 0;
+                }
+                break;
+            case SCANCODE_PAGE_DOWN:
+            case SCANCODE_DOWN_ARROW:
+                if(shift_pressed) {
+                    scroll_down();
                     continue;
-                case SCANCODE_PAGE_UP:
-                case SCANCODE_UP_ARROW:
-                    if(shift_pressed) {
-                        scroll_up();
-                        continue;
-                    }
-                    break;
-                case SCANCODE_PAGE_DOWN:
-                case SCANCODE_DOWN_ARROW:
-                    if(shift_pressed) {
-                        scroll_down();
-                        continue;
-                    }
-                    break;
-            }
-            
-            // Convert scancode to ASCII if in valid range
-            if(scancode < sizeof(scancode_to_ascii)) {
-                char c = scancode_to_ascii[scancode];
-                if(c != 0) {  // Valid character
-                    // Handle shift key for letters
-                    if(shift_pressed && c >= 'a' && c <= 'z') {
-                        c = c - 'a' + 'A';  // Convert to uppercase
-                    }
-                    return c;
                 }
+                break;
+        }
+        
+        // Convert scancode to ASCII if in valid range
+        if(scancode < sizeof(scancode_to_ascii)) {
+            char c = shift_pressed ? scancode_to_ascii_shift[scancode]
+                                   : scancode_to_ascii[scancode];
+            if(c != 0) {  // Valid character
+                // Ctrl+letter gives the control code (Ctrl-R is 0x12)
+                if(ctrl_pressed && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+                    return KEY_CTRL(c);
+                }
+                return c;
             }
         }
     }
+    return 0;
+}
+
+char getchar(void) {
+    while(1) {
+        char c = poll_key();
+        if(c != 0) {
+            return c;
+        }
+        // Nothing typed yet: move queued disk I/O along meanwhile
+        poll_block_queue();
+        update_load_average();
+    }
 }
 
 int strcmp(const char* s1, const char* s2) {
@@ -342,16 +390,57 @@ static void display_boot_logo(void) {
     for(volatile int i = 0; i < 80000000; i++) {}  // Increased final delay
 }
 
+// Copy a program embedded in the kernel image into the fs (it is already
+// there if the fs is on disk)
+static void install_program(const char* name, const char* start, const char* end) {
+    if (get_file_size(name) < 0) {
+        create_file(name);
+    }
+    write_file_data(name, start, end - start);
+}
+
 // Kernel entry point
-void __attribute__((section(".text.boot"))) kmain(void) {
+void kmain(uint32_t magic, uint32_t boot_info) {
+    mark_boot(BOOT_ENTRY);
+
     // Initialize hardware
     init_screen();
+    init_serial();
     init_keyboard();
+    init_cpu();        // Install GDT, TSS and IDT
+    init_memory();     // Physical frame allocator
+    init_multiboot(magic, (const MultibootInfo*)boot_info);  // Memory map, modules
+    init_paging();     // Identity map RAM, enable paging
+    init_syscalls();   // int 0x80 gate and sysenter MSRs
+    init_timer();      // Calibrate TSC for benchmarks
     
     // Initialize subsystems
     init_scheduler();  // Initialize process scheduler
+    init_ipc();        // Initialize mailboxes
+    init_virtio_blk(); // Probe for a virtio disk, preferred if present
+    init_ata();        // Probe the IDE disk
+    uint32_t initrd_length;
+    const void* initrd = get_initrd_location(&initrd_length);
+    init_initrd(initrd, initrd_length);  // Boot module or boot.asm's copy, if any
     init_fs();        // Initialize file system
     
+    // Install the sample programs so they can be started with exec
+    install_program("hello", _binary_hello_elf_start, _binary_hello_elf_end);
+    install_program("forktest", _binary_forktest_elf_start, _binary_forktest_elf_end);
+    install_program("maptest", _binary_maptest_elf_start, _binary_maptest_elf_end);
+    sync_fs();
+    mark_boot(BOOT_READY);
+
+    // Unattended run: execute the script QEMU passed in with the console
+    // mirrored to the serial port, then exit with its status
+    static char boot_script[MAX_CONTENT];
+    int script_size = fw_cfg_read_file(BOOT_SCRIPT, boot_script, sizeof(boot_script));
+    if (script_size >= 0) {
+        mirror_console(1);
+        int status = run_script(BOOT_SCRIPT, boot_script, script_size);
+        qemu_exit(status == 0 ? 0 : 1);
+    }
+    
     // Display boot logo
     display_boot_logo();
     
@@ -373,6 +462,13 @@ void shutdown(void) {
     while(1) { asm volatile("cli; hlt"); }
 }
 
+// Leave QEMU with exit status (code << 1) | 1 through the isa-debug-exit
+// device; without one, power off
+void qemu_exit(int code) {
+    outl(QEMU_DEBUG_EXIT_PORT, code);
+    shutdown();
+}
+
 void reboot(void) {
     asm volatile("cli");
     uint8_t good = 0x02;
@@ -383,7 +479,69 @@ void reboot(void) {
 }
 
 // Video functions
+// Route console output somewhere other than the screen (NULL restores
+// the screen). Returns the previous sink so callers can nest.
+output_sink set_output_sink(output_sink sink) {
+    output_sink previous = current_sink;
+    current_sink = sink;
+    return previous;
+}
+
 void print_char(char c) {
+    if (current_sink != NULL) {
+        current_sink(&c, 1);
+        return;
+    }
+    put_char(c);
+    update_cursor();
+}
+
+// Print bytes that need not be NUL-terminated
+void write_console(const char* data, int length) {
+    if (current_sink != NULL) {
+        current_sink(data, length);
+        return;
+    }
+    write_screen(data, length);
+}
+
+// Always draws on the screen, whatever sink is installed
+void write_screen(const char* data, int length) {
+    for (int i = 0; i < length; i++) {
+        put_char(data[i]);
+    }
+    update_cursor();
+}
+
+// Move the cursor by delta cells, wrapping between rows, without
+// touching what is on the screen. A cursor just past the last column
+// (waiting to wrap) is at the next row's first cell.
+void move_cursor(int delta) {
+    int offset = cursor_y * VGA_WIDTH + cursor_x + delta;
+    if (offset < 0) {
+        offset = 0;
+    }
+    cursor_y = offset / VGA_WIDTH;
+    cursor_x = offset % VGA_WIDTH;
+    if (cursor_y >= VGA_HEIGHT) {
+        cursor_y = VGA_HEIGHT - 1;
+        cursor_x = offset - cursor_y * VGA_WIDTH;
+    }
+    update_cursor();
+}
+
+// Copy everything drawn on the screen to the serial port as well.
+// Returns the previous setting.
+int mirror_console(int on) {
+    int previous = serial_mirror;
+    serial_mirror = on && serial_present();
+    return previous;
+}
+
+static void put_char(char c) {
+    if (serial_mirror) {
+        serial_write(&c, 1);
+    }
     if (c == '\n') {
         cursor_x = 0;
         cursor_y++;
@@ -391,7 +549,6 @@ void print_char(char c) {
             scroll_screen();
             cursor_y = VGA_HEIGHT - 1;
         }
-        update_cursor();
         return;
     }
     
@@ -406,7 +563,6 @@ void print_char(char c) {
             const int index = cursor_y * VGA_WIDTH + cursor_x;
             video_memory[index] = (uint16_t)' ' | (uint16_t)VGA_WHITE_ON_BLACK << 8;
         }
-        update_cursor();
         return;
     }
     
@@ -422,7 +578,6 @@ void print_char(char c) {
     const int index = cursor_y * VGA_WIDTH + cursor_x;
     video_memory[index] = (uint16_t)c | (uint16_t)VGA_WHITE_ON_BLACK << 8;
     cursor_x++;
-    update_cursor();
 }
 
 void print_int(int num) {
@@ -547,4 +702,29 @@ void* memset(void* s, int c, size_t n) {
         *p++ = (unsigned char)c;
     }
     return s;
-} 
\ No newline at end of file
+}
+
+void* memcpy(void* dest, const void* src, size_t n) {
+    unsigned char* d = dest;
+    const unsigned char* s = src;
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
+// Like memcpy, but the regions may overlap
+void* memmove(void* dest, const void* src, size_t n) {
+    unsigned char* d = dest;
+    const unsigned char* s = src;
+    if (d < s) {
+        while (n--) {
+            *d++ = *s++;
+        }
+    } else {
+        while (n--) {
+            d[n] = s[n];
+        }
+    }
+    return dest;
+}
@@ -5,9 +5,21 @@
 #define KEYBOARD_DATA_PORT 0x60
 #define KEYBOARD_STATUS_PORT 0x64
 
+// Keys returned by getchar() that have no ASCII code
+#define KEY_ESCAPE 0x1B
+#define KEY_UP 0x80
+#define KEY_DOWN 0x81
+#define KEY_LEFT 0x82
+#define KEY_RIGHT 0x83
+#define KEY_HOME 0x84
+#define KEY_END 0x85
+#define KEY_DELETE 0x86
+#define KEY_CTRL(c) ((c) & 0x1F)     // Ctrl+letter, e.g. KEY_CTRL('r')
+
 // Keyboard functions
 void init_keyboard(void);
 char getchar(void);
+char poll_key(void);
 void handle_keypress(void);
 
 #endif 
\ No newline at end of file
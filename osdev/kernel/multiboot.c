@@ -0,0 +1,104 @@
+#include "multiboot.h"
+#include "../mm/memory.h"
+#include "../fs/initrd.h"
+#include "../include/kernel.h"
+#include <stddef.h>
+
+#define BOOT_STACK 0x90000       // KERNEL_STACK in boot.asm
+
+#define MULTIBOOT_HEADER_FLAGS (MULTIBOOT_PAGE_ALIGN | MULTIBOOT_MEMORY_INFO | MULTIBOOT_AOUT_KLUDGE)
+#define STRING(x) #x
+#define VALUE(x) STRING(x)
+
+// The first bytes of the image, where boot.asm calls and loaders look
+// for the header (within 8KB of the file's start, 4-byte aligned). The
+// addresses come from linker.ld: everything up to __image_end is loaded
+// from the file at its link address. bss_end_addr stays 0 so QEMU does
+// not copy a buffer over the VGA and BIOS hole below .bss. A loader such
+// as GRUB may leave anything in that RAM, so multiboot_entry zeroes
+// __bss_start..__bss_end itself before calling kmain.
+// boot.asm clears eax, which tells the two entries apart.
+asm(".section .text.boot\n"
+    ".globl _start\n"
+    "_start:\n"
+    "    jmp multiboot_entry\n"
+    ".align 4\n"
+    "multiboot_header:\n"
+    "    .long " VALUE(MULTIBOOT_HEADER_MAGIC) "\n"
+    "    .long " VALUE(MULTIBOOT_HEADER_FLAGS) "\n"
+    "    .long -(" VALUE(MULTIBOOT_HEADER_MAGIC) " + " VALUE(MULTIBOOT_HEADER_FLAGS) ")\n"
+    "    .long multiboot_header\n"     // header_addr
+    "    .long __image_start\n"        // load_addr
+    "    .long __image_end\n"          // load_end_addr
+    "    .long 0\n"                    // bss_end_addr
+    "    .long multiboot_entry\n"      // entry_addr
+    "multiboot_entry:\n"
+    "    cli\n"
+    "    cld\n"
+    "    mov $" VALUE(BOOT_STACK) ", %esp\n"
+    "    mov %eax, %edx\n"            // Keep the magic
+    "    mov $__bss_start, %edi\n"
+    "    mov $__bss_end, %ecx\n"
+    "    sub %edi, %ecx\n"
+    "    xor %eax, %eax\n"
+    "    rep stosb\n"
+    "    mov %edx, %eax\n"
+    "    push %ebx\n"
+    "    push %eax\n"
+    "    call kmain\n"
+    "1:  hlt\n"
+    "    jmp 1b\n"
+    ".previous\n");
+
+static const void* initrd_start = (const void*)INITRD_ADDRESS;
+static uint32_t initrd_length = INITRD_MAX_SIZE;
+
+// Whether the map lists [start, end) as RAM
+static int is_ram(const MultibootInfo* info, uint32_t start, uint32_t end) {
+    uint32_t offset = 0;
+    while (offset + sizeof(MultibootMemory) <= info->mmap_length) {
+        const MultibootMemory* entry = (const MultibootMemory*)(info->mmap_addr + offset);
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && entry->address <= start &&
+            entry->address + entry->length >= end) {
+            return 1;
+        }
+        offset += entry->size + sizeof(entry->size);
+    }
+    return 0;
+}
+
+int init_multiboot(uint32_t magic, const MultibootInfo* info) {
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
+        return 0;
+    }
+
+    // The frame allocator assumes MEMORY_SIZE of RAM; give up what the
+    // loader says is not there
+    if (info->flags & MULTIBOOT_INFO_MEM_MAP) {
+        for (uint32_t frame = FRAME_BASE; frame < MEMORY_SIZE; frame += PAGE_SIZE) {
+            if (!is_ram(info, frame, frame + PAGE_SIZE)) {
+                reserve_frames(frame, frame + PAGE_SIZE);
+            }
+        }
+    } else if (info->flags & MULTIBOOT_INFO_MEMORY) {
+        reserve_frames(0x100000 + info->mem_upper * 1024, MEMORY_SIZE);
+    }
+
+    // Modules stay where the loader put them; the first is the initrd
+    initrd_start = NULL;
+    initrd_length = 0;
+    if ((info->flags & MULTIBOOT_INFO_MODS) && info->mods_count > 0) {
+        const MultibootModule* modules = (const MultibootModule*)info->mods_addr;
+        for (uint32_t i = 0; i < info->mods_count; i++) {
+            reserve_frames(modules[i].start, modules[i].end);
+        }
+        initrd_start = (const void*)modules[0].start;
+        initrd_length = modules[0].end - modules[0].start;
+    }
+    return 1;
+}
+
+const void* get_initrd_location(uint32_t* length) {
+    *length = initrd_length;
+    return initrd_start;
+}
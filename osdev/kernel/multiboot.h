@@ -0,0 +1,64 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+// Multiboot (version 1) lets QEMU's -kernel or GRUB load kernel.elf
+// straight into protected mode, with the initrd as a boot module. The
+// header in multiboot.c gives the load addresses itself, so loaders copy
+// the image to 0x10000 as boot.asm does and leave .bss alone; the entry
+// code clears it.
+#define MULTIBOOT_HEADER_MAGIC 0x1BADB002
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002   // In eax at entry
+
+// Header flags
+#define MULTIBOOT_PAGE_ALIGN 0x00000001      // Modules start on pages
+#define MULTIBOOT_MEMORY_INFO 0x00000002     // Pass mem_* and the map
+#define MULTIBOOT_AOUT_KLUDGE 0x00010000     // Use the header's addresses
+
+// MultibootInfo flags: which fields the loader filled in
+#define MULTIBOOT_INFO_MEMORY 0x00000001
+#define MULTIBOOT_INFO_MODS 0x00000008
+#define MULTIBOOT_INFO_MEM_MAP 0x00000040
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+typedef struct {
+    uint32_t flags;
+    uint32_t mem_lower;          // KB below 1MB
+    uint32_t mem_upper;          // KB from 1MB up to the first hole
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;          // MultibootModule array
+    uint32_t syms[4];
+    uint32_t mmap_length;        // Bytes of MultibootMemory entries
+    uint32_t mmap_addr;
+} MultibootInfo;
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;                // Exclusive
+    uint32_t cmdline;
+    uint32_t reserved;
+} MultibootModule;
+
+// Entries vary in length: size counts the bytes after itself
+typedef struct __attribute__((packed)) {
+    uint32_t size;
+    uint64_t address;
+    uint64_t length;
+    uint32_t type;
+} MultibootMemory;
+
+// Take what the loader passed in (magic and info as kmain received them):
+// frames the memory map does not list as RAM, or that hold a module, are
+// reserved. Call after init_memory, before anything allocates a frame.
+// Returns 1 when booted through multiboot, 0 when booted by boot.asm.
+int init_multiboot(uint32_t magic, const MultibootInfo* info);
+
+// Where the initrd is and how many bytes it may span: the first boot
+// module, or boot.asm's fixed load address
+const void* get_initrd_location(uint32_t* length);
+
+#endif
@@ -0,0 +1,44 @@
+#include "pci.h"
+#include "io.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+
+static void pci_select(const PciDevice* device, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | ((uint32_t)device->bus << 16) |
+         ((uint32_t)device->slot << 11) | ((uint32_t)device->function << 8) | (offset & 0xFC));
+}
+
+uint32_t pci_read(const PciDevice* device, uint8_t offset) {
+    pci_select(device, offset);
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write(const PciDevice* device, uint8_t offset, uint32_t value) {
+    pci_select(device, offset);
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// Brute-force scan; functions other than 0 are only probed on
+// multi-function devices
+int pci_find_device(uint16_t vendor, uint16_t device, PciDevice* found) {
+    uint32_t wanted = ((uint32_t)device << 16) | vendor;
+    for (int bus = 0; bus < 256; bus++) {
+        for (int slot = 0; slot < 32; slot++) {
+            PciDevice candidate = {(uint8_t)bus, (uint8_t)slot, 0};
+            uint32_t ids = pci_read(&candidate, PCI_VENDOR_ID);
+            if ((ids & 0xFFFF) == 0xFFFF) {
+                continue;    // Empty slot
+            }
+            int functions = (pci_read(&candidate, PCI_HEADER_TYPE) & 0x800000) ? 8 : 1;
+            for (int function = 0; function < functions; function++) {
+                candidate.function = (uint8_t)function;
+                if (pci_read(&candidate, PCI_VENDOR_ID) == wanted) {
+                    *found = candidate;
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
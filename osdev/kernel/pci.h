@@ -0,0 +1,32 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+// Configuration space registers
+#define PCI_VENDOR_ID 0x00
+#define PCI_COMMAND 0x04
+#define PCI_HEADER_TYPE 0x0C     // Byte 2 of this dword
+#define PCI_BAR0 0x10
+
+// Command register bits
+#define PCI_COMMAND_IO 0x0001
+#define PCI_COMMAND_MASTER 0x0004
+#define PCI_COMMAND_NO_INTX 0x0400
+
+typedef struct {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+} PciDevice;
+
+// Configuration space through mechanism #1 (ports 0xCF8/0xCFC); offsets
+// are dword aligned
+uint32_t pci_read(const PciDevice* device, uint8_t offset);
+void pci_write(const PciDevice* device, uint8_t offset, uint32_t value);
+
+// Find the first function with the given IDs. Returns 0, or -1 if there
+// is none.
+int pci_find_device(uint16_t vendor, uint16_t device, PciDevice* found);
+
+#endif
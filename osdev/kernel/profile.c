@@ -0,0 +1,54 @@
+#include "profile.h"
+#include "symbols.h"
+#include "timer.h"
+#include "cpu.h"
+#include "../include/kernel.h"
+
+static uint32_t symbol_samples[PROFILE_MAX_SYMBOLS];
+static uint32_t samples = 0;
+static uint32_t user_samples = 0;
+
+// IRQ 0: charge the tick to whatever it interrupted
+static void profile_tick(InterruptFrame* frame) {
+    samples++;
+    if ((frame->cs & 3) == 3) {
+        user_samples++;
+        return;
+    }
+    int index = find_symbol(frame->eip);
+    if (index >= 0 && index < PROFILE_MAX_SYMBOLS) {
+        symbol_samples[index]++;
+    }
+}
+
+void profile_start(int hz) {
+    for (int i = 0; i < PROFILE_MAX_SYMBOLS; i++) {
+        symbol_samples[i] = 0;
+    }
+    samples = 0;
+    user_samples = 0;
+
+    register_irq_handler(IRQ_TIMER, profile_tick);
+    set_timer_rate(hz);
+    enable_irq(IRQ_TIMER);
+    asm volatile ("sti");
+}
+
+// The rest of the kernel runs with interrupts off
+void profile_stop(void) {
+    asm volatile ("cli");
+    disable_irq(IRQ_TIMER);
+    register_irq_handler(IRQ_TIMER, NULL);
+}
+
+uint32_t get_profile_samples(void) {
+    return samples;
+}
+
+uint32_t get_profile_user_samples(void) {
+    return user_samples;
+}
+
+uint32_t get_profile_symbol_samples(int index) {
+    return index >= 0 && index < PROFILE_MAX_SYMBOLS ? symbol_samples[index] : 0;
+}
@@ -0,0 +1,20 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#define PROFILE_HZ 1000              // Samples per second
+#define PROFILE_MAX_SYMBOLS 1024
+
+// Sampling profiler: while running, every timer tick records the
+// interrupted EIP, counted against the kernel function it falls in
+void profile_start(int hz);
+void profile_stop(void);
+
+// Samples since profile_start(): in total, in ring 3, and per kernel
+// symbol index (see kernel/symbols.h)
+uint32_t get_profile_samples(void);
+uint32_t get_profile_user_samples(void);
+uint32_t get_profile_symbol_samples(int index);
+
+#endif
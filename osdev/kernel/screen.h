@@ -12,6 +12,18 @@ void clear_screen(void);
 void print_char(char c);
 void print_string(const char* str);
 void update_cursor(void);
+void move_cursor(int delta);
+
+// Output redirection: while a sink is installed, print_char, print_string
+// and write_console hand their bytes to it instead of the screen
+typedef void (*output_sink)(const char* data, int length);
+output_sink set_output_sink(output_sink sink);
+void write_console(const char* data, int length);
+void write_screen(const char* data, int length);
+
+// Copy everything drawn on the screen to COM1 as well (a no-op without
+// a serial port). Returns the previous setting.
+int mirror_console(int on);
 
 // Internal functions - not exposed in header
 // void backspace(void);
@@ -0,0 +1,56 @@
+#include "serial.h"
+#include "io.h"
+
+#define COM1 0x3F8
+
+// UART registers, offsets from the base port
+#define UART_DATA 0            // Divisor low byte while DLAB is set
+#define UART_INTERRUPTS 1      // Divisor high byte while DLAB is set
+#define UART_FIFO 2
+#define UART_LINE_CONTROL 3
+#define UART_MODEM_CONTROL 4
+#define UART_LINE_STATUS 5
+
+#define LINE_DLAB 0x80
+#define LINE_8N1 0x03
+#define STATUS_TX_EMPTY 0x20
+#define MODEM_LOOPBACK 0x10
+#define MODEM_READY 0x0B       // DTR, RTS and OUT2
+
+#define SERIAL_TIMEOUT 100000
+
+static int present = 0;
+
+// Program COM1 and check it echoes a byte in loopback mode; without a
+// working port serial_write() does nothing
+void init_serial(void) {
+    outb(COM1 + UART_INTERRUPTS, 0x00);
+    outb(COM1 + UART_LINE_CONTROL, LINE_DLAB);
+    outb(COM1 + UART_DATA, 0x01);             // 115200 / 1
+    outb(COM1 + UART_INTERRUPTS, 0x00);
+    outb(COM1 + UART_LINE_CONTROL, LINE_8N1);
+    outb(COM1 + UART_FIFO, 0xC7);             // Enable and clear FIFOs
+
+    outb(COM1 + UART_MODEM_CONTROL, MODEM_LOOPBACK | MODEM_READY);
+    outb(COM1 + UART_DATA, 0xAE);
+    present = inb(COM1 + UART_DATA) == 0xAE;
+    outb(COM1 + UART_MODEM_CONTROL, MODEM_READY);
+}
+
+int serial_present(void) {
+    return present;
+}
+
+void serial_write(const char* data, int length) {
+    if (!present) {
+        return;
+    }
+    for (int i = 0; i < length; i++) {
+        for (int wait = 0; wait < SERIAL_TIMEOUT; wait++) {
+            if (inb(COM1 + UART_LINE_STATUS) & STATUS_TX_EMPTY) {
+                break;
+            }
+        }
+        outb(COM1 + UART_DATA, data[i]);
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+// COM1, 115200 baud 8N1, polled
+void init_serial(void);
+int serial_present(void);
+void serial_write(const char* data, int length);
+
+#endif
@@ -0,0 +1,21 @@
+#include "symbols.h"
+
+int find_symbol(uint32_t address) {
+    int low = 0;
+    int high = kernel_symbol_count - 1;
+    int found = -1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (kernel_symbols[middle].address <= address) {
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return found;
+}
+
+const char* get_symbol_name(int index) {
+    return &kernel_symbol_names[kernel_symbols[index].name];
+}
@@ -0,0 +1,22 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdint.h>
+
+// Kernel function addresses, sorted. The table is generated from
+// kernel.elf by tools/mksyms and linked into a second pass of the kernel
+// (see the Makefile); names are offsets into kernel_symbol_names.
+typedef struct {
+    uint32_t address;
+    uint32_t name;
+} KernelSymbol;
+
+extern const KernelSymbol kernel_symbols[];
+extern const int kernel_symbol_count;
+extern const char kernel_symbol_names[];
+
+// Index of the function containing address, -1 if it is below them all
+int find_symbol(uint32_t address);
+const char* get_symbol_name(int index);
+
+#endif
@@ -0,0 +1,279 @@
+#include "../include/syscall.h"
+#include "../include/kernel.h"
+#include "cpu.h"
+#include "../fs/fs.h"
+#include "../process/process.h"
+#include "../process/ipc.h"
+#include "../mm/paging.h"
+
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+#define SYSENTER_STACK_SIZE 8192
+#define MAX_USER_STRING 4096     // Longest text SYS_WRITE prints
+
+typedef int (*syscall_fn)(uint32_t a1, uint32_t a2, uint32_t a3);
+
+static uint8_t sysenter_stack[SYSENTER_STACK_SIZE] __attribute__((aligned(16)));
+
+// Registers of the caller, set by the int 0x80 entry only
+UserContext* current_context;
+
+void syscall_int80_entry(void);
+void syscall_sysenter_entry(void);
+
+// int 0x80: save a full UserContext, pass eax/ebx/esi/edi to the
+// dispatcher and return its result in the saved eax
+asm(".globl syscall_int80_entry\n"
+    "syscall_int80_entry:\n"
+    "    push %ds\n"
+    "    push %es\n"
+    "    pusha\n"
+    "    mov %esp, current_context\n"
+    "    mov $0x10, %cx\n"
+    "    mov %cx, %ds\n"
+    "    mov %cx, %es\n"
+    "    push %edi\n"
+    "    push %esi\n"
+    "    push %ebx\n"
+    "    push %eax\n"
+    "    call syscall_dispatch\n"
+    "    add $16, %esp\n"
+    "    mov %eax, 28(%esp)\n"
+    "    popa\n"
+    "    pop %es\n"
+    "    pop %ds\n"
+    "    iret\n");
+
+// sysenter: segments are flat, so only the return ESP/EIP need saving.
+// No UserContext is built, so calls that need one fail on this path.
+// Interrupts go back on (perf's timer) if ring 3 had them; sti holds
+// them off for one more instruction, so none arrives before sysexit.
+asm(".globl syscall_sysenter_entry\n"
+    "syscall_sysenter_entry:\n"
+    "    movl $0, current_context\n"
+    "    push %ecx\n"
+    "    push %edx\n"
+    "    push %edi\n"
+    "    push %esi\n"
+    "    push %ebx\n"
+    "    push %eax\n"
+    "    call syscall_dispatch\n"
+    "    add $16, %esp\n"
+    "    pop %edx\n"
+    "    pop %ecx\n"
+    "    testl $0x200, user_flags\n"
+    "    jz 1f\n"
+    "    sti\n"
+    "1:  sysexit\n");
+
+// Pointer arguments come from ring 3 and are checked before the kernel
+// follows them (see check_user_range)
+static int user_string(uint32_t str, uint32_t max) {
+    return check_user_string(str, max) < 0 ? -1 : 0;
+}
+
+static int sys_exit(uint32_t code, uint32_t a2, uint32_t a3) {
+    (void)a2;
+    (void)a3;
+    leave_user_mode((int)code);
+}
+
+static int sys_write(uint32_t str, uint32_t a2, uint32_t a3) {
+    (void)a2;
+    (void)a3;
+    if (user_string(str, MAX_USER_STRING) != 0) {
+        return -1;
+    }
+    print_string((const char*)str);
+    return 0;
+}
+
+static int sys_getpid(uint32_t a1, uint32_t a2, uint32_t a3) {
+    (void)a1;
+    (void)a2;
+    (void)a3;
+    return get_current_pid();
+}
+
+static int sys_create(uint32_t name, uint32_t a2, uint32_t a3) {
+    (void)a2;
+    (void)a3;
+    if (user_string(name, MAX_PATH) != 0) {
+        return -1;
+    }
+    return create_file((const char*)name);
+}
+
+static int sys_write_file(uint32_t name, uint32_t content, uint32_t a3) {
+    (void)a3;
+    if (user_string(name, MAX_PATH) != 0 || user_string(content, MAX_FILE_SIZE) != 0) {
+        return -1;
+    }
+    return write_file((const char*)name, (const char*)content);
+}
+
+// Fills buffer with the file's first size - 1 bytes at most, NUL
+// terminated
+static int sys_read_file(uint32_t name, uint32_t buffer, uint32_t size) {
+    if (user_string(name, MAX_PATH) != 0 || size == 0 ||
+        check_user_range(buffer, size, 1) != 0) {
+        return -1;
+    }
+    int count = read_file_at((const char*)name, 0, (char*)buffer, size - 1);
+    if (count < 0) {
+        return -1;
+    }
+    ((char*)buffer)[count] = '\0';
+    return 0;
+}
+
+static int sys_delete(uint32_t name, uint32_t a2, uint32_t a3) {
+    (void)a2;
+    (void)a3;
+    if (user_string(name, MAX_PATH) != 0) {
+        return -1;
+    }
+    return delete_file((const char*)name);
+}
+
+static int sys_spawn(uint32_t name, uint32_t burst_time, uint32_t a3) {
+    (void)a3;
+    if (user_string(name, MAX_PATH) != 0) {
+        return -1;
+    }
+    return create_process((const char*)name, (int)burst_time);
+}
+
+static int sys_kill(uint32_t pid, uint32_t a2, uint32_t a3) {
+    (void)a2;
+    (void)a3;
+    if (!is_process_alive((int)pid)) {
+        return -1;
+    }
+    if ((int)pid == get_current_pid()) {
+        leave_user_mode(-1);    // run_process ends the process
+    }
+    kill_process((int)pid);
+    return 0;
+}
+
+static int sys_yield(uint32_t a1, uint32_t a2, uint32_t a3) {
+    (void)a1;
+    (void)a2;
+    (void)a3;
+    schedule();
+    return 0;
+}
+
+// A user program cannot sleep in the kernel, so its IPC calls never
+// block: a full or empty mailbox gives IPC_WOULD_BLOCK and the program
+// retries
+static int sys_send(uint32_t to, uint32_t msg, uint32_t flags) {
+    if (check_user_range(msg, sizeof(Message), 0) != 0) {
+        return IPC_ERROR;
+    }
+    return ipc_send(get_current_pid(), (int)to, (const Message*)msg, (int)flags | IPC_NONBLOCK);
+}
+
+static int sys_recv(uint32_t msg, uint32_t flags, uint32_t a3) {
+    (void)a3;
+    if (check_user_range(msg, sizeof(Message), 1) != 0) {
+        return IPC_ERROR;
+    }
+    return ipc_recv(get_current_pid(), (Message*)msg, (int)flags | IPC_NONBLOCK);
+}
+
+// Returns the child PID to the parent; the child resumes with 0
+static int sys_fork(uint32_t a1, uint32_t a2, uint32_t a3) {
+    (void)a1;
+    (void)a2;
+    (void)a3;
+    if (current_context == NULL) {
+        return -1;  // Must come through int 0x80
+    }
+    return fork_process(get_current_pid(), current_context);
+}
+
+// Map a whole file into the caller's address space. Returns the address
+// (the file's bytes, zeros past its end), storing the size if asked to.
+static int sys_mmap(uint32_t name, uint32_t writable, uint32_t size) {
+    AddressSpace* space = get_current_space();
+    if (space == NULL || user_string(name, MAX_PATH) != 0 ||
+        (size != 0 && check_user_range(size, sizeof(int), 1) != 0)) {
+        return 0;
+    }
+    int file = open_file((const char*)name);
+    if (file < 0) {
+        return 0;
+    }
+    int bytes = get_file_size((const char*)name);
+    uint32_t addr = map_file(space, file, bytes, writable != 0);
+    if (addr == 0) {
+        print_string("Error: Cannot map file\n");
+        return 0;
+    }
+    if (size != 0) {
+        *(int*)size = bytes;
+    }
+    return (int)addr;
+}
+
+// Write what was changed through a mapping to the disk
+static int sys_msync(uint32_t addr, uint32_t a2, uint32_t a3) {
+    (void)a2;
+    (void)a3;
+    AddressSpace* space = get_current_space();
+    if (space == NULL || sync_file_mapping(space, addr) != 0) {
+        return -1;
+    }
+    return sync_fs();
+}
+
+static int sys_munmap(uint32_t addr, uint32_t a2, uint32_t a3) {
+    (void)a2;
+    (void)a3;
+    AddressSpace* space = get_current_space();
+    if (space == NULL || unmap_file(space, addr) != 0) {
+        return -1;
+    }
+    return sync_fs();
+}
+
+static const syscall_fn syscall_table[SYSCALL_COUNT] = {
+    [SYS_EXIT] = sys_exit,
+    [SYS_WRITE] = sys_write,
+    [SYS_GETPID] = sys_getpid,
+    [SYS_CREATE] = sys_create,
+    [SYS_WRITE_FILE] = sys_write_file,
+    [SYS_READ_FILE] = sys_read_file,
+    [SYS_DELETE] = sys_delete,
+    [SYS_SPAWN] = sys_spawn,
+    [SYS_KILL] = sys_kill,
+    [SYS_YIELD] = sys_yield,
+    [SYS_SEND] = sys_send,
+    [SYS_RECV] = sys_recv,
+    [SYS_FORK] = sys_fork,
+    [SYS_MMAP] = sys_mmap,
+    [SYS_MSYNC] = sys_msync,
+    [SYS_MUNMAP] = sys_munmap,
+};
+
+// Common entry for both paths
+int syscall_dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3) {
+    if (num >= SYSCALL_COUNT) {
+        return -1;
+    }
+    return syscall_table[num](a1, a2, a3);
+}
+
+// Install the int 0x80 gate and, when supported, the sysenter MSRs
+void init_syscalls(void) {
+    idt_set_gate(SYSCALL_VECTOR, syscall_int80_entry, IDT_USER_GATE);
+
+    if (cpu_has_sysenter()) {
+        wrmsr(MSR_SYSENTER_CS, KERNEL_CODE_SEG);
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t)&sysenter_stack[SYSENTER_STACK_SIZE]);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t)syscall_sysenter_entry);
+    }
+}
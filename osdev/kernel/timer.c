@@ -0,0 +1,95 @@
+#include "timer.h"
+#include "io.h"
+#include "../include/kernel.h"
+
+// PIT constants
+#define PIT_FREQUENCY 1193182
+#define PIT_CHANNEL0_PORT 0x40
+#define PIT_CHANNEL2_PORT 0x42
+#define PIT_COMMAND_PORT 0x43
+#define PIT_GATE_PORT 0x61
+#define CALIBRATE_MS 10
+
+static uint32_t tsc_khz = 0;
+static uint64_t boot_marks[BOOT_MILESTONES];
+
+// Measure the TSC rate against a one-shot count on PIT channel 2
+void init_timer(void) {
+    uint16_t latch = PIT_FREQUENCY / (1000 / CALIBRATE_MS);
+
+    // Enable the channel 2 gate, keep the speaker off
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(PIT_COMMAND_PORT, 0xB0);
+    outb(PIT_CHANNEL2_PORT, latch & 0xFF);
+    outb(PIT_CHANNEL2_PORT, latch >> 8);
+
+    uint64_t start = rdtsc();
+    while ((inb(PIT_GATE_PORT) & 0x20) == 0) {}
+    uint64_t end = rdtsc();
+
+    tsc_khz = div_u64(end - start, CALIBRATE_MS);
+    if (tsc_khz == 0) {
+        tsc_khz = 1;  // Never divide by zero later on
+    }
+}
+
+// Make PIT channel 0 raise IRQ 0 hz times a second (mode 2, rate generator)
+void set_timer_rate(int hz) {
+    uint32_t divisor = PIT_FREQUENCY / hz;
+    if (divisor < 1) divisor = 1;
+    if (divisor > 0xFFFF) divisor = 0xFFFF;
+    outb(PIT_COMMAND_PORT, 0x34);
+    outb(PIT_CHANNEL0_PORT, divisor & 0xFF);
+    outb(PIT_CHANNEL0_PORT, divisor >> 8);
+}
+
+uint32_t get_tsc_khz(void) {
+    return tsc_khz;
+}
+
+// 64-by-32 bit division without libgcc; the quotient must fit in 32 bits
+uint32_t div_u64(uint64_t n, uint32_t d) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t quotient;
+
+    if (hi >= d) {
+        return 0xFFFFFFFF;  // Saturate instead of faulting
+    }
+    asm ("divl %2" : "=a"(quotient), "+d"(hi) : "rm"(d), "a"(lo));
+    return quotient;
+}
+
+// Convert a cycle count to nanoseconds
+uint32_t cycles_to_ns(uint64_t cycles) {
+    return div_u64(cycles * 1000000, tsc_khz);
+}
+
+uint32_t cycles_to_us(uint64_t cycles) {
+    return div_u64(cycles * 1000, tsc_khz);
+}
+
+// Events per second given the cycles they took in total
+uint32_t rate_per_sec(uint32_t count, uint64_t cycles) {
+    uint64_t scaled = (uint64_t)count * tsc_khz * 1000;
+
+    if (cycles == 0) {
+        return 0;
+    }
+    // Shrink both sides until the divisor fits in 32 bits
+    while (cycles >> 32) {
+        cycles >>= 1;
+        scaled >>= 1;
+    }
+    return div_u64(scaled, (uint32_t)cycles);
+}
+
+void mark_boot(int milestone) {
+    boot_marks[milestone] = rdtsc();
+}
+
+uint64_t get_boot_mark(int milestone) {
+    return boot_marks[milestone];
+}
@@ -0,0 +1,29 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// Read the CPU time-stamp counter
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Timer functions
+void init_timer(void);
+void set_timer_rate(int hz);
+uint32_t get_tsc_khz(void);
+uint32_t div_u64(uint64_t n, uint32_t d);
+uint32_t cycles_to_ns(uint64_t cycles);
+uint32_t cycles_to_us(uint64_t cycles);
+uint32_t rate_per_sec(uint32_t count, uint64_t cycles);
+
+// Boot milestones, kept as TSC readings (cycles since reset)
+#define BOOT_ENTRY 0             // kmain reached
+#define BOOT_READY 1             // Subsystems up, the shell can start
+#define BOOT_MILESTONES 2
+void mark_boot(int milestone);
+uint64_t get_boot_mark(int milestone);
+
+#endif
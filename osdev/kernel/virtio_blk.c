@@ -0,0 +1,293 @@
+#include "virtio_blk.h"
+#include "pci.h"
+#include "io.h"
+#include "timer.h"
+#include "../include/kernel.h"
+#include "../fs/block.h"
+
+#define VIRTIO_VENDOR 0x1AF4
+#define VIRTIO_BLK_DEVICE 0x1001    // Transitional block device
+
+// Legacy registers, offsets from the I/O port base in BAR0
+#define VIRTIO_HOST_FEATURES 0x00
+#define VIRTIO_GUEST_FEATURES 0x04
+#define VIRTIO_QUEUE_PFN 0x08
+#define VIRTIO_QUEUE_SIZE 0x0C
+#define VIRTIO_QUEUE_SELECT 0x0E
+#define VIRTIO_QUEUE_NOTIFY 0x10
+#define VIRTIO_STATUS 0x12
+#define VIRTIO_BLK_CAPACITY 0x14    // 64-bit sector count (no MSI-X)
+
+// Device status
+#define VIRTIO_ACKNOWLEDGE 1
+#define VIRTIO_DRIVER 2
+#define VIRTIO_DRIVER_OK 4
+#define VIRTIO_FAILED 128
+
+#define VIRTIO_BLK_F_FLUSH (1 << 9)
+
+// Request types and status
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_FLUSH 4
+#define VIRTIO_BLK_S_OK 0
+
+// Ring flags
+#define VRING_DESC_F_NEXT 1
+#define VRING_DESC_F_WRITE 2         // The device writes this buffer
+#define VRING_AVAIL_F_NO_INTERRUPT 1
+#define VRING_USED_F_NO_NOTIFY 1
+
+#define VIRTQ_MAX_SIZE 256           // QEMU's default queue size
+#define VIRTQ_ALIGN 4096
+#define VIRTIO_TIMEOUT_MS 5000
+
+typedef struct {
+    uint64_t address;
+    uint32_t length;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) VirtqDesc;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t index;
+    uint16_t ring[];
+} __attribute__((packed)) VirtqAvail;
+
+typedef struct {
+    uint32_t id;
+    uint32_t length;
+} __attribute__((packed)) VirtqUsedElem;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t index;
+    VirtqUsedElem ring[];
+} __attribute__((packed)) VirtqUsed;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) VirtioBlkHeader;
+
+// The legacy layout: descriptors and the available ring, then the used
+// ring on the next aligned page. The device is given physical addresses;
+// kernel memory is identity mapped, so buffers are passed as they are.
+static uint8_t ring[3 * VIRTQ_ALIGN] __attribute__((aligned(VIRTQ_ALIGN)));
+static VirtqDesc* descriptors;
+static volatile VirtqAvail* avail;
+static volatile VirtqUsed* used;
+static uint16_t queue_size;
+static uint16_t io_base;
+static int can_flush;
+static int broken;                   // A request timed out
+
+// Each round of requests fills the descriptor table from the start; the
+// next round begins once the device has used them all
+static uint16_t next_descriptor = 0;
+static uint16_t posted = 0;          // Chains made available
+
+// Per chain, indexed by its first descriptor
+static VirtioBlkHeader headers[VIRTQ_MAX_SIZE];
+static volatile uint8_t statuses[VIRTQ_MAX_SIZE];
+
+static void add_descriptor(const volatile void* address, uint32_t length, uint16_t flags) {
+    VirtqDesc* desc = &descriptors[next_descriptor];
+    desc->address = (uint32_t)address;
+    desc->length = length;
+    desc->flags = flags;
+    desc->next = next_descriptor + 1;
+    next_descriptor++;
+}
+
+// Whether a chain of count descriptors fits in this round
+static int chain_fits(int count) {
+    return next_descriptor + count <= queue_size;
+}
+
+// A request chain is a header, the data buffers and a status byte
+static uint16_t start_chain(uint32_t type, uint32_t lba) {
+    uint16_t head = next_descriptor;
+    headers[head].type = type;
+    headers[head].reserved = 0;
+    headers[head].sector = lba;
+    statuses[head] = 0xFF;
+    add_descriptor(&headers[head], sizeof(VirtioBlkHeader), VRING_DESC_F_NEXT);
+    return head;
+}
+
+static void add_data(void* buffer, uint32_t length, int write) {
+    add_descriptor(buffer, length, VRING_DESC_F_NEXT | (write ? 0 : VRING_DESC_F_WRITE));
+}
+
+static void end_chain(uint16_t head) {
+    add_descriptor(&statuses[head], 1, VRING_DESC_F_WRITE);
+    avail->ring[posted % queue_size] = head;
+    posted++;
+}
+
+// Make the round's chains available with one notification, unless the
+// device said it is still processing and needs none, then poll the used
+// ring until it has taken them all. Interrupts are suppressed, so a
+// round costs one VM exit however many requests it holds.
+static int run_round(void) {
+    __sync_synchronize();            // Chains before the index
+    avail->index = posted;
+    __sync_synchronize();            // Index before reading the flags
+    if (!(used->flags & VRING_USED_F_NO_NOTIFY)) {
+        outw(io_base + VIRTIO_QUEUE_NOTIFY, 0);
+    }
+
+    uint64_t start = rdtsc();
+    uint64_t limit = (uint64_t)get_tsc_khz() * VIRTIO_TIMEOUT_MS;
+    while (used->index != posted) {
+        if (rdtsc() - start > limit) {
+            print_string("Error: virtio disk not responding\n");
+            broken = 1;
+            return -1;
+        }
+        asm volatile ("pause");
+    }
+    __sync_synchronize();            // Index before the statuses
+    next_descriptor = 0;
+    return 0;
+}
+
+static int run_chain(uint16_t head) {
+    if (run_round() != 0) {
+        return -1;
+    }
+    return statuses[head] == VIRTIO_BLK_S_OK ? 0 : -1;
+}
+
+static int virtio_transfer(uint32_t lba, uint32_t count, void* buffer, int write) {
+    if (broken) {
+        return -1;
+    }
+    uint16_t head = start_chain(write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, lba);
+    add_data(buffer, count * SECTOR_SIZE, write);
+    end_chain(head);
+    return run_chain(head);
+}
+
+static int virtio_read(uint32_t lba, uint32_t count, void* buffer) {
+    return virtio_transfer(lba, count, buffer, 0);
+}
+
+static int virtio_write(uint32_t lba, uint32_t count, const void* buffer) {
+    return virtio_transfer(lba, count, (void*)buffer, 1);
+}
+
+static int virtio_flush(void) {
+    if (!can_flush) {
+        return 0;    // No write cache to flush
+    }
+    if (broken) {
+        return -1;
+    }
+    uint16_t head = start_chain(VIRTIO_BLK_T_FLUSH, 0);
+    end_chain(head);
+    return run_chain(head);
+}
+
+// Run the round holding transfers from up to to and set their status
+static void finish_round(BlockTransfer* transfers, const uint16_t* heads, int from, int to) {
+    int status = run_round();
+    for (int i = from; i < to; i++) {
+        transfers[i].status = status == 0 && statuses[heads[i]] == VIRTIO_BLK_S_OK ? 0 : -1;
+    }
+}
+
+// Merged runs go out scatter-gather, a descriptor per request buffer, so
+// they need no bounce buffer; as many as fit share a round
+static void virtio_transfer_batch(BlockTransfer* transfers, int count) {
+    uint16_t heads[BLOCK_BATCH];
+    int from = 0;
+    for (int i = 0; i < count; i++) {
+        int length = 2;
+        for (BlockRequest* r = transfers[i].first; r != transfers[i].end; r = r->next) {
+            length++;
+        }
+        if (!broken && !chain_fits(length)) {
+            finish_round(transfers, heads, from, i);
+            from = i;
+        }
+        if (broken) {
+            transfers[i].status = -1;
+            continue;
+        }
+
+        heads[i] = start_chain(transfers[i].write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN,
+                               transfers[i].lba);
+        for (BlockRequest* r = transfers[i].first; r != transfers[i].end; r = r->next) {
+            add_data(r->buffer, r->count * BLOCK_SIZE, transfers[i].write);
+        }
+        end_chain(heads[i]);
+    }
+    if (from < count && !broken) {
+        finish_round(transfers, heads, from, count);
+    }
+}
+
+static BlockDevice virtio_device = {
+    .name = "virtio0",
+    .read = virtio_read,
+    .write = virtio_write,
+    .flush = virtio_flush,
+    .transfer_batch = virtio_transfer_batch,
+};
+
+void init_virtio_blk(void) {
+    PciDevice pci;
+    if (pci_find_device(VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &pci) != 0) {
+        return;
+    }
+    uint32_t bar = pci_read(&pci, PCI_BAR0);
+    if (!(bar & 1)) {
+        return;    // The legacy interface is in I/O space
+    }
+    io_base = bar & 0xFFFC;
+    // Polled: bus mastering on, its interrupt line off
+    uint32_t command = pci_read(&pci, PCI_COMMAND) & 0xFFFF;
+    pci_write(&pci, PCI_COMMAND,
+              command | PCI_COMMAND_IO | PCI_COMMAND_MASTER | PCI_COMMAND_NO_INTX);
+
+    outb(io_base + VIRTIO_STATUS, 0);    // Reset
+    outb(io_base + VIRTIO_STATUS, VIRTIO_ACKNOWLEDGE);
+    outb(io_base + VIRTIO_STATUS, VIRTIO_ACKNOWLEDGE | VIRTIO_DRIVER);
+    uint32_t features = inl(io_base + VIRTIO_HOST_FEATURES);
+    can_flush = (features & VIRTIO_BLK_F_FLUSH) != 0;
+    outl(io_base + VIRTIO_GUEST_FEATURES, features & VIRTIO_BLK_F_FLUSH);
+
+    // The device picks the queue size; the largest merged transfer
+    // must fit in one chain
+    outw(io_base + VIRTIO_QUEUE_SELECT, 0);
+    queue_size = inw(io_base + VIRTIO_QUEUE_SIZE);
+    if (queue_size > VIRTQ_MAX_SIZE || queue_size < BLOCK_MAX_MERGE + 2) {
+        print_string("Error: unsupported virtio queue size\n");
+        outb(io_base + VIRTIO_STATUS, VIRTIO_FAILED);
+        return;
+    }
+
+    memset(ring, 0, sizeof(ring));
+    uint32_t avail_end = queue_size * sizeof(VirtqDesc) + sizeof(VirtqAvail) +
+                         (queue_size + 1) * sizeof(uint16_t);
+    descriptors = (VirtqDesc*)ring;
+    avail = (volatile VirtqAvail*)(ring + queue_size * sizeof(VirtqDesc));
+    used = (volatile VirtqUsed*)(ring + ((avail_end + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1)));
+    avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+    next_descriptor = 0;
+    posted = 0;
+    broken = 0;
+    outl(io_base + VIRTIO_QUEUE_PFN, (uint32_t)ring / VIRTQ_ALIGN);
+    outb(io_base + VIRTIO_STATUS, VIRTIO_ACKNOWLEDGE | VIRTIO_DRIVER | VIRTIO_DRIVER_OK);
+
+    uint32_t high = inl(io_base + VIRTIO_BLK_CAPACITY + 4);
+    virtio_device.sectors = high != 0 ? 0xFFFFFFFF : inl(io_base + VIRTIO_BLK_CAPACITY);
+    if (virtio_device.sectors == 0) {
+        return;
+    }
+    register_block_device(&virtio_device);
+}
@@ -0,0 +1,8 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+// Find a virtio block device on the PCI bus (QEMU's virtio-blk-pci,
+// legacy interface) and register it as a block device
+void init_virtio_blk(void);
+
+#endif
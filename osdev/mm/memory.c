@@ -0,0 +1,92 @@
+#include "memory.h"
+#include "../include/kernel.h"
+
+// One bit per frame above FRAME_BASE, set when in use
+static uint32_t frame_bitmap[FRAME_COUNT / 32];
+static uint16_t frame_refs[FRAME_COUNT];   // Address spaces sharing each frame
+static int free_frames = 0;
+static int next_search = 0;      // Word to start the next search from
+
+// Initialize the frame allocator
+void init_memory(void) {
+    for (int i = 0; i < FRAME_COUNT / 32; i++) {
+        frame_bitmap[i] = 0;
+    }
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        frame_refs[i] = 0;
+    }
+    free_frames = FRAME_COUNT;
+    next_search = 0;
+}
+
+// Allocate one 4KB physical frame, returns 0 when out of memory
+uint32_t alloc_frame(void) {
+    for (int n = 0; n < FRAME_COUNT / 32; n++) {
+        int word = (next_search + n) % (FRAME_COUNT / 32);
+        if (frame_bitmap[word] == 0xFFFFFFFF) {
+            continue;  // All 32 frames taken
+        }
+
+        int bit = __builtin_ctz(~frame_bitmap[word]);
+        frame_bitmap[word] |= 1u << bit;
+        frame_refs[word * 32 + bit] = 1;
+        free_frames--;
+        next_search = word;
+        return FRAME_BASE + (uint32_t)(word * 32 + bit) * PAGE_SIZE;
+    }
+    return 0;
+}
+
+static int frame_index(uint32_t frame) {
+    if (frame < FRAME_BASE || frame >= MEMORY_SIZE) {
+        return -1;
+    }
+    return (frame - FRAME_BASE) / PAGE_SIZE;
+}
+
+// Drop one reference, the frame is free when the last one goes
+void free_frame(uint32_t frame) {
+    int index = frame_index(frame);
+    if (index < 0 || frame_refs[index] == 0) {
+        return;
+    }
+
+    if (--frame_refs[index] == 0) {
+        frame_bitmap[index / 32] &= ~(1u << (index % 32));
+        free_frames++;
+    }
+}
+
+// Add a reference to a frame that is already in use
+void ref_frame(uint32_t frame) {
+    int index = frame_index(frame);
+    if (index >= 0 && frame_refs[index] > 0) {
+        frame_refs[index]++;
+    }
+}
+
+void reserve_frames(uint32_t start, uint32_t end) {
+    if (start < FRAME_BASE) {
+        start = FRAME_BASE;
+    }
+    if (end > MEMORY_SIZE) {
+        end = MEMORY_SIZE;
+    }
+    for (uint32_t frame = start & ~(PAGE_SIZE - 1); frame < end; frame += PAGE_SIZE) {
+        int index = frame_index(frame);
+        if (frame_refs[index] == 0) {
+            frame_bitmap[index / 32] |= 1u << (index % 32);
+            frame_refs[index] = 1;
+            free_frames--;
+        }
+    }
+}
+
+int get_frame_refs(uint32_t frame) {
+    int index = frame_index(frame);
+    return index < 0 ? 0 : frame_refs[index];
+}
+
+int get_free_frame_count(void) {
+    return free_frames;
+}
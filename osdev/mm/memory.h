@@ -0,0 +1,25 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+
+#define PAGE_SIZE 4096
+#define MEMORY_SIZE (32 * 1024 * 1024)   // Matches -m 32M in the Makefile
+#define FRAME_BASE 0x200000              // Frames are handed out above 2MB,
+                                         // the kernel .bss sits at 1MB
+#define FRAME_COUNT ((MEMORY_SIZE - FRAME_BASE) / PAGE_SIZE)
+
+// Physical frame allocator; frames are reference counted so
+// copy-on-write pages can be shared between address spaces
+void init_memory(void);
+uint32_t alloc_frame(void);
+void free_frame(uint32_t frame);
+void ref_frame(uint32_t frame);
+int get_frame_refs(uint32_t frame);
+
+// Never hand out the frames overlapping [start, end): RAM the boot loader
+// says is missing, or boot modules. Call before the first alloc_frame.
+void reserve_frames(uint32_t start, uint32_t end);
+int get_free_frame_count(void);
+
+#endif
@@ -0,0 +1,564 @@
+#include "paging.h"
+#include "../include/kernel.h"
+#include "../kernel/cpu.h"
+#include "../fs/fs.h"
+
+#define PAGE_FAULT_VECTOR 14
+#define KERNEL_TABLES (MEMORY_SIZE / (PAGE_SIZE * 1024))
+#define USER_PDE_START (USER_BASE >> 22)
+#define MAX_ADDRESS_SPACES 32
+
+// Page fault error code bits
+#define FAULT_PRESENT 0x1
+#define FAULT_WRITE 0x2
+#define FAULT_USER 0x4
+
+// Kernel directory and the tables identity mapping all of RAM
+static uint32_t kernel_directory[1024] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t kernel_tables[KERNEL_TABLES][1024] __attribute__((aligned(PAGE_SIZE)));
+
+static AddressSpace spaces[MAX_ADDRESS_SPACES];
+static int space_used[MAX_ADDRESS_SPACES];
+static AddressSpace* current_space = NULL;
+
+static inline void load_cr3(uint32_t directory) {
+    asm volatile ("mov %0, %%cr3" : : "r"(directory) : "memory");
+}
+
+static inline uint32_t read_cr2(void) {
+    uint32_t value;
+    asm volatile ("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static Region* find_region(AddressSpace* space, uint32_t addr) {
+    for (int i = 0; i < space->region_count; i++) {
+        Region* r = &space->regions[i];
+        if (addr >= r->start && addr < r->end) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+// Page of r's file holding the byte at virtual address addr
+static int file_index(Region* r, uint32_t addr) {
+    return (r->file_offset + (addr - r->data_start)) / PAGE_SIZE;
+}
+
+// Whether a page can be the file's page-cache page itself: every page of
+// a mapped file, and read-only pages of a program wholly inside its file
+// data, at the same offset within the page as in the file
+static int maps_file_page(Region* r, uint32_t page) {
+    if (r->file < 0) {
+        return 0;
+    }
+    if (r->shared) {
+        return 1;
+    }
+    return !r->writable && page >= r->data_start && page + PAGE_SIZE <= r->data_end &&
+           (r->file_offset - r->data_start) % PAGE_SIZE == 0;
+}
+
+// Map the page-cache page of a file behind a page of its region
+static int fault_in_file_page(AddressSpace* space, Region* r, uint32_t page) {
+    int index = file_index(r, page);
+    char* data = get_file_page(r->file, index, r->writable);
+    if (data == NULL) {
+        return -1;
+    }
+    uint32_t flags = PAGE_PRESENT | PAGE_USER | PAGE_FILE | (r->writable ? PAGE_WRITABLE : 0);
+    if (map_page(space, page, (uint32_t)data, flags) != 0) {
+        put_file_page(r->file, index, data);
+        return -1;
+    }
+    return 0;
+}
+
+// Copy length bytes of a region's file data, from virtual address addr
+// on, a page-cache page at a time
+static int copy_file_data(Region* r, uint32_t addr, uint8_t* dest, uint32_t length) {
+    while (length > 0) {
+        uint32_t offset = r->file_offset + (addr - r->data_start);
+        uint32_t within = offset % PAGE_SIZE;
+        uint32_t n = PAGE_SIZE - within < length ? PAGE_SIZE - within : length;
+        const char* data = get_file_page(r->file, offset / PAGE_SIZE, 0);
+        if (data == NULL) {
+            return -1;
+        }
+        memcpy(dest, data + within, n);
+        put_file_page(r->file, offset / PAGE_SIZE, data);
+        addr += n;
+        dest += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// Fill one page: image or file bytes from every region overlapping it,
+// zeros elsewhere
+static int fault_in_page(AddressSpace* space, uint32_t page) {
+    Region* file = find_region(space, page);
+    if (file != NULL && maps_file_page(file, page)) {
+        return fault_in_file_page(space, file, page);
+    }
+
+    uint32_t frame = alloc_frame();
+    if (frame == 0) {
+        return -1;
+    }
+
+    uint8_t* dest = (uint8_t*)frame;
+    uint32_t flags = PAGE_PRESENT | PAGE_USER;
+    memset(dest, 0, PAGE_SIZE);
+
+    // Segments that are not page aligned can share a page
+    for (int i = 0; i < space->region_count; i++) {
+        Region* r = &space->regions[i];
+        if (page >= r->end || page + PAGE_SIZE <= r->start) {
+            continue;
+        }
+        if (r->writable) {
+            flags |= PAGE_WRITABLE;
+        }
+
+        uint32_t copy_start = page > r->data_start ? page : r->data_start;
+        uint32_t copy_end = page + PAGE_SIZE < r->data_end ? page + PAGE_SIZE : r->data_end;
+        if (copy_start >= copy_end) {
+            continue;
+        }
+        if (r->file < 0) {
+            memcpy(dest + (copy_start - page),
+                   r->data + (copy_start - r->data_start),
+                   copy_end - copy_start);
+        } else if (copy_file_data(r, copy_start, dest + (copy_start - page),
+                                  copy_end - copy_start) != 0) {
+            free_frame(frame);
+            return -1;
+        }
+    }
+
+    if (map_page(space, page, frame, flags) != 0) {
+        free_frame(frame);
+        return -1;
+    }
+    return 0;
+}
+
+// Find the page table entry for a user address, NULL if it has no table
+static uint32_t* get_pte(AddressSpace* space, uint32_t virt) {
+    uint32_t pde = space->page_directory[virt >> 22];
+    if (!(pde & PAGE_PRESENT)) {
+        return NULL;
+    }
+    return &((uint32_t*)(pde & PAGE_FRAME_MASK))[(virt >> 12) & 0x3FF];
+}
+
+// Tell the page cache which of a region's file pages were written since
+// the last call, and clear their dirty bits to notice the next writes.
+// With release, the pages are also unmapped and handed back.
+static void collect_file_pages(AddressSpace* space, Region* r, int release) {
+    for (uint32_t page = r->start; page < r->end; page += PAGE_SIZE) {
+        uint32_t* pte = get_pte(space, page);
+        if (pte == NULL || !(*pte & PAGE_FILE)) {
+            continue;
+        }
+        int index = file_index(r, page);
+        if (*pte & PAGE_DIRTY) {
+            dirty_file_page(r->file, index);
+        }
+        if (release) {
+            put_file_page(r->file, index, (const char*)(*pte & PAGE_FRAME_MASK));
+            *pte = 0;
+            space->pages_mapped--;
+        } else {
+            *pte &= ~PAGE_DIRTY;
+        }
+        if (space == current_space) {
+            asm volatile ("invlpg (%0)" : : "r"(page) : "memory");
+        }
+    }
+}
+
+// Give the writer its own copy of a shared page
+static int break_cow(AddressSpace* space, uint32_t addr) {
+    uint32_t page = addr & PAGE_FRAME_MASK;
+    uint32_t* pte = get_pte(space, page);
+    if (pte == NULL || !(*pte & PAGE_COW)) {
+        return -1;
+    }
+
+    uint32_t old_frame = *pte & PAGE_FRAME_MASK;
+    uint32_t flags = (*pte & ~(PAGE_FRAME_MASK | PAGE_COW)) | PAGE_WRITABLE;
+
+    // Last sharer keeps the frame, nothing to copy
+    if (get_frame_refs(old_frame) == 1) {
+        *pte = old_frame | flags;
+    } else {
+        uint32_t new_frame = alloc_frame();
+        if (new_frame == 0) {
+            return -1;
+        }
+        memcpy((void*)new_frame, (void*)old_frame, PAGE_SIZE);
+        *pte = new_frame | flags;
+        free_frame(old_frame);
+    }
+    asm volatile ("invlpg (%0)" : : "r"(page) : "memory");
+    return 0;
+}
+
+static void page_fault_handler(InterruptFrame* frame) {
+    uint32_t addr = read_cr2();
+
+    // Writes to a shared page copy it, from user code or from a syscall
+    uint32_t write_present = FAULT_PRESENT | FAULT_WRITE;
+    if (current_space && (frame->error_code & write_present) == write_present &&
+        break_cow(current_space, addr) == 0) {
+        return;
+    }
+
+    // Not-present faults inside a region are the lazy mappings
+    if (current_space && !(frame->error_code & FAULT_PRESENT)) {
+        if (find_region(current_space, addr) &&
+            fault_in_page(current_space, addr & PAGE_FRAME_MASK) == 0) {
+            return;  // Retry the faulting instruction
+        }
+    }
+
+    // Bad user addresses end the program, even when a syscall touched them
+    if ((frame->error_code & FAULT_USER) || (current_space && addr >= USER_BASE)) {
+        print_string("\nSegmentation fault at address ");
+        print_int(addr);
+        print_string(" (EIP ");
+        print_int(frame->eip);
+        print_string(")\n");
+        leave_user_mode(-1);
+    }
+
+    print_string("\nKernel panic: page fault at address ");
+    print_int(addr);
+    print_string("\nSystem halted.\n");
+    while (1) {
+        asm volatile ("cli; hlt");
+    }
+}
+
+// Identity map RAM and turn on paging
+void init_paging(void) {
+    for (int t = 0; t < KERNEL_TABLES; t++) {
+        for (int i = 0; i < 1024; i++) {
+            uint32_t addr = (uint32_t)(t * 1024 + i) * PAGE_SIZE;
+            kernel_tables[t][i] = addr | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+        }
+    }
+
+    // Ring 3 code built into the kernel (userdemo, sysbench) runs in the
+    // kernel directory, so its entries allow user access. Process
+    // directories clear PAGE_USER in the same entries instead.
+    for (int i = 0; i < 1024; i++) {
+        kernel_directory[i] = 0;
+    }
+    for (int t = 0; t < KERNEL_TABLES; t++) {
+        kernel_directory[t] = (uint32_t)kernel_tables[t] | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+    }
+
+    for (int i = 0; i < MAX_ADDRESS_SPACES; i++) {
+        space_used[i] = 0;
+    }
+
+    register_interrupt_handler(PAGE_FAULT_VECTOR, page_fault_handler);
+    load_cr3((uint32_t)kernel_directory);
+
+    // Enable paging, and write protection in ring 0 so the kernel
+    // also faults on copy-on-write pages
+    uint32_t cr0;
+    asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= 0x80010000;
+    asm volatile ("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+// New address space sharing the kernel mapping, supervisor only
+AddressSpace* create_address_space(void) {
+    AddressSpace* space = NULL;
+    for (int i = 0; i < MAX_ADDRESS_SPACES; i++) {
+        if (!space_used[i]) {
+            space_used[i] = 1;
+            space = &spaces[i];
+            break;
+        }
+    }
+    if (space == NULL) {
+        return NULL;
+    }
+
+    uint32_t directory = alloc_frame();
+    if (directory == 0) {
+        space_used[space - spaces] = 0;
+        return NULL;
+    }
+
+    space->page_directory = (uint32_t*)directory;
+    memset(space->page_directory, 0, PAGE_SIZE);
+    for (int t = 0; t < KERNEL_TABLES; t++) {
+        space->page_directory[t] = kernel_directory[t] & ~PAGE_USER;
+    }
+    space->region_count = 0;
+    space->pages_mapped = 0;
+    return space;
+}
+
+// Copy an address space for fork(). Page contents are not copied:
+// writable pages become read-only and shared in both spaces, and the
+// first write from either side takes a private copy (break_cow). Mapped
+// files stay shared: the child faults in the same page-cache pages.
+AddressSpace* clone_address_space(AddressSpace* parent) {
+    AddressSpace* child = create_address_space();
+    if (child == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < parent->region_count; i++) {
+        child->regions[i] = parent->regions[i];
+        if (child->regions[i].file >= 0) {
+            hold_file(child->regions[i].file);
+        }
+    }
+    child->region_count = parent->region_count;
+
+    for (int d = USER_PDE_START; d < 1024; d++) {
+        uint32_t pde = parent->page_directory[d];
+        if (!(pde & PAGE_PRESENT)) {
+            continue;
+        }
+
+        uint32_t table = alloc_frame();
+        if (table == 0) {
+            destroy_address_space(child);
+            return NULL;
+        }
+        child->page_directory[d] = table | (pde & ~PAGE_FRAME_MASK);
+
+        uint32_t* parent_table = (uint32_t*)(pde & PAGE_FRAME_MASK);
+        uint32_t* child_table = (uint32_t*)table;
+        for (int i = 0; i < 1024; i++) {
+            uint32_t pte = parent_table[i];
+            if (pte & PAGE_FILE) {
+                pte = 0;     // The child maps the file's pages itself
+            }
+            if (pte & PAGE_PRESENT) {
+                if (pte & PAGE_WRITABLE) {
+                    pte = (pte & ~PAGE_WRITABLE) | PAGE_COW;
+                    parent_table[i] = pte;
+                }
+                ref_frame(pte & PAGE_FRAME_MASK);
+                child->pages_mapped++;
+            }
+            child_table[i] = pte;
+        }
+    }
+
+    // Parent mappings just lost write access
+    if (current_space == parent) {
+        load_cr3((uint32_t)parent->page_directory);
+    }
+    return child;
+}
+
+// Free every user frame and table, then the directory itself
+void destroy_address_space(AddressSpace* space) {
+    if (space == NULL) {
+        return;
+    }
+    if (current_space == space) {
+        switch_address_space(NULL);
+    }
+    for (int i = 0; i < space->region_count; i++) {
+        if (space->regions[i].file >= 0) {
+            collect_file_pages(space, &space->regions[i], 1);
+            release_file(space->regions[i].file);
+        }
+    }
+
+    for (int d = USER_PDE_START; d < 1024; d++) {
+        uint32_t pde = space->page_directory[d];
+        if (!(pde & PAGE_PRESENT)) {
+            continue;
+        }
+        uint32_t* table = (uint32_t*)(pde & PAGE_FRAME_MASK);
+        for (int i = 0; i < 1024; i++) {
+            if (table[i] & PAGE_PRESENT) {
+                free_frame(table[i] & PAGE_FRAME_MASK);  // Drops a shared reference
+            }
+        }
+        free_frame((uint32_t)table);
+    }
+    free_frame((uint32_t)space->page_directory);
+    space_used[space - spaces] = 0;
+}
+
+// Load a process address space, NULL goes back to the kernel directory
+void switch_address_space(AddressSpace* space) {
+    current_space = space;
+    load_cr3(space ? (uint32_t)space->page_directory : (uint32_t)kernel_directory);
+}
+
+// Describe a lazily populated range of user memory
+int add_region(AddressSpace* space, uint32_t start, uint32_t end,
+               const uint8_t* data, uint32_t data_start, uint32_t data_size, int writable) {
+    if (space->region_count >= MAX_REGIONS || start < USER_BASE || end > USER_STACK_TOP ||
+        start >= end) {
+        return -1;
+    }
+
+    Region* r = &space->regions[space->region_count++];
+    r->start = start & PAGE_FRAME_MASK;
+    r->end = (end + PAGE_SIZE - 1) & PAGE_FRAME_MASK;
+    r->data = data;
+    r->data_start = data_start;
+    r->data_end = data_start + data_size;
+    r->writable = writable;
+    r->file = -1;
+    r->file_offset = 0;
+    r->shared = 0;
+    return 0;
+}
+
+// Describe a range whose data comes from a file, from offset on, read
+// through the page cache as it is touched. The region holds the file
+// (hold_file) until the space is destroyed.
+int add_file_region(AddressSpace* space, uint32_t start, uint32_t end, int file,
+                    uint32_t offset, uint32_t data_start, uint32_t data_size, int writable) {
+    if (add_region(space, start, end, NULL, data_start, data_size, writable) != 0) {
+        return -1;
+    }
+    Region* r = &space->regions[space->region_count - 1];
+    r->file = file;
+    r->file_offset = offset;
+    hold_file(file);
+    return 0;
+}
+
+// Map one user page, allocating its page table on demand
+int map_page(AddressSpace* space, uint32_t virt, uint32_t frame, uint32_t flags) {
+    uint32_t* pde = &space->page_directory[virt >> 22];
+
+    if (!(*pde & PAGE_PRESENT)) {
+        uint32_t table = alloc_frame();
+        if (table == 0) {
+            return -1;
+        }
+        memset((void*)table, 0, PAGE_SIZE);
+        *pde = table | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+    }
+
+    uint32_t* table = (uint32_t*)(*pde & PAGE_FRAME_MASK);
+    table[(virt >> 12) & 0x3FF] = (frame & PAGE_FRAME_MASK) | flags;
+    space->pages_mapped++;
+    asm volatile ("invlpg (%0)" : : "r"(virt) : "memory");
+    return 0;
+}
+
+AddressSpace* get_current_space(void) {
+    return current_space;
+}
+
+// Whether a system call may touch [addr, addr + length) for the caller:
+// the range must lie in the user half and every page of it in one of
+// the caller's regions (a writable one with write). Pages not faulted
+// in yet are fine, the kernel's access faults them in. Ring 3 code
+// built into the kernel (userdemo, sysbench) runs in the kernel
+// directory, where all RAM is user-accessible anyway; it may pass any
+// range inside RAM. Returns 0 if allowed, else -1.
+int check_user_range(uint32_t addr, uint32_t length, int write) {
+    if (addr + length < addr) {
+        return -1;
+    }
+    if (current_space == NULL) {
+        return addr != 0 && addr + length <= MEMORY_SIZE ? 0 : -1;
+    }
+    if (addr < USER_BASE || addr + length > USER_STACK_TOP) {
+        return -1;
+    }
+    for (uint32_t page = addr & PAGE_FRAME_MASK; page < addr + length; page += PAGE_SIZE) {
+        Region* r = find_region(current_space, page);
+        if (r == NULL || (write && !r->writable)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Length of a NUL-terminated string from ring 3, checked a page at a
+// time as above; -1 if it is not readable or longer than max
+int check_user_string(uint32_t addr, uint32_t max) {
+    uint32_t length = 0;
+    while (length < max) {
+        uint32_t byte = addr + length;
+        if ((length == 0 || byte % PAGE_SIZE == 0) && check_user_range(byte, 1, 0) != 0) {
+            return -1;
+        }
+        if (*(const char*)byte == '\0') {
+            return length;
+        }
+        length++;
+    }
+    return -1;
+}
+
+// Map a whole file at the first free range from MMAP_BASE. The mapping
+// holds the file until it is unmapped or the space destroyed.
+uint32_t map_file(AddressSpace* space, int file, uint32_t size, int writable) {
+    uint32_t length = (size + PAGE_SIZE - 1) & PAGE_FRAME_MASK;
+    if (length == 0) {
+        return 0;
+    }
+
+    uint32_t start = MMAP_BASE;
+    int moved = 1;
+    while (moved) {
+        moved = 0;
+        for (int i = 0; i < space->region_count; i++) {
+            Region* r = &space->regions[i];
+            if (start < r->end && start + length > r->start) {
+                start = r->end;
+                moved = 1;
+            }
+        }
+    }
+    if (start + length > USER_STACK_TOP || start + length < start ||
+        add_file_region(space, start, start + length, file, 0, start, length, writable) != 0) {
+        return 0;
+    }
+    space->regions[space->region_count - 1].shared = 1;
+    return start;
+}
+
+// The mapped file around addr
+static Region* find_file_region(AddressSpace* space, uint32_t addr) {
+    Region* r = find_region(space, addr);
+    return r != NULL && r->shared ? r : NULL;
+}
+
+int sync_file_mapping(AddressSpace* space, uint32_t addr) {
+    Region* r = find_file_region(space, addr);
+    if (r == NULL) {
+        return -1;
+    }
+    collect_file_pages(space, r, 0);
+    return 0;
+}
+
+// Remove the mapping starting at addr
+int unmap_file(AddressSpace* space, uint32_t addr) {
+    Region* r = find_file_region(space, addr);
+    if (r == NULL || r->start != addr) {
+        return -1;
+    }
+    collect_file_pages(space, r, 1);
+    release_file(r->file);
+    for (int i = r - space->regions; i < space->region_count - 1; i++) {
+        space->regions[i] = space->regions[i + 1];
+    }
+    space->region_count--;
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include "memory.h"
+
+// Page table entry flags
+#define PAGE_PRESENT 0x001
+#define PAGE_WRITABLE 0x002
+#define PAGE_USER 0x004
+#define PAGE_DIRTY 0x040         // Set by the CPU on a write through the entry
+#define PAGE_COW 0x200           // Available bit: shared until written
+#define PAGE_FILE 0x400          // Available bit: a mapped file's page-cache page
+#define PAGE_FRAME_MASK 0xFFFFF000
+
+// User address space layout
+#define USER_BASE 0x40000000
+#define USER_STACK_TOP 0xC0000000
+#define USER_STACK_SIZE (64 * 1024)
+#define MMAP_BASE 0x80000000     // Mapped files are placed from here up
+
+#define MAX_REGIONS 16
+
+// A range of user memory filled on first touch
+typedef struct {
+    uint32_t start;              // Page-aligned virtual start
+    uint32_t end;                // Page-aligned virtual end
+    uint32_t data_start;         // First byte backed by image data
+    uint32_t data_end;           // End of image data, zero after this
+    const uint8_t* data;         // Image bytes for data_start
+    int writable;
+    int file;                    // Inode the data comes from, -1 for memory
+    uint32_t file_offset;        // File offset of data_start
+    int shared;                  // A mapped file: writes go to the file
+} Region;
+
+typedef struct {
+    uint32_t* page_directory;    // Physical address, identity mapped
+    Region regions[MAX_REGIONS];
+    int region_count;
+    int pages_mapped;
+} AddressSpace;
+
+// Paging functions
+void init_paging(void);
+AddressSpace* create_address_space(void);
+AddressSpace* clone_address_space(AddressSpace* parent);
+void destroy_address_space(AddressSpace* space);
+void switch_address_space(AddressSpace* space);
+int add_region(AddressSpace* space, uint32_t start, uint32_t end,
+               const uint8_t* data, uint32_t data_start, uint32_t data_size, int writable);
+int add_file_region(AddressSpace* space, uint32_t start, uint32_t end, int file,
+                    uint32_t offset, uint32_t data_start, uint32_t data_size, int writable);
+int map_page(AddressSpace* space, uint32_t virt, uint32_t frame, uint32_t flags);
+AddressSpace* get_current_space(void);
+
+// Pointers from ring 3, checked against the current space before a
+// system call uses them
+int check_user_range(uint32_t addr, uint32_t length, int write);
+int check_user_string(uint32_t addr, uint32_t max);
+
+// Memory-mapped files. The file's page-cache pages themselves are mapped
+// on first touch, so nothing is copied; writes reach the cache through
+// the entries' dirty bits, collected by sync_file_mapping and on unmap
+// (and when the space is destroyed). map_file returns the address of a
+// whole-file mapping, or 0.
+uint32_t map_file(AddressSpace* space, int file, uint32_t size, int writable);
+int sync_file_mapping(AddressSpace* space, uint32_t addr);
+int unmap_file(AddressSpace* space, uint32_t addr);
+
+#endif
@@ -0,0 +1,108 @@
+#include "elf.h"
+#include "process.h"
+#include "../include/kernel.h"
+#include "../fs/fs.h"
+
+// Describe every PT_LOAD segment as a region backed by the file; nothing
+// is read until the program touches a page, and .bss (memsz past filesz)
+// is zero-filled. image holds the file's first head bytes, where the
+// headers must be.
+static int load_segments(AddressSpace* space, int file, const uint8_t* image, uint32_t head,
+                         uint32_t size, uint32_t* entry) {
+    const Elf32Header* header = (const Elf32Header*)image;
+
+    if (head < sizeof(Elf32Header) || header->magic != ELF_MAGIC ||
+        header->elf_class != ELF_CLASS32 || header->data != ELF_DATA_LSB) {
+        print_string("Error: Not an ELF32 file\n");
+        return -1;
+    }
+    if (header->type != ET_EXEC || header->machine != EM_386 ||
+        header->phentsize != sizeof(Elf32ProgramHeader) ||
+        header->phoff > head ||
+        header->phnum > (head - header->phoff) / sizeof(Elf32ProgramHeader)) {
+        print_string("Error: Unsupported ELF executable\n");
+        return -1;
+    }
+
+    const Elf32ProgramHeader* phdrs = (const Elf32ProgramHeader*)(image + header->phoff);
+    int entry_mapped = 0;
+
+    for (int i = 0; i < header->phnum; i++) {
+        const Elf32ProgramHeader* ph = &phdrs[i];
+        if (ph->type != PT_LOAD || ph->memsz == 0) {
+            continue;
+        }
+
+        uint32_t start = ph->vaddr;
+        uint32_t end = ph->vaddr + ph->memsz;
+        if (ph->filesz > ph->memsz || ph->offset > size || ph->filesz > size - ph->offset ||
+            start < USER_BASE || end < start || end > USER_STACK_TOP - USER_STACK_SIZE) {
+            print_string("Error: Bad ELF segment\n");
+            return -1;
+        }
+        if (add_file_region(space, start, end, file, ph->offset, start, ph->filesz,
+                            (ph->flags & PF_W) != 0) != 0) {
+            print_string("Error: Too many ELF segments\n");
+            return -1;
+        }
+        if (header->entry >= start && header->entry < end) {
+            entry_mapped = 1;
+        }
+    }
+
+    if (!entry_mapped) {
+        print_string("Error: ELF entry point is not in a segment\n");
+        return -1;
+    }
+
+    // Stack is demand-zeroed like .bss
+    if (add_region(space, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_TOP, NULL, 0, 0, 1) != 0) {
+        print_string("Error: Too many ELF segments\n");
+        return -1;
+    }
+
+    *entry = header->entry;
+    return 0;
+}
+
+// Load an open file of size bytes into space: its headers are read from
+// the first page, its segments only when touched
+int elf_load(AddressSpace* space, int file, uint32_t size, uint32_t* entry) {
+    const uint8_t* image = (const uint8_t*)get_file_page(file, 0, 0);
+    if (image == NULL) {
+        return -1;
+    }
+    uint32_t head = size < PAGE_SIZE ? size : PAGE_SIZE;
+    int result = load_segments(space, file, image, head, size, entry);
+    put_file_page(file, 0, (const char*)image);
+    return result;
+}
+
+// Load an ELF file from the fs into a new process, returns its PID
+int exec_program(const char* name) {
+    int file = open_file(name);
+    if (file < 0) {
+        return -1;
+    }
+
+    AddressSpace* space = create_address_space();
+    if (space == NULL) {
+        print_string("Error: Out of memory\n");
+        return -1;
+    }
+
+    uint32_t entry;
+    if (elf_load(space, file, get_file_size(name), &entry) != 0) {
+        destroy_address_space(space);
+        return -1;
+    }
+
+    int pid = create_process(name, DEFAULT_QUANTUM);
+    if (pid < 0) {
+        print_string("Error: No free process slots\n");
+        destroy_address_space(space);
+        return -1;
+    }
+    attach_address_space(pid, space, entry);
+    return pid;
+}
@@ -0,0 +1,53 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdint.h>
+#include "../mm/paging.h"
+
+#define ELF_MAGIC 0x464C457F     // "\x7FELF"
+#define ELF_CLASS32 1
+#define ELF_DATA_LSB 1
+#define ET_EXEC 2
+#define EM_386 3
+#define PT_LOAD 1
+#define PF_W 0x2
+
+// ELF32 file header
+typedef struct {
+    uint32_t magic;
+    uint8_t elf_class;
+    uint8_t data;
+    uint8_t version;
+    uint8_t pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t elf_version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed)) Elf32Header;
+
+// ELF32 program header
+typedef struct {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} __attribute__((packed)) Elf32ProgramHeader;
+
+// ELF loader functions
+int elf_load(AddressSpace* space, int file, uint32_t size, uint32_t* entry);
+int exec_program(const char* name);
+
+#endif
@@ -0,0 +1,225 @@
+#include "ipc.h"
+#include "process.h"
+#include "../include/kernel.h"
+
+#define MAILBOX_MASK (MAILBOX_CAPACITY - 1)
+#define NO_OWNER -1
+
+// Mailbox slot; the sequence number says whether it is free or filled
+typedef struct {
+    volatile uint32_t sequence;
+    Message msg;
+} MailboxSlot;
+
+// Bounded MPSC queue: any process may send, only the owner receives
+typedef struct {
+    MailboxSlot slots[MAILBOX_CAPACITY];
+    volatile uint32_t head;          // Next slot to claim (producers)
+    uint32_t tail;                   // Next slot to read (consumer)
+    volatile uint32_t blocked_senders;  // Bitmask of PIDs waiting for space
+    volatile int receiver_blocked;
+} Mailbox;
+
+static Mailbox mailboxes[MAX_PROCESSES];
+static char ipc_buffers[IPC_BUFFER_COUNT][IPC_BUFFER_SIZE]
+    __attribute__((aligned(IPC_BUFFER_SIZE)));
+static int buffer_owner[IPC_BUFFER_COUNT];
+
+static int valid_pid(int pid) {
+    return pid >= 0 && pid < MAX_PROCESSES;
+}
+
+static void copy_message(Message* dest, const Message* src) {
+    const char* s = (const char*)src;
+    char* d = (char*)dest;
+    for (unsigned int i = 0; i < sizeof(Message); i++) {
+        d[i] = s[i];
+    }
+}
+
+// Initialize IPC state
+void init_ipc(void) {
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        ipc_init_mailbox(i);
+    }
+    for (int i = 0; i < IPC_BUFFER_COUNT; i++) {
+        buffer_owner[i] = NO_OWNER;
+    }
+}
+
+// Reset a mailbox for a newly created process
+void ipc_init_mailbox(int pid) {
+    if (!valid_pid(pid)) {
+        return;
+    }
+
+    Mailbox* box = &mailboxes[pid];
+    for (uint32_t i = 0; i < MAILBOX_CAPACITY; i++) {
+        box->slots[i].sequence = i;
+    }
+    box->head = 0;
+    box->tail = 0;
+    box->blocked_senders = 0;
+    box->receiver_blocked = 0;
+}
+
+// Drop everything a terminated process owns
+void ipc_release(int pid) {
+    if (!valid_pid(pid)) {
+        return;
+    }
+
+    // Buffers still queued in its mailbox die with it
+    Message msg;
+    while (ipc_recv(pid, &msg, IPC_NONBLOCK) == IPC_OK) {
+        if (msg.type == MSG_BUFFER) {
+            ipc_buffer_free(pid, msg.buffer);
+        }
+    }
+    for (int i = 0; i < IPC_BUFFER_COUNT; i++) {
+        if (buffer_owner[i] == pid) {
+            buffer_owner[i] = NO_OWNER;
+        }
+    }
+
+    // Nobody can wait on a dead mailbox
+    uint32_t waiters = __atomic_exchange_n(&mailboxes[pid].blocked_senders, 0, __ATOMIC_ACQ_REL);
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (waiters & (1u << i)) {
+            wake_process(i);
+        }
+    }
+}
+
+// Queue a message for another process
+int ipc_send(int from, int to, const Message* msg, int flags) {
+    if (!valid_pid(from) || !is_process_alive(to)) {
+        return IPC_ERROR;
+    }
+    if (msg->type == MSG_BUFFER &&
+        (msg->buffer < 0 || msg->buffer >= IPC_BUFFER_COUNT || buffer_owner[msg->buffer] != from)) {
+        return IPC_ERROR;
+    }
+
+    Mailbox* box = &mailboxes[to];
+    uint32_t pos = __atomic_load_n(&box->head, __ATOMIC_RELAXED);
+    MailboxSlot* slot;
+
+    // Claim a slot: it is free when its sequence equals our position
+    while (1) {
+        slot = &box->slots[pos & MAILBOX_MASK];
+        uint32_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&box->head, &pos, pos + 1, 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Mailbox is full
+            if (flags & IPC_NONBLOCK) {
+                return IPC_WOULD_BLOCK;
+            }
+            __atomic_or_fetch(&box->blocked_senders, 1u << from, __ATOMIC_SEQ_CST);
+
+            // The receiver may have freed a slot before it saw our bit
+            seq = __atomic_load_n(&slot->sequence, __ATOMIC_SEQ_CST);
+            if ((int32_t)(seq - pos) < 0) {
+                block_process(from);
+                return IPC_BLOCKED;
+            }
+            __atomic_and_fetch(&box->blocked_senders, ~(1u << from), __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&box->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    copy_message(&slot->msg, msg);
+    slot->msg.sender = from;
+
+    // Ownership moves with the message, the sender loses access
+    if (msg->type == MSG_BUFFER) {
+        buffer_owner[msg->buffer] = to;
+    }
+
+    // Publish the slot to the consumer
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    if (__atomic_exchange_n(&box->receiver_blocked, 0, __ATOMIC_ACQ_REL)) {
+        wake_process(to);
+    }
+    return IPC_OK;
+}
+
+// Take the oldest message from our own mailbox
+int ipc_recv(int pid, Message* msg, int flags) {
+    if (!valid_pid(pid)) {
+        return IPC_ERROR;
+    }
+
+    Mailbox* box = &mailboxes[pid];
+    uint32_t pos = box->tail;
+    MailboxSlot* slot = &box->slots[pos & MAILBOX_MASK];
+    uint32_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+    if ((int32_t)(seq - (pos + 1)) < 0) {
+        // Mailbox is empty
+        if (flags & IPC_NONBLOCK) {
+            return IPC_WOULD_BLOCK;
+        }
+        __atomic_store_n(&box->receiver_blocked, 1, __ATOMIC_SEQ_CST);
+
+        // A sender may have published before it saw the flag
+        seq = __atomic_load_n(&slot->sequence, __ATOMIC_SEQ_CST);
+        if ((int32_t)(seq - (pos + 1)) < 0) {
+            block_process(pid);
+            return IPC_BLOCKED;
+        }
+        __atomic_store_n(&box->receiver_blocked, 0, __ATOMIC_RELAXED);
+    }
+
+    copy_message(msg, &slot->msg);
+    box->tail = pos + 1;
+
+    // Hand the slot back to producers one lap ahead
+    __atomic_store_n(&slot->sequence, pos + MAILBOX_CAPACITY, __ATOMIC_RELEASE);
+
+    // Space is available again, let blocked senders retry
+    uint32_t waiters = __atomic_exchange_n(&box->blocked_senders, 0, __ATOMIC_ACQ_REL);
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (waiters & (1u << i)) {
+            wake_process(i);
+        }
+    }
+    return IPC_OK;
+}
+
+// Allocate a page-sized buffer owned by pid
+int ipc_buffer_alloc(int pid) {
+    if (!valid_pid(pid)) {
+        return -1;
+    }
+    for (int i = 0; i < IPC_BUFFER_COUNT; i++) {
+        int expected = NO_OWNER;
+        if (__atomic_compare_exchange_n(&buffer_owner[i], &expected, pid, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ipc_buffer_free(int pid, int handle) {
+    if (handle >= 0 && handle < IPC_BUFFER_COUNT && buffer_owner[handle] == pid) {
+        __atomic_store_n(&buffer_owner[handle], NO_OWNER, __ATOMIC_RELEASE);
+    }
+}
+
+// Only the current owner may touch a buffer
+void* ipc_buffer_data(int pid, int handle) {
+    if (handle < 0 || handle >= IPC_BUFFER_COUNT || buffer_owner[handle] != pid) {
+        return NULL;
+    }
+    return ipc_buffers[handle];
+}
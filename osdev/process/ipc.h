@@ -0,0 +1,45 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdint.h>
+
+#define MSG_DATA_SIZE 48
+#define MAILBOX_CAPACITY 16      // Must be a power of two
+#define IPC_BUFFER_SIZE 4096     // One page per zero-copy buffer
+#define IPC_BUFFER_COUNT 8
+
+// Message types
+#define MSG_INLINE 0             // Payload copied in data[]
+#define MSG_BUFFER 1             // Payload is a transferred IPC buffer
+
+// Send/receive flags
+#define IPC_NONBLOCK 1
+
+// Return codes
+#define IPC_OK 0
+#define IPC_BLOCKED -1           // Caller was blocked, retry when woken
+#define IPC_WOULD_BLOCK -2       // Full/empty and IPC_NONBLOCK was given
+#define IPC_ERROR -3
+
+// Fixed-size message (64 bytes)
+typedef struct {
+    int sender;
+    int type;
+    int length;
+    int buffer;                  // Buffer handle for MSG_BUFFER
+    char data[MSG_DATA_SIZE];
+} Message;
+
+// IPC functions
+void init_ipc(void);
+void ipc_init_mailbox(int pid);
+void ipc_release(int pid);
+int ipc_send(int from, int to, const Message* msg, int flags);
+int ipc_recv(int pid, Message* msg, int flags);
+
+// Zero-copy buffers
+int ipc_buffer_alloc(int pid);
+void ipc_buffer_free(int pid, int handle);
+void* ipc_buffer_data(int pid, int handle);
+
+#endif
@@ -0,0 +1,85 @@
+#include "pipe.h"
+#include "../include/kernel.h"
+
+#define PIPE_MASK (PIPE_SIZE - 1)
+
+// Single-producer single-consumer ring. head and tail run freely and
+// are masked on use, so head - tail is always the byte count.
+typedef struct {
+    char data[PIPE_SIZE];
+    volatile uint32_t head;      // Next byte to write (writer)
+    volatile uint32_t tail;      // Next byte to read (reader)
+    int used;
+} Pipe;
+
+static Pipe pipes[MAX_PIPES];
+
+static Pipe* get_pipe(int id) {
+    if (id < 0 || id >= MAX_PIPES || !pipes[id].used) {
+        return NULL;
+    }
+    return &pipes[id];
+}
+
+// Allocate an empty pipe, returns its id or -1 if none are free
+int pipe_create(void) {
+    for (int i = 0; i < MAX_PIPES; i++) {
+        if (!pipes[i].used) {
+            pipes[i].head = 0;
+            pipes[i].tail = 0;
+            pipes[i].used = 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void pipe_destroy(int id) {
+    Pipe* pipe = get_pipe(id);
+    if (pipe != NULL) {
+        pipe->used = 0;
+    }
+}
+
+// Copy in as many bytes as there is room for, returns how many
+int pipe_write(int id, const char* data, int length) {
+    Pipe* pipe = get_pipe(id);
+    if (pipe == NULL) {
+        return 0;
+    }
+
+    uint32_t head = pipe->head;
+    int room = PIPE_SIZE - (int)(head - pipe->tail);
+    int count = length < room ? length : room;
+    for (int i = 0; i < count; i++) {
+        pipe->data[(head + i) & PIPE_MASK] = data[i];
+    }
+    pipe->head = head + count;
+    return count;
+}
+
+// Copy out up to length bytes, returns how many (0 when empty)
+int pipe_read(int id, char* buffer, int length) {
+    Pipe* pipe = get_pipe(id);
+    if (pipe == NULL) {
+        return 0;
+    }
+
+    uint32_t tail = pipe->tail;
+    int available = (int)(pipe->head - tail);
+    int count = length < available ? length : available;
+    for (int i = 0; i < count; i++) {
+        buffer[i] = pipe->data[(tail + i) & PIPE_MASK];
+    }
+    pipe->tail = tail + count;
+    return count;
+}
+
+// Bytes waiting to be read
+int pipe_count(int id) {
+    Pipe* pipe = get_pipe(id);
+    if (pipe == NULL) {
+        return 0;
+    }
+    return (int)(pipe->head - pipe->tail);
+}
@@ -0,0 +1,15 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#define PIPE_SIZE 512            // Must be a power of two
+#define MAX_PIPES 8
+
+// Pipe functions. Pipes are bounded byte rings with one writer and one
+// reader; reads and writes never block, they move as much as fits.
+int pipe_create(void);
+void pipe_destroy(int id);
+int pipe_write(int id, const char* data, int length);
+int pipe_read(int id, char* buffer, int length);
+int pipe_count(int id);
+
+#endif
@@ -1,11 +1,46 @@
 #include "process.h"
+#include "ipc.h"
 #include "../include/kernel.h"
+#include "../kernel/cpu.h"
+#include "../kernel/timer.h"
 
 // Global variables
 static Process processes[MAX_PROCESSES];
 static int next_pid = 0;
 static Queue ready_queue;
 static Process* current_process = NULL;
+static Process* user_process = NULL;     // In ring 3, inside run_process
+static int context_switches = 0;
+
+// 1, 5 and 15 minute load averages: exponentially decayed counts of
+// runnable processes, sampled every LOAD_INTERVAL_MS
+static const uint32_t load_decay[3] = {1884, 2014, 2037};   // LOAD_FIXED_1 / e^(5s / period)
+static uint32_t load_average[3];
+static uint64_t next_load_sample = 0;
+
+// Move a process to a new state, charging the time since its last change
+// to running or to waiting in the ready queue
+static void set_state(Process* proc, ProcessState state) {
+    uint64_t now = rdtsc();
+    uint64_t spent = now - proc->since;
+    if (proc->state == RUNNING) {
+        proc->run_time += spent;
+    } else if (proc->state == READY) {
+        proc->wait_time += spent;
+        if (spent > proc->max_latency) {
+            proc->max_latency = spent;
+        }
+    }
+    if (state == RUNNING) {
+        if (proc->switches == 0) {
+            proc->response = now - proc->created;
+        }
+        proc->switches++;
+        context_switches++;
+    }
+    proc->state = state;
+    proc->since = now;
+}
 
 // Initialize the scheduler
 void init_scheduler() {
@@ -17,16 +52,19 @@ void init_scheduler() {
         processes[i].time_quantum = 0;
         processes[i].burst_time = 0;
         processes[i].time_remaining = 0;
+        processes[i].space = NULL;
+        processes[i].entry = 0;
     }
     
     // Initialize ready queue
     queue_init(&ready_queue);
     current_process = NULL;
     next_pid = 0;
+    context_switches = 0;
 }
 
-// Create a new process
-int create_process(const char* name, int burst_time) {
+// Fill in a free process slot and queue it, without scheduling
+static int alloc_process(const char* name, int burst_time) {
     // Find a free process slot
     int pid = -1;
     for (int i = 0; i < MAX_PROCESSES; i++) {
@@ -45,13 +83,33 @@ int create_process(const char* name, int burst_time) {
     new_process->pid = pid;
     strncpy(new_process->name, name, 31);
     new_process->name[31] = '\0';  // Ensure null termination
-    new_process->state = READY;
     new_process->time_quantum = burst_time;
     new_process->burst_time = burst_time;
     new_process->time_remaining = burst_time;
+    new_process->space = NULL;
+    new_process->entry = 0;
+    new_process->has_context = 0;
+    new_process->created = rdtsc();
+    new_process->since = new_process->created;
+    new_process->run_time = 0;
+    new_process->wait_time = 0;
+    new_process->max_latency = 0;
+    new_process->response = 0;
+    new_process->switches = 0;
+    set_state(new_process, READY);
+    ipc_init_mailbox(pid);
 
     // Add to ready queue
     queue_push(&ready_queue, new_process);
+    return pid;
+}
+
+// Create a new process
+int create_process(const char* name, int burst_time) {
+    int pid = alloc_process(name, burst_time);
+    if (pid == -1) {
+        return -1; // No free slots
+    }
     
     // Run one scheduling cycle to start it
     schedule();
@@ -71,8 +129,14 @@ void kill_process(int pid) {
     }
     
     // Mark process as terminated
-    proc->state = TERMINATED;
+    if (proc->state == READY) {
+        queue_remove(&ready_queue, proc);
+    }
+    set_state(proc, TERMINATED);
     proc->time_remaining = 0;
+    ipc_release(pid);
+    destroy_address_space(proc->space);
+    proc->space = NULL;
     
     // If this is the current process, schedule next one
     if (current_process && current_process->pid == pid) {
@@ -100,12 +164,145 @@ int get_running_process_count() {
     return count;
 }
 
+// Get the PID of the running process, -1 if the CPU is idle
+int get_current_pid(void) {
+    return current_process ? current_process->pid : -1;
+}
+
+// Take a process off the CPU or ready queue until wake_process()
+void block_process(int pid) {
+    if (!is_process_alive(pid)) {
+        return;
+    }
+
+    Process* proc = &processes[pid];
+    if (proc->state == WAITING) {
+        return;  // Already blocked
+    }
+    if (proc->state == READY) {
+        queue_remove(&ready_queue, proc);
+    }
+    set_state(proc, WAITING);
+
+    // If this is the current process, give the CPU away
+    if (current_process == proc) {
+        current_process = NULL;
+        schedule();
+    }
+}
+
+// Make a blocked process runnable again
+void wake_process(int pid) {
+    if (!is_process_alive(pid)) {
+        return;
+    }
+
+    Process* proc = &processes[pid];
+    if (proc->state == WAITING) {
+        set_state(proc, READY);
+        queue_push(&ready_queue, proc);
+    }
+}
+
+// Give a process a user program to run
+void attach_address_space(int pid, AddressSpace* space, uint32_t entry) {
+    if (!is_process_alive(pid)) {
+        return;
+    }
+    processes[pid].space = space;
+    processes[pid].entry = entry;
+}
+
+// Put a process with a user program on the CPU and run it until it exits.
+// Returns the program's exit code; the process is gone afterwards.
+int run_process(int pid) {
+    if (!is_process_alive(pid) || processes[pid].space == NULL) {
+        return -1;
+    }
+
+    Process* proc = &processes[pid];
+    if (proc->state == READY) {
+        queue_remove(&ready_queue, proc);
+    }
+    if (current_process && current_process != proc) {
+        set_state(current_process, READY);
+        queue_push(&ready_queue, current_process);
+    }
+    set_state(proc, RUNNING);
+    current_process = proc;
+
+    switch_address_space(proc->space);
+    user_process = proc;
+    int code;
+    if (proc->has_context) {
+        code = resume_user_mode(&proc->context);
+    } else {
+        code = enter_user_mode((void (*)(void))proc->entry, (void*)USER_STACK_TOP);
+    }
+    user_process = NULL;
+    switch_address_space(NULL);
+
+    kill_process(pid);
+    return code;
+}
+
+// Duplicate a user process. The child shares every page copy-on-write
+// and, given a context, resumes from it with 0 in eax.
+int fork_process(int parent_pid, const UserContext* context) {
+    if (!is_process_alive(parent_pid) || processes[parent_pid].space == NULL) {
+        return -1;
+    }
+
+    Process* parent = &processes[parent_pid];
+    AddressSpace* space = clone_address_space(parent->space);
+    if (space == NULL) {
+        return -1;
+    }
+
+    int pid = alloc_process(parent->name, parent->burst_time);
+    if (pid == -1) {
+        destroy_address_space(space);
+        return -1;
+    }
+
+    Process* child = &processes[pid];
+    child->space = space;
+    child->entry = parent->entry;
+    if (context) {
+        child->context = *context;
+        child->context.eax = 0;
+        child->has_context = 1;
+    }
+    return pid;
+}
+
+// Find a user program that is waiting for the CPU, -1 if none
+int next_user_process(void) {
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        Process* p = &processes[i];
+        if (p->state != TERMINATED && p->space != NULL && p != current_process) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 // Schedule the next process
 void schedule() {
+    // A user program keeps the CPU until it exits: the system calls that
+    // get here (yield, spawn) must not make another process current
+    // while it is still running
+    if (user_process != NULL) {
+        return;
+    }
+
     // Check if current process is done
     if (current_process != NULL) {
         if (current_process->time_remaining <= 0) {
-            current_process->state = TERMINATED;
+            set_state(current_process, TERMINATED);
+            ipc_release(current_process->pid);
+            destroy_address_space(current_process->space);
+            current_process->space = NULL;
             print_string("Process terminated: ");
             print_string(current_process->name);
             print_char('\n');
@@ -113,12 +310,15 @@ void schedule() {
         } else if (current_process->time_quantum <= 0) {
             // Reset quantum and put back in queue
             current_process->time_quantum = DEFAULT_QUANTUM;
-            current_process->state = READY;
+            set_state(current_process, READY);
             queue_push(&ready_queue, current_process);
             current_process = NULL;
         } else {
             current_process->time_quantum--;
-            current_process->time_remaining--;
+            // User programs run until they exit, not for a fixed burst
+            if (current_process->space == NULL) {
+                current_process->time_remaining--;
+            }
             return;  // Continue running current process
         }
     }
@@ -126,7 +326,7 @@ void schedule() {
     // Get next process from ready queue
     if (!queue_is_empty(&ready_queue)) {
         current_process = queue_pop(&ready_queue);
-        current_process->state = RUNNING;
+        set_state(current_process, RUNNING);
         
         print_string("Running process: ");
         print_string(current_process->name);
@@ -134,6 +334,66 @@ void schedule() {
     }
 }
 
+// Copy out a live process's accounting. Returns -1 if pid is not alive.
+int get_process_stats(int pid, ProcessStats* stats) {
+    if (!is_process_alive(pid)) {
+        return -1;
+    }
+
+    const Process* proc = &processes[pid];
+    uint64_t spent = rdtsc() - proc->since;
+    stats->pid = pid;
+    strcpy(stats->name, proc->name);
+    stats->state = proc->state;
+    stats->run_time = proc->run_time;
+    stats->wait_time = proc->wait_time;
+    stats->max_latency = proc->max_latency;
+    stats->response = proc->response;
+    stats->switches = proc->switches;
+    if (proc->state == RUNNING) {
+        stats->run_time += spent;
+    } else if (proc->state == READY) {
+        stats->wait_time += spent;
+        if (spent > stats->max_latency) {
+            stats->max_latency = spent;
+        }
+    }
+    return 0;
+}
+
+// Times any process was put on the CPU since boot
+int get_context_switches(void) {
+    return context_switches;
+}
+
+// Take the load samples due since the last call. Called while the shell
+// waits for a key and while top runs, not per decision, to keep the TSC
+// read off the scheduling path.
+void update_load_average(void) {
+    uint64_t now = rdtsc();
+    uint64_t interval = (uint64_t)get_tsc_khz() * LOAD_INTERVAL_MS;
+    if (next_load_sample == 0) {
+        next_load_sample = now + interval;
+        return;
+    }
+
+    // Processes on the CPU or waiting for it
+    uint32_t active = (ready_queue.size + (current_process != NULL)) * LOAD_FIXED_1;
+    while (now >= next_load_sample) {
+        for (int i = 0; i < 3; i++) {
+            load_average[i] = (load_average[i] * load_decay[i] +
+                               active * (LOAD_FIXED_1 - load_decay[i])) >> LOAD_FSHIFT;
+        }
+        next_load_sample += interval;
+    }
+}
+
+void get_load_average(int hundredths[3]) {
+    for (int i = 0; i < 3; i++) {
+        hundredths[i] = (load_average[i] * 100 + LOAD_FIXED_1 / 2) >> LOAD_FSHIFT;
+    }
+}
+
 // Display all processes
 void display_processes() {
     int found = 0;
@@ -215,4 +475,14 @@ Process* queue_pop(Queue* q) {
 
 int queue_is_empty(Queue* q) {
     return q->size == 0;
+}
+
+void queue_remove(Queue* q, Process* p) {
+    int count = q->size;
+    for (int i = 0; i < count; i++) {
+        Process* entry = queue_pop(q);
+        if (entry != p) {
+            queue_push(q, entry);
+        }
+    }
 } 
\ No newline at end of file
@@ -1,6 +1,9 @@
 #ifndef PROCESS_H
 #define PROCESS_H
 
+#include "../mm/paging.h"
+#include "../kernel/cpu.h"
+
 #define MAX_PROCESSES 32
 #define DEFAULT_QUANTUM 5
 
@@ -20,8 +23,37 @@ typedef struct {
     int time_quantum;          // Time slice
     int burst_time;           // Total execution time needed
     int time_remaining;       // Time left to execute
+    AddressSpace* space;      // User program memory, NULL if none
+    uint32_t entry;           // User program entry point
+    UserContext context;      // Registers to resume a forked child with
+    int has_context;
+
+    // Accounting, in TSC cycles
+    uint64_t created;
+    uint64_t since;           // Last state change
+    uint64_t run_time;        // On the CPU
+    uint64_t wait_time;       // Ready but not running
+    uint64_t max_latency;     // Longest wait in the ready queue
+    uint64_t response;        // From creation to first run
+    int switches;             // Times put on the CPU
 } Process;
 
+// Snapshot of a process's accounting, the current run or wait included
+typedef struct {
+    int pid;
+    char name[32];
+    ProcessState state;
+    uint64_t run_time;
+    uint64_t wait_time;
+    uint64_t max_latency;
+    uint64_t response;
+    int switches;
+} ProcessStats;
+
+#define LOAD_FSHIFT 11               // Load averages are fixed point
+#define LOAD_FIXED_1 (1 << LOAD_FSHIFT)
+#define LOAD_INTERVAL_MS 5000        // Sampling period
+
 // Process queue
 typedef struct {
     Process* processes[MAX_PROCESSES];
@@ -38,11 +70,25 @@ void schedule(void);
 void display_processes(void);
 int is_process_alive(int pid);
 int get_running_process_count(void);
+int get_current_pid(void);
+void block_process(int pid);
+void wake_process(int pid);
+void attach_address_space(int pid, AddressSpace* space, uint32_t entry);
+int run_process(int pid);
+int fork_process(int parent_pid, const UserContext* context);
+int next_user_process(void);
+
+// Accounting
+int get_process_stats(int pid, ProcessStats* stats);
+int get_context_switches(void);
+void update_load_average(void);
+void get_load_average(int hundredths[3]);
 
 // Queue operations
 void queue_init(Queue* q);
 void queue_push(Queue* q, Process* p);
 Process* queue_pop(Queue* q);
 int queue_is_empty(Queue* q);
+void queue_remove(Queue* q, Process* p);
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+#include <stdint.h>
+
+// Seeded FNV-1a over a command name. Shared by the kernel and the host
+// generator (tools/mkcmdhash.c) so both agree on every slot.
+static inline uint32_t command_hash(const char* name, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    // Fold the high bits down; slots are picked from the low bits
+    return hash ^ (hash >> 16);
+}
+
+#endif
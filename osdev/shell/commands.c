@@ -1,91 +1,162 @@
 #include "../include/kernel.h"
+#include "../include/syscall.h"
 #include "../fs/fs.h"
+#include "../fs/block.h"
+#include "../fs/journal.h"
+#include "../fs/pagecache.h"
+#include "../fs/lz4.h"
 #include "../process/process.h"
+#include "../process/ipc.h"
+#include "../process/elf.h"
 #include "../kernel/screen.h"
+#include "../kernel/timer.h"
+#include "../kernel/cpu.h"
+#include "../kernel/keyboard.h"
+#include "../kernel/profile.h"
+#include "../kernel/symbols.h"
+#include "shell.h"
 #include "commands.h"
+#include "pipeline.h"
+#include "parse.h"
+#include "history.h"
+#include "cmdhash.h"
+#include "command_hash.h"
 #include <stddef.h>
 
 #define MAX_ARGS 16
-#define MAX_CONTENT 1024
+#define DEMO_STACK_SIZE 4096
+#define MAX_SOURCE_DEPTH 4
 
-// Helper function to parse command string into argc/argv
-static int parse_command(const char* command, char* argv[]) {
-    int argc = 0;
-    static char cmd_copy[MAX_CONTENT];
-    
-    // Make a copy of the command
-    int i;
-    for(i = 0; command[i] != '\0' && i < MAX_CONTENT - 1; i++) {
-        cmd_copy[i] = command[i];
+// Stack for code the shell runs in ring 3
+static uint8_t demo_stack[DEMO_STACK_SIZE] __attribute__((aligned(16)));
+
+// Set by 'set -e': stop a script at the first failing command
+static int exit_on_error = 0;
+
+// How many 'source' commands are currently running
+static int source_depth = 0;
+
+// Command table, generated from commands.def in the same order that
+// tools/mkcmdhash.c numbered the names
+#define COMMAND(name, handler, min_args, usage, help, group) \
+    { name, handler, NULL, NULL, min_args, usage, help, group },
+#define FILTER(name, input, finish, min_args, usage, help, group) \
+    { name, NULL, input, finish, min_args, usage, help, group },
+static const Command commands[] = {
+#include "commands.def"
+};
+#undef COMMAND
+#undef FILTER
+
+#define COMMAND_COUNT ((int)(sizeof(commands) / sizeof(commands[0])))
+
+int get_command_count(void) {
+    return COMMAND_COUNT;
+}
+
+const Command* get_command(int index) {
+    if (index < 0 || index >= COMMAND_COUNT) {
+        return NULL;
     }
-    cmd_copy[i] = '\0';
-    
-    char* token = cmd_copy;
-    
-    // Skip leading spaces
-    while (*token == ' ') token++;
-    
-    // Parse arguments
-    while (*token && argc < MAX_ARGS) {
-        argv[argc++] = token;
-        
-        // Find end of argument
-        while (*token && *token != ' ') token++;
-        
-        // Replace space with null terminator
-        if (*token) *token++ = '\0';
-        
-        // Skip spaces between arguments
-        while (*token == ' ') token++;
+    return &commands[index];
+}
+
+static int starts_with(const char* str, const char* prefix) {
+    while (*prefix) {
+        if (*str++ != *prefix++) {
+            return 0;
+        }
     }
-    
-    return argc;
+    return 1;
+}
+
+// Names of commands starting with prefix, in name order. The first max
+// are stored in names and the last in *last; returns how many match.
+int complete_command(const char* prefix, const char* names[], int max, const char** last) {
+    int low = 0;
+    int high = COMMAND_COUNT;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (strcmp(commands[command_sorted[mid]].name, prefix) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    int found = 0;
+    for (int i = low; i < COMMAND_COUNT; i++) {
+        const char* name = commands[command_sorted[i]].name;
+        if (!starts_with(name, prefix)) {
+            break;
+        }
+        if (found < max) {
+            names[found] = name;
+        }
+        *last = name;
+        found++;
+    }
+    return found;
+}
+
+// One hash and one compare: every name owns a slot, so anything that
+// lands on a slot holding a different name is not a command
+const Command* find_command(const char* name) {
+    uint32_t hash = command_hash(name, COMMAND_HASH_SEED);
+    int index = command_slots[hash & (COMMAND_HASH_SIZE - 1)];
+    if (index < 0 || strcmp(commands[index].name, name) != 0) {
+        return NULL;
+    }
+    return &commands[index];
 }
 
 // Built-in commands
-void cmd_help(void) {
+int cmd_help(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
     print_string("\n=== Available Commands ===\n\n");
-    
-    // Basic system commands
-    print_string("help      - Show available commands\n");
-    print_string("clear     - Clear screen\n");
-    print_string("echo      - Echo the arguments\n");
-    print_string("info      - Show system information\n");
-    print_string("version   - Show OS version\n");
-    print_string("shutdown  - Shutdown the system\n");
-    print_string("reboot    - Reboot the system\n");
-    
-    // File system commands
-    print_string("\nFile System:\n");
-    print_string("ls        - List all files in system\n");
-    print_string("create    - Create a new file (create filename)\n");
-    print_string("write     - Write text to file (write filename text)\n");
-    print_string("read      - Read file contents (read filename)\n");
-    print_string("delete    - Delete a file (delete filename)\n");
-    
-    // Process commands
-    print_string("\nProcess Management:\n");
-    print_string("ps        - Show all running processes\n");
-    print_string("run       - Start a new process (run processname)\n");
-    print_string("kill      - Stop a process (kill pid)\n");
-    print_string("demo      - Run process scheduling demo\n");
+
+    const char* group = commands[0].group;
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        if (strcmp(commands[i].group, group) != 0) {
+            group = commands[i].group;
+            print_string("\n");
+            print_string(group);
+            print_string(":\n");
+        }
+
+        // Pad names to a ten character column
+        print_string(commands[i].name);
+        for (int len = strlen(commands[i].name); len < 10; len++) {
+            print_char(' ');
+        }
+        print_string("- ");
+        print_string(commands[i].help);
+        print_char('\n');
+    }
     print_string("\n");
+    return 0;
 }
 
-void cmd_clear(void) {
+int cmd_clear(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
     clear_screen();
+    return 0;
 }
 
-void cmd_echo(const char* text) {
-    if (text == NULL) {
-        print_string("Usage: echo [text]\n");
-        return;
+int cmd_echo(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (i > 1) print_char(' ');
+        print_string(argv[i]);
     }
-    print_string(text);
     print_string("\n");
+    return 0;
 }
 
-void cmd_info(void) {
+int cmd_info(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
     print_string("\nAGRAN OS System Information\n");
     print_string("==========================\n");
     print_string("OS Name: AGRAN OS\n");
@@ -93,84 +164,674 @@ void cmd_info(void) {
     print_string("Architecture: x86\n");
     print_string("Memory: 1.44 MB\n");
     print_string("Features:\n");
-    print_string("- Basic File System\n");
+    print_string("- Hierarchical File System\n");
     print_string("- Process Management\n");
     print_string("- Round Robin Scheduling\n");
+    int hits, misses;
+    get_dcache_stats(&hits, &misses);
+    print_string("Dentry cache: ");
+    print_int(hits);
+    print_string(" hits, ");
+    print_int(misses);
+    print_string(" misses\n");
+
+    const char* disk;
+    int blocks, used, reads, writes, commits, journaled;
+    get_disk_stats(&disk, &blocks, &used);
+    if (disk != NULL) {
+        get_block_stats(&reads, &writes);
+        get_journal_stats(&commits, &journaled);
+        print_string("Disk: ");
+        print_string(disk);
+        print_string(", ");
+        print_int(used);
+        print_string("/");
+        print_int(blocks);
+        print_string(" blocks used, ");
+        print_int(reads);
+        print_string(" reads, ");
+        print_int(writes);
+        print_string(" writes\n");
+        print_string("Journal: ");
+        print_int(commits);
+        print_string(" commits, ");
+        print_int(journaled);
+        print_string(" blocks\n");
+        int requests, merged;
+        get_queue_stats(&requests, &merged);
+        print_string("Block queue: ");
+        print_int(requests);
+        print_string(" requests, ");
+        print_int(merged);
+        print_string(" merged\n");
+    }
+    int cached, dirty, evicted, readahead;
+    get_page_cache_stats(&cached, &dirty, &evicted);
+    get_read_stats(&hits, &misses, &readahead);
+    print_string("Page cache: ");
+    print_int(cached);
+    print_string(" pages (");
+    print_int(dirty);
+    print_string(" dirty), ");
+    print_int(hits);
+    print_string(" hits, ");
+    print_int(misses);
+    print_string(" misses, ");
+    print_int(readahead);
+    print_string(" pages read, ");
+    print_int(evicted);
+    print_string(" evicted\n");
     print_string("==========================\n");
+    return 0;
 }
 
-void cmd_version(void) {
+int cmd_version(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
     print_string("AGRAN OS version 1.0\n");
+    return 0;
 }
 
-void cmd_shutdown(void) {
+int cmd_shutdown(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
     print_string("\nShutting down AGRAN OS...\n");
+    sync_fs();
     print_string("It is now safe to turn off your computer.\n");
     shutdown();
+    return 0;
+}
+
+// Leave QEMU with a status for whoever started it (make bench)
+int cmd_exit(int argc, char* argv[]) {
+    int code = (argc > 1) ? string_to_int(argv[1]) : 0;
+    sync_fs();
+    qemu_exit(code);
+    return 0;
 }
 
-void cmd_reboot(void) {
+int cmd_reboot(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
     print_string("\nRebooting AGRAN OS...\n");
+    sync_fs();
     reboot();
+    return 0;
 }
 
 // File system commands
-void cmd_ls(int argc, char* argv[]) {
+int cmd_ls(int argc, char* argv[]) {
+    return list_directory(argc > 1 ? argv[1] : NULL);
+}
+
+int cmd_create(int argc, char* argv[]) {
+    (void)argc;
+    return create_file(argv[1]);
+}
+
+int cmd_write(int argc, char* argv[]) {
+    (void)argc;
+    return write_file(argv[1], argv[2]);
+}
+
+// send_file sink: the console (or the pipeline's sink) reads the bytes
+// straight out of the page cache
+static int console_sink(const char* data, int length, void* context) {
+    (void)context;
+    write_console(data, length);
+    return length;
+}
+
+// Send a whole file to the console
+static int send_to_console(const char* name) {
+    int size = get_file_size(name);
+    if (size < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    return send_file(name, 0, size, console_sink, NULL) == size ? 0 : -1;
+}
+
+int cmd_read(int argc, char* argv[]) {
+    (void)argc;
+    int result = send_to_console(argv[1]);
+    if (result == 0) {
+        print_string("\n");
+    }
+    return result;
+}
+
+// Files back to back, byte for byte (read adds a newline)
+int cmd_cat(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (send_to_console(argv[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int cmd_cp(int argc, char* argv[]) {
+    (void)argc;
+    return copy_file(argv[1], argv[2]);
+}
+
+int cmd_delete(int argc, char* argv[]) {
+    (void)argc;
+    return delete_file(argv[1]);
+}
+
+int cmd_mkdir(int argc, char* argv[]) {
+    (void)argc;
+    return make_directory(argv[1]);
+}
+
+int cmd_rmdir(int argc, char* argv[]) {
+    (void)argc;
+    return remove_directory(argv[1]);
+}
+
+int cmd_cd(int argc, char* argv[]) {
+    return change_directory(argc > 1 ? argv[1] : "/");
+}
+
+int cmd_pwd(int argc, char* argv[]) {
     (void)argc;
     (void)argv;
-    list_files();
+    char path[MAX_PATH];
+    get_cwd(path, MAX_PATH);
+    print_string(path);
+    print_char('\n');
+    return 0;
 }
 
-void cmd_create(int argc, char* argv[]) {
-    if (argc < 2) {
-        print_string("Usage: create <filename>\n");
-        return;
+int cmd_sync(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+    return sync_fs();
+}
+
+int cmd_mkfile(int argc, char* argv[]) {
+    (void)argc;
+    int kb = string_to_int(argv[2]);
+    if (kb <= 0 || kb > MAX_FILE_SIZE / 1024) {
+        print_string("Error: Size must be 1 to ");
+        print_int(MAX_FILE_SIZE / 1024);
+        print_string(" KB\n");
+        return -1;
+    }
+    if (get_file_size(argv[1]) < 0 && create_file(argv[1]) != 0) {
+        return -1;
     }
-    create_file(argv[1]);
+
+    // Each line says where it sits in the file, so reads are easy to check
+    char chunk[1024];
+    int offset = 0;
+    write_file_data(argv[1], "", 0);
+    for (int k = 0; k < kb; k++) {
+        for (int i = 0; i < 1024; i += 32) {
+            memset(&chunk[i], '.', 31);
+            int value = offset + i;
+            for (int d = 7; d >= 0; d--) {
+                chunk[i + d] = '0' + value % 10;
+                value /= 10;
+            }
+            chunk[i + 31] = '\n';
+        }
+        if (write_file_at(argv[1], offset, chunk, 1024) != 1024) {
+            return -1;
+        }
+        offset += 1024;
+    }
+    print_string("Wrote ");
+    print_int(kb);
+    print_string(" KB to ");
+    print_string(argv[1]);
+    print_char('\n');
+    return 0;
 }
 
-void cmd_write(int argc, char* argv[]) {
-    if (argc < 3) {
-        print_string("Usage: write <filename> <content>\n");
-        return;
+// Read a file front to back with nothing cached, in 1 KB requests like a
+// program reading a stream would make
+int cmd_readbench(int argc, char* argv[]) {
+    (void)argc;
+    int size = get_file_size(argv[1]);
+    if (size < 0) {
+        print_string("Error: File not found\n");
+        return -1;
+    }
+    if (drop_file_cache(argv[1]) != 0) {
+        return -1;
     }
-    write_file(argv[1], argv[2]);
+
+    int reads_before, writes, hits_before, misses_before, ahead_before;
+    get_block_stats(&reads_before, &writes);
+    get_read_stats(&hits_before, &misses_before, &ahead_before);
+
+    char buffer[1024];
+    int offset = 0;
+    int count;
+    uint64_t start = rdtsc();
+    while ((count = read_file_at(argv[1], offset, buffer, sizeof(buffer))) > 0) {
+        offset += count;
+    }
+    uint64_t cycles = rdtsc() - start;
+    if (count < 0) {
+        return -1;
+    }
+
+    int reads, hits, misses, ahead;
+    get_block_stats(&reads, &writes);
+    get_read_stats(&hits, &misses, &ahead);
+    print_string("\n=== Sequential Read Benchmark ===\n");
+    print_string("Read ");
+    print_int(offset / 1024);
+    print_string(" KB in ");
+    print_int(div_u64(cycles * 1000, get_tsc_khz()));
+    print_string(" us, ");
+    print_int(rate_per_sec(offset / 1024, cycles));
+    print_string(" KB/sec\n");
+    print_string("Disk requests: ");
+    print_int(reads - reads_before);
+    print_string(", pages read: ");
+    print_int(ahead - ahead_before);
+    print_string("\nPage hits: ");
+    print_int(hits - hits_before);
+    print_string(", misses: ");
+    print_int(misses - misses_before);
+    print_char('\n');
+    return 0;
 }
 
-void cmd_read(int argc, char* argv[]) {
-    if (argc < 2) {
-        print_string("Usage: read <filename>\n");
-        return;
+int cmd_compress(int argc, char* argv[]) {
+    if (argc > 2) {
+        if (strcmp(argv[2], "on") != 0 && strcmp(argv[2], "off") != 0) {
+            print_string("Usage: compress <filename> [on|off]\n");
+            return -1;
+        }
+        if (set_file_compression(argv[1], strcmp(argv[2], "on") == 0) != 0) {
+            return -1;
+        }
     }
-    char buffer[MAX_CONTENT];
-    if (read_file(argv[1], buffer) >= 0) {
-        print_string(buffer);
-        print_string("\n");
+    int on = get_file_compression(argv[1]);
+    if (on < 0) {
+        print_string("Error: File not found\n");
+        return -1;
     }
+    print_string(argv[1]);
+    print_string(on ? ": compressed\n" : ": not compressed\n");
+    return 0;
 }
 
-void cmd_delete(int argc, char* argv[]) {
-    if (argc < 2) {
-        print_string("Usage: delete <filename>\n");
-        return;
+#define COMPBENCH_CHUNK 1024
+#define COMPBENCH_SAMPLE 16384
+#define COMPBENCH_ROUNDS 64
+
+// Log text for compbench, a line at a time, carried over between chunks
+static char log_text[COMPBENCH_SAMPLE + 128];
+static int log_length;
+static int log_line;
+
+// Append lines like a kernel log to log_text until it holds size bytes
+static void make_log(int size) {
+    static const char* const events[] = {
+        "scheduled, quantum 5", "blocked on pipe read", "woken by pipe write",
+        "exited with code 0", "page fault at user stack, zero page mapped",
+    };
+    while (log_length < size) {
+        char number[12];
+        log_text[log_length++] = '[';
+        int_to_string(log_line * 37 + 1000, number);
+        for (int i = strlen(number); i < 8; i++) {
+            log_text[log_length++] = ' ';
+        }
+        strcpy(&log_text[log_length], number);
+        log_length += strlen(number);
+        strcpy(&log_text[log_length], "] pid ");
+        log_length += 6;
+        int_to_string(log_line % 13 + 2, number);
+        strcpy(&log_text[log_length], number);
+        log_length += strlen(number);
+        log_text[log_length++] = ' ';
+        const char* event = events[(log_line * 7) % 5];
+        strcpy(&log_text[log_length], event);
+        log_length += strlen(event);
+        log_text[log_length++] = '\n';
+        log_line++;
+    }
+}
+
+// Take the first count bytes of log_text
+static void take_log(char* out, int count) {
+    memcpy(out, log_text, count);
+    log_length -= count;
+    memmove(log_text, log_text + count, log_length);
+}
+
+static void print_rate(int kb, uint64_t cycles) {
+    uint32_t rate = rate_per_sec(kb, cycles);     // KB per second
+    print_int(rate / 1024);
+    print_char('.');
+    print_int(rate % 1024 * 10 / 1024);
+    print_string(" MB/s");
+}
+
+// Ratio of a to b with two decimals
+static void print_ratio(int a, int b) {
+    int hundredths = b > 0 ? (int)div_u64((uint64_t)a * 100, b) : 0;
+    print_int(hundredths / 100);
+    print_char('.');
+    if (hundredths % 100 < 10) {
+        print_char('0');
     }
-    delete_file(argv[1]);
+    print_int(hundredths % 100);
+}
+
+typedef struct {
+    int blocks;          // Disk blocks the file took
+    int transferred;     // Blocks moved by the cold read
+    uint64_t write_cycles;
+    uint64_t read_cycles;
+} CompbenchResult;
+
+// Write kb KB of log to a new file, sync it, then read it back cold
+static int compbench_file(const char* name, int compressed, int kb, CompbenchResult* result) {
+    static char chunk[COMPBENCH_CHUNK];
+    const char* disk;
+    int blocks, used_before, used_after, reads_before, reads_after, writes;
+
+    if (create_file(name) != 0 || set_file_compression(name, compressed) != 0) {
+        return -1;
+    }
+    get_disk_stats(&disk, &blocks, &used_before);
+    log_length = 0;
+    log_line = 0;
+    uint64_t start = rdtsc();
+    for (int k = 0; k < kb; k++) {
+        make_log(COMPBENCH_CHUNK);
+        take_log(chunk, COMPBENCH_CHUNK);
+        int offset = k * COMPBENCH_CHUNK;
+        if (write_file_at(name, offset, chunk, COMPBENCH_CHUNK) != COMPBENCH_CHUNK) {
+            return -1;
+        }
+    }
+    if (sync_fs() != 0) {
+        return -1;
+    }
+    result->write_cycles = rdtsc() - start;
+    get_disk_stats(&disk, &blocks, &used_after);
+    result->blocks = used_after - used_before;
+
+    if (drop_file_cache(name) != 0) {
+        return -1;
+    }
+    get_block_stats(&reads_before, &writes);
+    start = rdtsc();
+    for (int k = 0; k < kb; k++) {
+        if (read_file_at(name, k * COMPBENCH_CHUNK, chunk, COMPBENCH_CHUNK) != COMPBENCH_CHUNK) {
+            return -1;
+        }
+    }
+    result->read_cycles = rdtsc() - start;
+    get_block_stats(&reads_after, &writes);
+    result->transferred = reads_after - reads_before;
+    return 0;
+}
+
+static void print_compbench_row(const char* label, int kb, const CompbenchResult* result) {
+    print_string(label);
+    print_int(result->blocks);
+    print_string(" blocks, write+sync ");
+    print_rate(kb, result->write_cycles);
+    print_string(", cold read ");
+    print_rate(kb, result->read_cycles);
+    print_string(" in ");
+    print_int(result->transferred);
+    print_string(" transfers\n");
+}
+
+// Store the same log text plain and compressed, and compare the space
+// each takes and how fast each is written and read back
+int cmd_compbench(int argc, char* argv[]) {
+    static char packed[COMPBENCH_SAMPLE + COMPBENCH_SAMPLE / 255 + 16];
+    static char sample[COMPBENCH_SAMPLE];
+    static char chunk[2][COMPBENCH_CHUNK];
+    int kb = (argc > 1) ? string_to_int(argv[1]) : 256;
+    if (kb <= 0 || kb > MAX_FILE_SIZE / 1024) {
+        print_string("Usage: compbench [kb], at most ");
+        print_int(MAX_FILE_SIZE / 1024);
+        print_string(" KB\n");
+        return -1;
+    }
+    const char* disk;
+    int blocks, used;
+    get_disk_stats(&disk, &blocks, &used);
+    if (disk == NULL) {
+        print_string("Error: No disk, nothing is stored compressed\n");
+        return -1;
+    }
+    if (get_file_size("/compbench.plain") >= 0 || get_file_size("/compbench.lz4") >= 0) {
+        print_string("Error: /compbench.plain or /compbench.lz4 already exists\n");
+        return -1;
+    }
+
+    print_string("\n=== Compression Benchmark ===\n");
+
+    // The compressor alone, on one cluster's worth of log
+    log_length = 0;
+    log_line = 0;
+    make_log(COMPBENCH_SAMPLE);
+    take_log(sample, COMPBENCH_SAMPLE);
+    int packed_length = 0;
+    uint64_t start = rdtsc();
+    for (int r = 0; r < COMPBENCH_ROUNDS; r++) {
+        packed_length = lz4_compress(sample, COMPBENCH_SAMPLE, packed, sizeof(packed));
+    }
+    uint64_t compress_cycles = rdtsc() - start;
+    start = rdtsc();
+    for (int r = 0; r < COMPBENCH_ROUNDS; r++) {
+        lz4_decompress(packed, packed_length, sample, COMPBENCH_SAMPLE);
+    }
+    uint64_t decompress_cycles = rdtsc() - start;
+    print_string("LZ4 on 16 KB of log: ratio ");
+    print_ratio(COMPBENCH_SAMPLE, packed_length);
+    print_string(", compress ");
+    print_rate(COMPBENCH_SAMPLE / 1024 * COMPBENCH_ROUNDS, compress_cycles);
+    print_string(", decompress ");
+    print_rate(COMPBENCH_SAMPLE / 1024 * COMPBENCH_ROUNDS, decompress_cycles);
+    print_char('\n');
+
+    CompbenchResult plain, compressed;
+    int status = 0;
+    if (compbench_file("/compbench.plain", 0, kb, &plain) != 0 ||
+        compbench_file("/compbench.lz4", 1, kb, &compressed) != 0) {
+        status = -1;
+    }
+
+    // Both must read back the same
+    for (int k = 0; k < kb && status == 0; k++) {
+        int offset = k * COMPBENCH_CHUNK;
+        if (read_file_at("/compbench.plain", offset, chunk[0], COMPBENCH_CHUNK) != COMPBENCH_CHUNK ||
+            read_file_at("/compbench.lz4", offset, chunk[1], COMPBENCH_CHUNK) != COMPBENCH_CHUNK) {
+            status = -1;
+        }
+        for (int i = 0; i < COMPBENCH_CHUNK && status == 0; i++) {
+            if (chunk[0][i] != chunk[1][i]) {
+                print_string("Error: Compressed file reads back differently\n");
+                status = -1;
+            }
+        }
+    }
+
+    if (status == 0) {
+        print_compbench_row("Plain:      ", kb, &plain);
+        print_compbench_row("Compressed: ", kb, &compressed);
+        print_string("Disk space saved: ratio ");
+        print_ratio(plain.blocks, compressed.blocks);
+        print_char('\n');
+    }
+    delete_file("/compbench.plain");
+    delete_file("/compbench.lz4");
+    return status;
 }
 
 // Process commands
-void cmd_ps(int argc, char* argv[]) {
+int cmd_ps(int argc, char* argv[]) {
     (void)argc;
     (void)argv;
     display_processes();
+    return 0;
 }
 
-void cmd_run(int argc, char* const argv[]) {
-    if (argc < 2) {
-        print_string("Error: Please provide a process name\n");
-        print_string("Usage: run <process_name>\n");
-        return;
+// top: accounting for every live process, redrawn in place
+#define TOP_REFRESH_MS 1000
+#define TOP_TICK_MS 10           // Scheduling tick while top runs
+
+static void print_column(const char* text, int width) {
+    print_string(text);
+    for (int i = strlen(text); i < width; i++) {
+        print_char(' ');
     }
+}
+
+static void print_number(uint32_t value, int width) {
+    char text[12];
+    int_to_string(value, text);
+    for (int i = strlen(text); i < width; i++) {
+        print_char(' ');
+    }
+    print_string(text);
+}
 
+// Two decimals from hundredths
+static void print_hundredths(int value) {
+    print_int(value / 100);
+    print_char('.');
+    print_char('0' + value / 10 % 10);
+    print_char('0' + value % 10);
+}
+
+// part / whole as a percentage with two decimals, right aligned in 6
+static void print_percent(uint32_t part, uint32_t whole) {
+    uint32_t hundredths = div_u64((uint64_t)part * 10000, whole);
+    if (hundredths < 1000) {
+        print_char(' ');
+    }
+    if (hundredths < 10000) {
+        print_char(' ');
+    }
+    print_hundredths(hundredths);
+}
+
+// part as a percentage of whole. Both are halved until whole fits the
+// 32-bit divisor of div_u64, so long intervals are not truncated.
+static uint32_t percent_of(uint64_t part, uint64_t whole) {
+    if (whole == 0) {
+        return 0;
+    }
+    while (whole > 0xFFFFFFFF) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    return div_u64(part * 100, (uint32_t)whole);
+}
+
+// run_before holds each process's CPU time at the last refresh, for the
+// CPU% column; elapsed is the time since then
+static void draw_top(uint64_t run_before[], uint64_t elapsed) {
+    static const char* states[] = {"ready", "run", "wait", "done"};
+    int load[3];
+    get_load_average(load);
+
+    print_string("top - up ");
+    print_int(div_u64(rdtsc(), get_tsc_khz()) / 1000);
+    print_string("s, load average: ");
+    for (int i = 0; i < 3; i++) {
+        print_hundredths(load[i]);
+        print_string(i < 2 ? ", " : "\n");
+    }
+    print_string("Processes: ");
+    print_int(get_running_process_count());
+    print_string(", context switches: ");
+    print_int(get_context_switches());
+    print_string(", quantum: ");
+    print_int(DEFAULT_QUANTUM);
+    print_string(" ticks\n\n");
+    print_string("PID NAME            STATE   CPU ms  WAIT ms  RESP us  MAXLAT us  SWITCH  CPU%\n");
+
+    for (int pid = 0; pid < MAX_PROCESSES; pid++) {
+        ProcessStats stats;
+        if (get_process_stats(pid, &stats) != 0) {
+            run_before[pid] = 0;
+            continue;
+        }
+        uint64_t ran = stats.run_time >= run_before[pid] ? stats.run_time - run_before[pid] : 0;
+        run_before[pid] = stats.run_time;
+
+        print_number(pid, 3);
+        print_char(' ');
+        stats.name[15] = '\0';
+        print_column(stats.name, 16);
+        print_column(states[stats.state], 8);
+        print_number(div_u64(stats.run_time, get_tsc_khz()), 6);
+        print_number(div_u64(stats.wait_time, get_tsc_khz()), 9);
+        print_number(cycles_to_us(stats.response), 9);
+        print_number(cycles_to_us(stats.max_latency), 11);
+        print_number(stats.switches, 8);
+        print_number(percent_of(ran, elapsed), 6);
+        print_char('\n');
+    }
+}
+
+// 'top' redraws every second until q or Escape is pressed, driving the
+// scheduler with a TOP_TICK_MS tick meanwhile. 'top <n>' prints n
+// snapshots one after another instead, for pipes and scripts.
+int cmd_top(int argc, char* argv[]) {
+    static uint64_t run_before[MAX_PROCESSES];
+    int snapshots = (argc > 1) ? string_to_int(argv[1]) : 0;
+    if (argc > 1 && snapshots <= 0) {
+        print_string("Usage: top [snapshots]\n");
+        return -1;
+    }
+
+    uint64_t tick = (uint64_t)get_tsc_khz() * TOP_TICK_MS;
+    uint64_t refresh = (uint64_t)get_tsc_khz() * TOP_REFRESH_MS;
+    for (int pid = 0; pid < MAX_PROCESSES; pid++) {
+        ProcessStats stats;
+        run_before[pid] = get_process_stats(pid, &stats) == 0 ? stats.run_time : 0;
+    }
+
+    uint64_t last = rdtsc();
+    for (int shown = 0; snapshots == 0 || shown < snapshots; shown++) {
+        if (shown > 0) {
+            // Let the processes run until the next refresh
+            uint64_t next_tick = last + tick;
+            while (rdtsc() - last < refresh) {
+                char key = poll_key();
+                if (snapshots == 0 && (key == 'q' || key == KEY_ESCAPE)) {
+                    return 0;
+                }
+                if (rdtsc() >= next_tick) {
+                    schedule();
+                    next_tick += tick;
+                }
+                update_load_average();
+            }
+        }
+        uint64_t now = rdtsc();
+        if (snapshots == 0) {
+            clear_screen();
+        } else if (shown > 0) {
+            print_char('\n');
+        }
+        draw_top(run_before, now - last);
+        last = now;
+    }
+    return 0;
+}
+
+int cmd_run(int argc, char* argv[]) {
+    (void)argc;
     // Create the process with a default burst time
     int pid = create_process(argv[1], DEFAULT_QUANTUM);
     if (pid >= 0) {
@@ -183,14 +844,13 @@ void cmd_run(int argc, char* const argv[]) {
         print_string("Error: Failed to create process '");
         print_string(argv[1]);
         print_string("'\n");
+        return -1;
     }
+    return 0;
 }
 
-void cmd_kill(int argc, char* const argv[]) {
-    if (argc < 2) {
-        print_string("Usage: kill <pid>\n");
-        return;
-    }
+int cmd_kill(int argc, char* argv[]) {
+    (void)argc;
     int pid = string_to_int(argv[1]);
     if (is_process_alive(pid)) {
         kill_process(pid);
@@ -201,11 +861,561 @@ void cmd_kill(int argc, char* const argv[]) {
         print_string("No such process with PID ");
         print_string(argv[1]);
         print_string("\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int run_and_report(int pid) {
+    int code = run_process(pid);
+    print_string("Process ");
+    print_int(pid);
+    print_string(" exited with code ");
+    print_int(code);
+    print_char('\n');
+    return code;
+}
+
+int cmd_exec(int argc, char* argv[]) {
+    (void)argc;
+    int pid = exec_program(argv[1]);
+    if (pid < 0) {
+        return -1;
+    }
+    int code = run_and_report(pid);
+
+    // Then run anything it forked, until no user programs are left
+    while ((pid = next_user_process()) >= 0) {
+        run_and_report(pid);
+    }
+
+    // The program's own exit code is the command's status
+    return code;
+}
+
+// Cycles for fork+exit of a parent with the given number of resident pages
+static uint64_t fork_exit_cycles(int pages, int rounds, uint64_t* copy_cycles) {
+    uint32_t size = (uint32_t)pages * PAGE_SIZE;
+    AddressSpace* space = create_address_space();
+    if (space == NULL) {
+        return 0;
+    }
+    if (add_region(space, USER_BASE, USER_BASE + size, NULL, 0, 0, 1) != 0) {
+        destroy_address_space(space);
+        return 0;
+    }
+
+    int parent = create_process("forkbench", DEFAULT_QUANTUM);
+    if (parent < 0) {
+        destroy_address_space(space);
+        return 0;
+    }
+    attach_address_space(parent, space, USER_BASE);
+
+    // Touch every page so the parent really has them mapped
+    switch_address_space(space);
+    for (uint32_t addr = USER_BASE; addr < USER_BASE + size; addr += PAGE_SIZE) {
+        *(volatile uint32_t*)addr = addr;
+    }
+    switch_address_space(NULL);
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < rounds; i++) {
+        int child = fork_process(parent, NULL);
+        if (child < 0) {
+            kill_process(parent);
+            return 0;
+        }
+        kill_process(child);
+    }
+    uint64_t cycles = rdtsc() - start;
+
+    // What an eager fork would spend on copying alone
+    start = rdtsc();
+    for (int i = 0; i < pages; i++) {
+        uint32_t frame = alloc_frame();
+        if (frame != 0) {
+            memcpy((void*)frame, (void*)FRAME_BASE, PAGE_SIZE);
+            free_frame(frame);
+        }
     }
+    *copy_cycles = rdtsc() - start;
+
+    kill_process(parent);
+    return cycles;
+}
+
+static void print_fork_result(const char* label, int rounds, uint64_t cycles,
+                              uint64_t copy_cycles) {
+    print_string(label);
+    print_string(" fork+exit ");
+    print_int(cycles_to_ns(div_u64(cycles, rounds)) / 1000);
+    print_string(" us, eager copy would add ");
+    print_int(cycles_to_ns(copy_cycles) / 1000);
+    print_string(" us\n");
+}
+
+int cmd_forkbench(int argc, char* argv[]) {
+    int rounds = (argc > 1) ? string_to_int(argv[1]) : 100;
+    if (rounds <= 0) {
+        print_string("Usage: forkbench [rounds]\n");
+        return -1;
+    }
+
+    print_string("\n=== Copy-on-Write Fork Benchmark ===\n");
+    uint64_t small_copy = 0, large_copy = 0;
+    uint64_t small = fork_exit_cycles(4, rounds, &small_copy);
+    uint64_t large = fork_exit_cycles(1024, rounds, &large_copy);
+    if (small == 0 || large == 0) {
+        print_string("Error: Out of memory or process slots\n");
+        return -1;
+    }
+
+    print_fork_result("Small parent (16 KB):", rounds, small, small_copy);
+    print_fork_result("Large parent (4 MB): ", rounds, large, large_copy);
+    return 0;
+}
+
+// One side of the ping-pong, run while the scheduler has it current:
+// pass the message on if it holds it, otherwise wait for it. Waiting
+// blocks the process, so the peer runs next.
+static int ipc_side(int pid, int peer, Message* msg, int* holding) {
+    if (*holding) {
+        int result = ipc_send(pid, peer, msg, 0);
+        if (result == IPC_OK) {
+            *holding = 0;
+        }
+        return result;
+    }
+    int result = ipc_recv(pid, msg, 0);
+    if (result == IPC_OK) {
+        *holding = 1;
+    }
+    return result;
+}
+
+// schedule() announces every switch; the timed loop keeps that off the
+// console
+static void discard_output(const char* data, int length) {
+    (void)data;
+    (void)length;
+}
+
+// Bounce one message between two processes, returns cycles taken or 0 on
+// error. Whichever one is current takes its next step, so each round trip
+// is two sends, two receives and two blocking switches through
+// block_process and wake_process.
+static uint64_t ipc_ping_pong(int ping, int pong, Message* msg, int rounds) {
+    int holding[2] = {1, 0};    // ping starts with the message
+    int replies = 0;
+    output_sink outer = set_output_sink(discard_output);
+
+    uint64_t start = rdtsc();
+    while (replies < rounds) {
+        int pid = get_current_pid();
+        if (pid != ping && pid != pong) {
+            // Another process's turn, or none picked yet
+            schedule();
+            if (get_current_pid() == -1) {
+                break;
+            }
+            continue;
+        }
+        int side = (pid == pong);
+        int result = ipc_side(pid, side ? ping : pong, msg, &holding[side]);
+        if (result == IPC_ERROR) {
+            break;
+        }
+        if (side == 0 && result == IPC_OK && holding[0]) {
+            replies++;
+        }
+    }
+    uint64_t cycles = rdtsc() - start;
+
+    set_output_sink(outer);
+    return replies == rounds ? cycles : 0;
+}
+
+static void print_ipc_result(const char* label, int rounds, uint64_t cycles) {
+    uint32_t per_round = div_u64(cycles, rounds);
+
+    print_string(label);
+    print_string(" round trip: ");
+    print_int(cycles_to_ns(per_round));
+    print_string(" ns (");
+    print_int(per_round);
+    print_string(" cycles), ");
+    print_int(rate_per_sec(rounds * 2, cycles));
+    print_string(" msgs/sec\n");
+}
+
+int cmd_ipcbench(int argc, char* argv[]) {
+    int rounds = (argc > 1) ? string_to_int(argv[1]) : 10000;
+    if (rounds <= 0) {
+        print_string("Usage: ipcbench [rounds]\n");
+        return -1;
+    }
+
+    print_string("\n=== IPC Ping-Pong Benchmark ===\n");
+    print_string("Round trips between two processes, each blocking in ipc_recv\n");
+    int ping = create_process("ping", DEFAULT_QUANTUM);
+    int pong = create_process("pong", DEFAULT_QUANTUM);
+    if (ping < 0 || pong < 0) {
+        print_string("Error: No free process slots\n");
+        kill_process(ping);
+        kill_process(pong);
+        return -1;
+    }
+
+    // Inline messages are copied into the mailbox slot
+    Message msg;
+    msg.type = MSG_INLINE;
+    msg.length = MSG_DATA_SIZE;
+    msg.buffer = -1;
+    for (int i = 0; i < MSG_DATA_SIZE; i++) {
+        msg.data[i] = (char)i;
+    }
+    uint64_t inline_cycles = ipc_ping_pong(ping, pong, &msg, rounds);
+
+    // A page-sized buffer changes owner instead of being copied
+    msg.type = MSG_BUFFER;
+    msg.length = IPC_BUFFER_SIZE;
+    msg.buffer = ipc_buffer_alloc(ping);
+    uint64_t buffer_cycles = msg.buffer >= 0 ? ipc_ping_pong(ping, pong, &msg, rounds) : 0;
+
+    kill_process(ping);
+    kill_process(pong);
+    if (inline_cycles == 0 || buffer_cycles == 0) {
+        print_string("Error: IPC benchmark failed\n");
+        return -1;
+    }
+    print_ipc_result("Inline (48 bytes)", rounds, inline_cycles);
+    print_ipc_result("Zero-copy (4 KB) ", rounds, buffer_cycles);
+    return 0;
+}
+
+// Results written by the ring 3 half of sysbench
+static int bench_calls;
+static int bench_sysenter;
+static uint64_t bench_int80_cycles;
+static uint64_t bench_sysenter_cycles;
+
+// Runs in ring 3: time a null system call through both entry paths
+static void syscall_bench_user(void) {
+    uint64_t start = rdtsc();
+    for (int i = 0; i < bench_calls; i++) {
+        syscall0(SYS_GETPID);
+    }
+    bench_int80_cycles = rdtsc() - start;
+
+    if (bench_sysenter) {
+        start = rdtsc();
+        for (int i = 0; i < bench_calls; i++) {
+            fast_syscall3(SYS_GETPID, 0, 0, 0);
+        }
+        bench_sysenter_cycles = rdtsc() - start;
+    }
+    syscall1(SYS_EXIT, 0);
+}
+
+// Runs in ring 3: file, process and console operations through int 0x80
+static void user_demo(void) {
+    char buffer[64];
+
+    syscall1(SYS_WRITE, "Hello from ring 3\n");
+    syscall1(SYS_CREATE, "user.txt");
+    syscall2(SYS_WRITE_FILE, "user.txt", "written through int 0x80");
+    if (syscall3(SYS_READ_FILE, (uint32_t)"user.txt", (uint32_t)buffer, sizeof(buffer)) == 0) {
+        syscall1(SYS_WRITE, "Read back: ");
+        syscall1(SYS_WRITE, buffer);
+        syscall1(SYS_WRITE, "\n");
+    }
+    syscall1(SYS_DELETE, "user.txt");
+
+    int pid = syscall2(SYS_SPAWN, "child", DEFAULT_QUANTUM);
+    if (pid >= 0) {
+        syscall1(SYS_KILL, pid);
+    }
+    syscall1(SYS_EXIT, 0);
+}
+
+static void print_syscall_result(const char* label, uint64_t cycles) {
+    uint32_t per_call = div_u64(cycles, bench_calls);
+
+    print_string(label);
+    print_int(cycles_to_ns(per_call));
+    print_string(" ns (");
+    print_int(per_call);
+    print_string(" cycles), ");
+    print_int(rate_per_sec(bench_calls, cycles));
+    print_string(" calls/sec\n");
+}
+
+int cmd_sysbench(int argc, char* argv[]) {
+    bench_calls = (argc > 1) ? string_to_int(argv[1]) : 100000;
+    if (bench_calls <= 0) {
+        print_string("Usage: sysbench [calls]\n");
+        return -1;
+    }
+    bench_sysenter = cpu_has_sysenter();
+
+    print_string("\n=== System Call Benchmark ===\n");
+
+    // Dispatch cost without any privilege change, for reference
+    uint64_t start = rdtsc();
+    for (int i = 0; i < bench_calls; i++) {
+        syscall_dispatch(SYS_GETPID, 0, 0, 0);
+    }
+    uint64_t direct_cycles = rdtsc() - start;
+
+    if (enter_user_mode(syscall_bench_user, &demo_stack[DEMO_STACK_SIZE]) != 0) {
+        print_string("Error: Benchmark faulted in ring 3\n");
+        return -1;
+    }
+
+    print_syscall_result("Direct call: ", direct_cycles);
+    print_syscall_result("int 0x80:    ", bench_int80_cycles);
+    if (bench_sysenter) {
+        print_syscall_result("sysenter:    ", bench_sysenter_cycles);
+    } else {
+        print_string("sysenter:    not supported by this CPU\n");
+    }
+    return 0;
+}
+
+int cmd_userdemo(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+    int code = enter_user_mode(user_demo, &demo_stack[DEMO_STACK_SIZE]);
+    print_string("User program exited with code ");
+    print_int(code);
+    print_char('\n');
+    return code;
+}
+
+// Unattended benchmark suite (make bench). Each result is one line,
+// "BENCH <name> <value> <unit>", so a job can grep them out of the
+// serial log and compare builds.
+#define BENCH_DIR "/benchfs"
+#define BENCH_FILES 200
+#define BENCH_LINES 200
+#define BENCH_SWITCHES 10000
+
+static void print_bench(const char* name, uint32_t value, const char* unit) {
+    print_string("BENCH ");
+    print_string(name);
+    print_char(' ');
+    print_int(value);
+    print_char(' ');
+    print_string(unit);
+    print_char('\n');
+}
+
+// Time from reset to kmain (BIOS and boot sector, or the multiboot
+// loader), and from kmain until the shell could start
+static void bench_boot(void) {
+    uint64_t entry = get_boot_mark(BOOT_ENTRY);
+    print_bench("boot_loader", cycles_to_us(entry), "us");
+    print_bench("boot_kernel", cycles_to_us(get_boot_mark(BOOT_READY) - entry), "us");
+}
+
+// Full lines drawn straight on the screen, scrolling every line
+static void bench_console(void) {
+    char line[VGA_WIDTH];
+    for (int i = 0; i < VGA_WIDTH - 1; i++) {
+        line[i] = 'A' + i % 26;
+    }
+    line[VGA_WIDTH - 1] = '\n';
+
+    int mirrored = mirror_console(0);    // Time the screen, not the serial port
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_LINES; i++) {
+        write_screen(line, VGA_WIDTH);
+    }
+    uint64_t cycles = rdtsc() - start;
+    clear_screen();
+    mirror_console(mirrored);
+    print_bench("console_write", rate_per_sec(BENCH_LINES * VGA_WIDTH, cycles), "chars/s");
+}
+
+static void bench_file_name(char* name, int i) {
+    strcpy(name, BENCH_DIR "/f");
+    int_to_string(i, name + strlen(name));
+}
+
+// Run one fs operation over every benchmark file, returns cycles taken
+// or 0 if any call failed
+static uint64_t bench_fs_pass(int op) {
+    static char buffer[MAX_CONTENT];
+    char name[32];
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_FILES; i++) {
+        bench_file_name(name, i);
+        int result;
+        switch (op) {
+            case 0: result = create_file(name); break;
+            case 1: result = write_file(name, "benchmark data"); break;
+            case 2: result = read_file(name, buffer); break;
+            default: result = delete_file(name); break;
+        }
+        if (result != 0) {
+            return 0;
+        }
+    }
+    return rdtsc() - start;
+}
+
+static int bench_fs(void) {
+    static const char* names[] = {"fs_create", "fs_write", "fs_read", "fs_delete"};
+    uint64_t cycles[4];
+
+    if (make_directory(BENCH_DIR) != 0) {
+        return -1;
+    }
+    for (int op = 0; op < 4; op++) {
+        cycles[op] = bench_fs_pass(op);
+        if (cycles[op] == 0) {
+            return -1;
+        }
+        // Time the journal commit of everything written so far
+        if (op == 1) {
+            uint64_t start = rdtsc();
+            if (sync_fs() != 0) {
+                return -1;
+            }
+            print_bench("fs_sync", cycles_to_us(rdtsc() - start), "us");
+        }
+    }
+    remove_directory(BENCH_DIR);
+    sync_fs();
+
+    for (int op = 0; op < 4; op++) {
+        print_bench(names[op], rate_per_sec(BENCH_FILES, cycles[op]), "ops/s");
+    }
+    return 0;
+}
+
+// Cost of taking the running process off the CPU and picking the next
+// one: blocking it forces a switch, waking it queues it again
+static int bench_switch(void) {
+    int a = create_process("bench_a", 1000000);
+    int b = create_process("bench_b", 1000000);
+    if (a < 0 || b < 0) {
+        kill_process(a);
+        kill_process(b);
+        return -1;
+    }
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_SWITCHES; i++) {
+        int pid = get_current_pid();
+        block_process(pid);
+        wake_process(pid);
+    }
+    uint64_t cycles = rdtsc() - start;
+    kill_process(a);
+    kill_process(b);
+    print_bench("context_switch", cycles_to_ns(div_u64(cycles, BENCH_SWITCHES)), "ns");
+    return 0;
+}
+
+int cmd_bench(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+    print_bench("tsc_rate", get_tsc_khz(), "kHz");
+    bench_boot();
+    bench_console();
+    if (bench_fs() != 0) {
+        print_string("Error: File system benchmark failed\n");
+        return -1;
+    }
+    if (bench_switch() != 0) {
+        print_string("Error: No free process slots\n");
+        return -1;
+    }
+    return 0;
+}
+
+// perf <command>: run a command with the sampling profiler on and list
+// the kernel functions its time went to
+#define PERF_TOP 15
+
+int cmd_perf(int argc, char* argv[]) {
+    static int order[PROFILE_MAX_SYMBOLS];
+    char line[MAX_COMMAND_LENGTH];
+    int length = 0;
+    for (int i = 1; i < argc; i++) {
+        int word = strlen(argv[i]);
+        if (length + word + 1 >= MAX_COMMAND_LENGTH) {
+            print_string("perf: Command too long\n");
+            return -1;
+        }
+        if (i > 1) {
+            line[length++] = ' ';
+        }
+        strcpy(line + length, argv[i]);
+        length += word;
+    }
+    line[length] = '\0';
+
+    profile_start(PROFILE_HZ);
+    uint64_t start = rdtsc();
+    int status = execute_command(line);
+    uint64_t cycles = rdtsc() - start;
+    profile_stop();
+
+    uint32_t total = get_profile_samples();
+    print_string("\n=== perf: ");
+    print_int(total);
+    print_string(" samples in ");
+    print_int(div_u64(cycles, get_tsc_khz()));
+    print_string(" ms ===\n");
+    if (total == 0) {
+        print_string("Command finished before the first sample\n");
+        return status;
+    }
+
+    // Busiest functions first; insertion sort of the ones with samples
+    int count = 0;
+    int symbols = kernel_symbol_count;
+    if (symbols > PROFILE_MAX_SYMBOLS) {
+        symbols = PROFILE_MAX_SYMBOLS;
+    }
+    for (int i = 0; i < symbols; i++) {
+        uint32_t hits = get_profile_symbol_samples(i);
+        if (hits == 0) {
+            continue;
+        }
+        int j = count++;
+        while (j > 0 && get_profile_symbol_samples(order[j - 1]) < hits) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    print_string("Samples       %  Function\n");
+    for (int i = 0; i < count && i < PERF_TOP; i++) {
+        uint32_t hits = get_profile_symbol_samples(order[i]);
+        print_number(hits, 7);
+        print_string("  ");
+        print_percent(hits, total);
+        print_string("  ");
+        print_string(get_symbol_name(order[i]));
+        print_char('\n');
+    }
+    uint32_t user = get_profile_user_samples();
+    if (user > 0) {
+        print_number(user, 7);
+        print_string("  ");
+        print_percent(user, total);
+        print_string("  [ring 3]\n");
+    }
+    return status;
 }
 
 // Demo commands
-void cmd_demo(int argc, char* argv[]) {
+int cmd_demo(int argc, char* argv[]) {
     (void)argc;
     (void)argv;
     print_string("\n=== Process Scheduling Demo ===\n");
@@ -231,9 +1441,10 @@ void cmd_demo(int argc, char* argv[]) {
     }
     
     print_string("\nDemo completed.\n");
+    return 0;
 }
 
-void cmd_filedemo(int argc, char* argv[]) {
+int cmd_filedemo(int argc, char* argv[]) {
     (void)argc;
     (void)argv;
     print_string("\n=== File System Demo ===\n");
@@ -244,43 +1455,328 @@ void cmd_filedemo(int argc, char* argv[]) {
     read_file("test.txt", buffer);
     print_string(buffer);
     print_char('\n');
-    list_files();
+    list_directory(NULL);
     delete_file("test.txt");
-    list_files();
+    list_directory(NULL);
+    return 0;
 }
 
-// Command execution
-void execute_command(const char* command) {
-    char* argv[MAX_ARGS];
-    int argc = parse_command(command, argv);
-    
-    if (argc == 0) return;
-    
-    // System commands
-    if (strcmp(argv[0], "help") == 0) cmd_help();
-    else if (strcmp(argv[0], "clear") == 0) cmd_clear();
-    else if (strcmp(argv[0], "echo") == 0) cmd_echo(argc > 1 ? argv[1] : NULL);
-    else if (strcmp(argv[0], "info") == 0) cmd_info();
-    else if (strcmp(argv[0], "version") == 0) cmd_version();
-    else if (strcmp(argv[0], "shutdown") == 0) cmd_shutdown();
-    else if (strcmp(argv[0], "reboot") == 0) cmd_reboot();
-    
-    // File system commands
-    else if (strcmp(argv[0], "ls") == 0) cmd_ls(argc, argv);
-    else if (strcmp(argv[0], "create") == 0) cmd_create(argc, argv);
-    else if (strcmp(argv[0], "write") == 0) cmd_write(argc, argv);
-    else if (strcmp(argv[0], "read") == 0) cmd_read(argc, argv);
-    else if (strcmp(argv[0], "delete") == 0) cmd_delete(argc, argv);
-    
-    // Process commands
-    else if (strcmp(argv[0], "ps") == 0) cmd_ps(argc, argv);
-    else if (strcmp(argv[0], "run") == 0) cmd_run(argc, argv);
-    else if (strcmp(argv[0], "kill") == 0) cmd_kill(argc, argv);
-    else if (strcmp(argv[0], "demo") == 0) cmd_demo(argc, argv);
-    
-    else {
+int cmd_history(int argc, char* argv[]) {
+    if (argc < 2) {
+        for (int i = 0; i < history_count(); i++) {
+            print_int(i + 1);
+            print_string("  ");
+            print_string(history_get(i));
+            print_char('\n');
+        }
+        return 0;
+    }
+    if (strcmp(argv[1], "save") == 0) {
+        return history_save();
+    }
+    if (strcmp(argv[1], "clear") == 0) {
+        history_clear();
+        return 0;
+    }
+    print_string("Usage: history [save|clear]\n");
+    return -1;
+}
+
+// Script commands
+int cmd_source(int argc, char* argv[]) {
+    (void)argc;
+    return source_file(argv[1]);
+}
+
+int cmd_set(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_string(exit_on_error ? "set -e\n" : "set +e\n");
+        return 0;
+    }
+    if (strcmp(argv[1], "-e") == 0) {
+        exit_on_error = 1;
+    } else if (strcmp(argv[1], "+e") == 0) {
+        exit_on_error = 0;
+    } else {
+        print_string("Usage: set [-e|+e]\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Filters
+void cmd_grep_input(Stage* stage, const char* line, int length) {
+    const char* text = stage->argv[1];
+    int text_length = strlen(text);
+
+    for (int i = 0; i + text_length <= length; i++) {
+        int j = 0;
+        while (j < text_length && line[i + j] == text[j]) j++;
+        if (j == text_length) {
+            write_console(line, length);
+            stage->counts[0]++;
+            return;
+        }
+    }
+}
+
+// Like grep(1): fails when nothing matched
+int cmd_grep_finish(Stage* stage) {
+    return stage->counts[0] > 0 ? 0 : 1;
+}
+
+// counts: lines, words, bytes, and whether the last byte was in a word
+// (long lines arrive in pieces)
+void cmd_wc_input(Stage* stage, const char* line, int length) {
+    for (int i = 0; i < length; i++) {
+        char c = line[i];
+        if (c == '\n') {
+            stage->counts[0]++;
+        }
+        if (c == ' ' || c == '\t' || c == '\n') {
+            stage->counts[3] = 0;
+        } else if (!stage->counts[3]) {
+            stage->counts[1]++;
+            stage->counts[3] = 1;
+        }
+    }
+    stage->counts[2] += length;
+}
+
+int cmd_wc_finish(Stage* stage) {
+    print_int(stage->counts[0]);
+    print_char(' ');
+    print_int(stage->counts[1]);
+    print_char(' ');
+    print_int(stage->counts[2]);
+    print_char('\n');
+    return 0;
+}
+
+// Look up one command of a pipeline and check its arguments
+static const Command* resolve_command(int argc, char* argv[]) {
+    const Command* cmd = find_command(argv[0]);
+    if (cmd == NULL) {
         print_string("Unknown command: ");
         print_string(argv[0]);
         print_string("\nType 'help' for available commands\n");
+        return NULL;
     }
-} 
\ No newline at end of file
+
+    if (argc - 1 < cmd->min_args) {
+        print_string("Usage: ");
+        print_string(cmd->usage);
+        print_string("\n");
+        return NULL;
+    }
+    return cmd;
+}
+
+// Command execution, returns the command's status (0 on success)
+int execute_command(const char* command) {
+    char words[2 * MAX_COMMAND_LENGTH];
+    char* argv[MAX_ARGS];
+    int argc = parse_command(command, words, argv);
+    
+    if (argc == 0) return 0;
+    
+    // Split at '|' into stages; '>' or '>>' may only end the line
+    Pipeline pipeline;
+    pipeline.count = 0;
+    pipeline.redirect = NULL;
+    pipeline.append = 0;
+    int start = 0;
+    for (int i = 0; i <= argc; i++) {
+        if (i < argc && !is_operator(argv[i][0])) {
+            continue;
+        }
+        if (i == start) {
+            print_string("Syntax error: Missing command\n");
+            return -1;
+        }
+        if (pipeline.count == MAX_STAGES) {
+            print_string("Error: Too many commands in pipeline\n");
+            return -1;
+        }
+
+        Stage* stage = &pipeline.stages[pipeline.count++];
+        stage->argc = i - start;
+        stage->argv = &argv[start];
+        stage->command = resolve_command(stage->argc, stage->argv);
+        if (stage->command == NULL) {
+            return -1;
+        }
+        if (pipeline.count > 1 && stage->command->input == NULL) {
+            print_string("Error: ");
+            print_string(argv[start]);
+            print_string(" does not read input\n");
+            return -1;
+        }
+
+        if (i < argc && argv[i][0] == '>') {
+            if (i + 2 != argc || is_operator(argv[i + 1][0])) {
+                print_string("Syntax error: Expected one filename after '>'\n");
+                return -1;
+            }
+            pipeline.redirect = argv[i + 1];
+            pipeline.append = argv[i][1] == '>';
+            break;
+        }
+        start = i + 1;
+    }
+
+    // A lone command needs none of the pipeline machinery
+    const Command* cmd = pipeline.stages[0].command;
+    if (pipeline.count == 1 && pipeline.redirect == NULL && cmd->handler != NULL) {
+        return cmd->handler(argc, argv);
+    }
+    return run_pipeline(&pipeline);
+}
+
+// A script being run: held in memory, or read from a file a block at a
+// time so scripts of any size run without being loaded whole
+typedef struct {
+    const char* name;            // For messages
+    const char* data;            // Memory script, NULL for a file
+    int size;
+    char path[MAX_PATH];         // The file, absolute: the script may cd
+    char block[256];             // File bytes from block_start on
+    int block_start;
+    int block_length;
+    int offset;                  // Next byte to take
+} Script;
+
+static Script scripts[MAX_SOURCE_DEPTH];   // One per nesting level
+
+// The Script for the next nesting level, NULL (after saying so) if
+// scripts are nested too deeply
+static Script* new_script(const char* name) {
+    if (source_depth >= MAX_SOURCE_DEPTH) {
+        print_string("source: Scripts nested too deeply\n");
+        return NULL;
+    }
+    Script* script = &scripts[source_depth];
+    script->name = name;
+    script->offset = 0;
+    return script;
+}
+
+// Next byte of a script, -1 at its end, -2 if the file cannot be read
+static int next_script_byte(Script* script) {
+    if (script->data != NULL) {
+        if (script->offset >= script->size) {
+            return -1;
+        }
+        return (unsigned char)script->data[script->offset++];
+    }
+    if (script->offset >= script->block_start + script->block_length) {
+        script->block_start = script->offset;
+        script->block_length = read_file_at(script->path, script->offset,
+                                            script->block, sizeof(script->block));
+        if (script->block_length <= 0) {
+            return script->block_length == 0 ? -1 : -2;
+        }
+    }
+    return (unsigned char)script->block[script->offset++ - script->block_start];
+}
+
+// Run each line of a script as a command. Returns the status of the
+// last command run.
+static int run_lines(Script* script) {
+    source_depth++;
+
+    char line[MAX_COMMAND_LENGTH];
+    int status = 0;
+    int line_number = 0;
+    int c = 0;
+    while (c != -1) {
+        int len = 0;
+        int too_long = 0;
+        line_number++;
+
+        // Copy one line, without its newline (or CR LF)
+        while ((c = next_script_byte(script)) >= 0 && c != '\n') {
+            if (len < MAX_COMMAND_LENGTH - 1) {
+                line[len++] = c;
+            } else {
+                too_long = 1;
+            }
+        }
+        if (c == -2) {
+            status = -1;
+            break;
+        }
+        if (len > 0 && line[len - 1] == '\r') len--;
+        line[len] = '\0';
+
+        char* start = line;
+        while (*start == ' ' || *start == '\t') start++;
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+
+        if (too_long) {
+            print_string("source: Line too long\n");
+            status = -1;
+        } else {
+            status = execute_command(start);
+        }
+
+        if (status != 0 && exit_on_error) {
+            print_string(script->name);
+            print_char(':');
+            print_int(line_number);
+            print_string(": Command failed, stopping script\n");
+            break;
+        }
+    }
+
+    source_depth--;
+    return status;
+}
+
+// Run each line of a file as a command. Lines go straight to
+// execute_command, so nothing is echoed and no prompt is drawn. Blank
+// lines and lines starting with '#' are skipped. Returns the status of
+// the last command run, like sh.
+int source_file(const char* name) {
+    if (get_file_size(name) < 0) {
+        print_string("source: File not found: ");
+        print_string(name);
+        print_char('\n');
+        return -1;
+    }
+    Script* script = new_script(name);
+    if (script == NULL) {
+        return -1;
+    }
+    script->data = NULL;
+    script->path[0] = '\0';
+    if (name[0] != '/') {
+        get_cwd(script->path, MAX_PATH);
+    }
+    int length = strlen(script->path);
+    if (length > 0 && script->path[length - 1] != '/') {
+        script->path[length++] = '/';
+    }
+    if (length + (int)strlen(name) >= MAX_PATH) {
+        print_string("source: Path too long\n");
+        return -1;
+    }
+    strcpy(script->path + length, name);
+    script->block_start = 0;
+    script->block_length = 0;
+    return run_lines(script);
+}
+
+// Run each line of a script held in memory as a command. name is only
+// used in messages. Returns the status of the last command run.
+int run_script(const char* name, const char* data, int size) {
+    Script* script = new_script(name);
+    if (script == NULL) {
+        return -1;
+    }
+    script->data = data;
+    script->size = size;
+    return run_lines(script);
+}
@@ -1,32 +1,97 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+typedef struct Stage Stage;
+
+// Handlers return 0 on success and nonzero on failure
+typedef int (*command_handler)(int argc, char* argv[]);
+
+// Filters read the output of the previous pipeline stage a line at a
+// time (the line keeps its '\n'); finish runs at end of input
+typedef void (*filter_input)(Stage* stage, const char* line, int length);
+typedef int (*filter_finish)(Stage* stage);
+
+// One entry per line of commands.def
+typedef struct {
+    const char* name;
+    command_handler handler;     // NULL for filters
+    filter_input input;          // NULL for plain commands
+    filter_finish finish;
+    int min_args;          // Arguments required after the command name
+    const char* usage;
+    const char* help;
+    const char* group;     // Heading the command is listed under in 'help'
+} Command;
+
 // File system commands
-void cmd_ls(int argc, char* argv[]);
-void cmd_create(int argc, char* argv[]);
-void cmd_write(int argc, char* argv[]);
-void cmd_read(int argc, char* argv[]);
-void cmd_delete(int argc, char* argv[]);
+int cmd_ls(int argc, char* argv[]);
+int cmd_create(int argc, char* argv[]);
+int cmd_write(int argc, char* argv[]);
+int cmd_read(int argc, char* argv[]);
+int cmd_cat(int argc, char* argv[]);
+int cmd_cp(int argc, char* argv[]);
+int cmd_delete(int argc, char* argv[]);
+int cmd_mkdir(int argc, char* argv[]);
+int cmd_rmdir(int argc, char* argv[]);
+int cmd_cd(int argc, char* argv[]);
+int cmd_pwd(int argc, char* argv[]);
+int cmd_sync(int argc, char* argv[]);
+int cmd_mkfile(int argc, char* argv[]);
+int cmd_readbench(int argc, char* argv[]);
+int cmd_compress(int argc, char* argv[]);
+int cmd_compbench(int argc, char* argv[]);
 
 // System commands
-void cmd_help(void);
-void cmd_clear(void);
-void cmd_echo(const char* text);
-void cmd_info(void);
-void cmd_version(void);
-void cmd_shutdown(void);
-void cmd_reboot(void);
+int cmd_help(int argc, char* argv[]);
+int cmd_clear(int argc, char* argv[]);
+int cmd_echo(int argc, char* argv[]);
+int cmd_info(int argc, char* argv[]);
+int cmd_version(int argc, char* argv[]);
+int cmd_shutdown(int argc, char* argv[]);
+int cmd_reboot(int argc, char* argv[]);
+int cmd_exit(int argc, char* argv[]);
+int cmd_bench(int argc, char* argv[]);
+int cmd_perf(int argc, char* argv[]);
 
 // Process commands
-void cmd_ps(int argc, char* argv[]);
-void cmd_run(int argc, char* const argv[]);
-void cmd_kill(int argc, char* const argv[]);
+int cmd_ps(int argc, char* argv[]);
+int cmd_top(int argc, char* argv[]);
+int cmd_run(int argc, char* argv[]);
+int cmd_kill(int argc, char* argv[]);
+int cmd_ipcbench(int argc, char* argv[]);
+int cmd_exec(int argc, char* argv[]);
+int cmd_forkbench(int argc, char* argv[]);
+
+// System call commands
+int cmd_sysbench(int argc, char* argv[]);
+int cmd_userdemo(int argc, char* argv[]);
+
+// Shell state commands
+int cmd_history(int argc, char* argv[]);
+
+// Script commands
+int cmd_source(int argc, char* argv[]);
+int cmd_set(int argc, char* argv[]);
+
+// Filters
+void cmd_grep_input(Stage* stage, const char* line, int length);
+int cmd_grep_finish(Stage* stage);
+void cmd_wc_input(Stage* stage, const char* line, int length);
+int cmd_wc_finish(Stage* stage);
 
 // Demo commands
-void cmd_demo(int argc, char* argv[]);
-void cmd_filedemo(int argc, char* argv[]);
+int cmd_demo(int argc, char* argv[]);
+int cmd_filedemo(int argc, char* argv[]);
+
+// Command table lookup
+const Command* find_command(const char* name);
+int get_command_count(void);
+const Command* get_command(int index);
+int complete_command(const char* prefix, const char* names[], int max, const char** last);
 
 // Command execution
-void execute_command(const char* command);
+int execute_command(const char* command);
+int source_file(const char* name);
+int run_script(const char* name, const char* data, int size);
 
 #endif 
\ No newline at end of file
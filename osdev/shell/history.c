@@ -0,0 +1,183 @@
+#include "../include/kernel.h"
+#include "../fs/fs.h"
+#include "history.h"
+#include <stddef.h>
+
+// Entries are NUL-terminated strings packed back to back into one arena
+// that wraps like a ring. An entry never straddles the end: when it
+// would, writing restarts at offset 0. Writing over old bytes evicts
+// the entries stored there, oldest first.
+static char arena[HISTORY_ARENA_SIZE];
+static uint16_t entry_offset[HISTORY_MAX_ENTRIES];   // Ring, oldest at 'first'
+static int first = 0;
+static int count = 0;
+static int next_offset = 0;                          // Where the next entry goes
+
+// Set once the history is kept in HISTORY_FILE
+static int persistent = 0;
+
+static void evict_oldest(void) {
+    first = (first + 1) % HISTORY_MAX_ENTRIES;
+    count--;
+}
+
+// Returns 1 if the line was added, 0 if skipped (blank or a repeat)
+static int add_entry(const char* line) {
+    int length = strlen(line) + 1;
+    if (length == 1 || length > HISTORY_ARENA_SIZE) {
+        return 0;
+    }
+    if (count > 0 && strcmp(history_get(count - 1), line) == 0) {
+        return 0;
+    }
+
+    // Surviving entries from the previous lap sit from next_offset to
+    // the end and are the oldest; wrapping drops them
+    if (next_offset + length > HISTORY_ARENA_SIZE) {
+        while (count > 0 && entry_offset[first] >= next_offset) {
+            evict_oldest();
+        }
+        next_offset = 0;
+    }
+
+    // The oldest entry is always the first one at or after next_offset
+    while (count > 0 && entry_offset[first] >= next_offset &&
+           entry_offset[first] < next_offset + length) {
+        evict_oldest();
+    }
+    if (count == HISTORY_MAX_ENTRIES) {
+        evict_oldest();
+    }
+
+    memcpy(&arena[next_offset], line, length);
+    entry_offset[(first + count) % HISTORY_MAX_ENTRIES] = next_offset;
+    count++;
+    next_offset += length;
+    return 1;
+}
+
+void history_add(const char* line) {
+    add_entry(line);
+}
+
+// Add a line typed at the prompt, and append it to HISTORY_FILE if the
+// history is being kept there
+void history_record(const char* line) {
+    if (!add_entry(line) || !persistent) {
+        return;
+    }
+
+    int size = get_file_size(HISTORY_FILE);
+    if (size < 0) {
+        persistent = 0;              // File was deleted: stop keeping it
+        return;
+    }
+    // history_load reads the file as one page
+    int length = strlen(line);
+    if (size + length + 1 > MAX_CONTENT - 1 ||
+        append_file_data(HISTORY_FILE, line, length) != 0 ||
+        append_file_data(HISTORY_FILE, "\n", 1) != 0) {
+        history_save();              // Full: rewrite with the newest entries
+    }
+}
+
+void history_clear(void) {
+    first = 0;
+    count = 0;
+    next_offset = 0;
+}
+
+int history_count(void) {
+    return count;
+}
+
+const char* history_get(int index) {
+    if (index < 0 || index >= count) {
+        return NULL;
+    }
+    return &arena[entry_offset[(first + index) % HISTORY_MAX_ENTRIES]];
+}
+
+// Whether text occurs anywhere in str
+static int contains(const char* str, const char* text) {
+    for (; *str; str++) {
+        int i = 0;
+        while (text[i] && str[i] == text[i]) i++;
+        if (text[i] == '\0') {
+            return 1;
+        }
+    }
+    return text[0] == '\0';
+}
+
+// Newest entry before index 'before' that contains text, or -1
+int history_search(const char* text, int before) {
+    if (before > count) {
+        before = count;
+    }
+    for (int i = before - 1; i >= 0; i--) {
+        if (contains(history_get(i), text)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Read HISTORY_FILE (one command per line) and keep the history there
+// from now on
+int history_load(void) {
+    int size;
+    const char* data = get_file_data(HISTORY_FILE, &size);
+    if (data == NULL) {
+        return -1;
+    }
+
+    char line[256];
+    int length = 0;
+    for (int i = 0; i <= size; i++) {
+        if (i == size || data[i] == '\n') {
+            line[length] = '\0';
+            add_entry(line);
+            length = 0;
+        } else if (length < (int)sizeof(line) - 1) {
+            line[length++] = data[i];
+        }
+    }
+    put_file_data(data);
+    persistent = 1;
+    return 0;
+}
+
+// Write the newest entries that fit into HISTORY_FILE, oldest first,
+// and keep appending to it from now on
+int history_save(void) {
+    static char buffer[MAX_CONTENT];
+    int start = count;
+    int size = 0;
+    while (start > 0) {
+        int length = strlen(history_get(start - 1)) + 1;
+        if (size + length > MAX_CONTENT - 1) {
+            break;
+        }
+        size += length;
+        start--;
+    }
+
+    int offset = 0;
+    for (int i = start; i < count; i++) {
+        const char* entry = history_get(i);
+        int length = strlen(entry);
+        memcpy(&buffer[offset], entry, length);
+        buffer[offset + length] = '\n';
+        offset += length + 1;
+    }
+
+    if (get_file_size(HISTORY_FILE) < 0 && create_file(HISTORY_FILE) != 0) {
+        return -1;
+    }
+    if (write_file_data(HISTORY_FILE, buffer, size) != 0) {
+        return -1;
+    }
+    persistent = 1;
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#define HISTORY_ARENA_SIZE 16384    // Bytes shared by all entries
+#define HISTORY_MAX_ENTRIES 512
+#define HISTORY_FILE "/.history"
+
+// History functions. Entries are numbered from 0 (oldest) to
+// history_count() - 1 (newest).
+void history_add(const char* line);
+void history_record(const char* line);
+void history_clear(void);
+int history_count(void);
+const char* history_get(int index);
+int history_search(const char* text, int before);
+
+// Persistence in HISTORY_FILE
+int history_load(void);
+int history_save(void);
+
+#endif
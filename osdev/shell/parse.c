@@ -0,0 +1,38 @@
+#include "parse.h"
+
+// Whether a character ends a word without needing a space
+int is_operator(char c) {
+    return c == '|' || c == '>';
+}
+
+// Helper function to parse command string into argc/argv. Each word is
+// copied into words (2 * MAX_COMMAND_LENGTH bytes), which the caller owns
+// so that commands can run other commands (source) without clobbering
+// their own argv. '|', '>' and '>>' are words even without spaces.
+int parse_command(const char* command, char* words, char* argv[]) {
+    int argc = 0;
+    int in = 0;
+    int out = 0;
+    
+    while (argc < MAX_ARGS) {
+        // Skip spaces between arguments
+        while (command[in] == ' ' && in < MAX_COMMAND_LENGTH - 1) in++;
+        if (command[in] == '\0' || in >= MAX_COMMAND_LENGTH - 1) break;
+        
+        argv[argc++] = &words[out];
+        if (is_operator(command[in])) {
+            words[out++] = command[in++];
+            if (words[out - 1] == '>' && command[in] == '>') {
+                words[out++] = command[in++];
+            }
+        } else {
+            while (command[in] != '\0' && command[in] != ' ' && !is_operator(command[in]) &&
+                   in < MAX_COMMAND_LENGTH - 1) {
+                words[out++] = command[in++];
+            }
+        }
+        words[out++] = '\0';
+    }
+    
+    return argc;
+}
@@ -0,0 +1,11 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include "shell.h"
+
+// Command line parsing, kept apart from the command table so it can be
+// built and tested on the host
+int is_operator(char c);
+int parse_command(const char* command, char* words, char* argv[]);
+
+#endif
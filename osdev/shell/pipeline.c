@@ -0,0 +1,160 @@
+#include "../include/kernel.h"
+#include "../fs/fs.h"
+#include "../process/pipe.h"
+#include "pipeline.h"
+#include <stddef.h>
+
+// Stage whose output print_* is currently producing
+static Stage* current_stage = NULL;
+
+static void flush_redirect(Pipeline* pipeline) {
+    if (pipeline->buffered > 0 &&
+        append_file_data(pipeline->redirect, pipeline->buffer, pipeline->buffered) != 0) {
+        pipeline->overflow = 1;
+    }
+    pipeline->buffered = 0;
+}
+
+// Hand bytes to a filter one line at a time
+static void feed_stage(Stage* stage, const char* data, int length) {
+    for (int i = 0; i < length; i++) {
+        stage->line[stage->line_length++] = data[i];
+        if (data[i] == '\n' || stage->line_length == MAX_COMMAND_LENGTH) {
+            stage->command->input(stage, stage->line, stage->line_length);
+            stage->line_length = 0;
+        }
+    }
+}
+
+// Run the next stage on everything waiting in this stage's pipe. Its
+// output goes through the sink as well, so a long pipeline advances one
+// pipe-full at a time and never holds a whole command's output.
+static void drain(Stage* stage) {
+    Stage* reader = stage + 1;
+    char chunk[64];
+    int count;
+
+    current_stage = reader;
+    while ((count = pipe_read(stage->pipe, chunk, sizeof(chunk))) > 0) {
+        feed_stage(reader, chunk, count);
+    }
+    current_stage = stage;
+}
+
+// Installed as the console sink while a pipeline runs
+static void pipeline_sink(const char* data, int length) {
+    Stage* stage = current_stage;
+    Pipeline* pipeline = stage->pipeline;
+
+    if (stage->pipe >= 0) {
+        while (length > 0) {
+            int written = pipe_write(stage->pipe, data, length);
+            data += written;
+            length -= written;
+            if (length > 0) {
+                drain(stage);
+            }
+        }
+    } else if (pipeline->redirect != NULL) {
+        // Whole pages (cat, read) go to the file as they are
+        if (length >= REDIRECT_BUFFER_SIZE) {
+            flush_redirect(pipeline);
+            if (append_file_data(pipeline->redirect, data, length) != 0) {
+                pipeline->overflow = 1;
+            }
+            return;
+        }
+        while (length > 0) {
+            if (pipeline->buffered == REDIRECT_BUFFER_SIZE) {
+                flush_redirect(pipeline);
+            }
+            pipeline->buffer[pipeline->buffered++] = *data++;
+            length--;
+        }
+    } else if (pipeline->outer != NULL) {
+        // Nested pipeline (e.g. a sourced script): pass it on outwards
+        current_stage = pipeline->outer_stage;
+        pipeline->outer(data, length);
+        current_stage = stage;
+    } else {
+        write_screen(data, length);
+    }
+}
+
+static void destroy_pipes(Pipeline* pipeline) {
+    for (int i = 0; i < pipeline->count; i++) {
+        pipe_destroy(pipeline->stages[i].pipe);
+    }
+}
+
+// Run a parsed pipeline, returns the status of its last command
+int run_pipeline(Pipeline* pipeline) {
+    for (int i = 0; i < pipeline->count; i++) {
+        Stage* stage = &pipeline->stages[i];
+        stage->pipeline = pipeline;
+        stage->line_length = 0;
+        for (int j = 0; j < 4; j++) {
+            stage->counts[j] = 0;
+        }
+        stage->pipe = -1;
+        if (i < pipeline->count - 1 && (stage->pipe = pipe_create()) < 0) {
+            print_string("Error: No free pipes\n");
+            destroy_pipes(pipeline);
+            return -1;
+        }
+    }
+
+    // Open the target before output is redirected, so errors still show
+    pipeline->buffered = 0;
+    pipeline->overflow = 0;
+    if (pipeline->redirect != NULL) {
+        int result = 0;
+        if (get_file_size(pipeline->redirect) < 0) {
+            result = create_file(pipeline->redirect);
+        } else if (!pipeline->append) {
+            result = write_file_data(pipeline->redirect, "", 0);
+        }
+        if (result != 0) {
+            destroy_pipes(pipeline);
+            return -1;
+        }
+    }
+
+    pipeline->outer_stage = current_stage;
+    pipeline->outer = set_output_sink(pipeline_sink);
+
+    // The first command only produces; a filter there gets no input
+    Stage* first = &pipeline->stages[0];
+    current_stage = first;
+    int status;
+    if (first->command->handler != NULL) {
+        status = first->command->handler(first->argc, first->argv);
+    } else {
+        status = first->command->finish(first);
+    }
+
+    // Each later stage gets whatever is still buffered, then its end of input
+    for (int i = 1; i < pipeline->count; i++) {
+        Stage* stage = &pipeline->stages[i];
+        drain(stage - 1);
+        current_stage = stage;
+        if (stage->line_length > 0) {
+            stage->command->input(stage, stage->line, stage->line_length);
+            stage->line_length = 0;
+        }
+        status = stage->command->finish(stage);
+    }
+
+    if (pipeline->redirect != NULL) {
+        flush_redirect(pipeline);
+    }
+    set_output_sink(pipeline->outer);
+    current_stage = pipeline->outer_stage;
+    destroy_pipes(pipeline);
+
+    if (pipeline->overflow) {
+        print_string("Error: File too large, output truncated\n");
+        return -1;
+    }
+    return status;
+}
@@ -0,0 +1,40 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "../kernel/screen.h"
+#include "shell.h"
+#include "commands.h"
+
+#define MAX_STAGES 4
+#define REDIRECT_BUFFER_SIZE 128
+
+typedef struct Pipeline Pipeline;
+
+// One command of a pipeline
+struct Stage {
+    const Command* command;
+    int argc;
+    char** argv;
+    int pipe;                        // Pipe to the next stage, -1 for the last
+    char line[MAX_COMMAND_LENGTH];   // Input line being assembled for a filter
+    int line_length;
+    int counts[4];                   // Scratch space for filters
+    Pipeline* pipeline;
+};
+
+// Commands joined by '|', optionally ending in '> file' or '>> file'
+struct Pipeline {
+    Stage stages[MAX_STAGES];
+    int count;
+    const char* redirect;            // File the last stage writes to, or NULL
+    int append;                      // '>>' rather than '>'
+    char buffer[REDIRECT_BUFFER_SIZE];
+    int buffered;
+    int overflow;                    // The file filled up, output was lost
+    output_sink outer;               // Sink in use before the pipeline started
+    Stage* outer_stage;
+};
+
+int run_pipeline(Pipeline* pipeline);
+
+#endif
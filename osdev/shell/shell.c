@@ -1,7 +1,10 @@
+#include "../include/kernel.h"
 #include "../kernel/screen.h"
 #include "../kernel/keyboard.h"
+#include "../fs/fs.h"
 #include "shell.h"
 #include "commands.h"
+#include "history.h"
 #include <stddef.h>
 
 // Prototype for int_to_string implemented in kernel.c
@@ -9,92 +12,329 @@ void int_to_string(int num, char* str);
 
 #define MAX_COMMAND_LENGTH 256
 #define MAX_ARGS 16
-#define HISTORY_SIZE 2
+#define PROMPT "$ "
+#define PROMPT_LENGTH 2
+#define MAX_COMPLETIONS 32
 
-// Buffer for command input
+// Line being edited. The screen cursor always sits at input[pos].
 static char input[MAX_COMMAND_LENGTH];
+static int length = 0;
 static int pos = 0;
 
-// Command history
-static char history[HISTORY_SIZE][MAX_COMMAND_LENGTH] = {0};
-static int history_count = 0;
+// Entry shown while browsing with the arrows; history_count() means a new line
 static int history_pos = 0;
-static int navigating_history = 0;
 
-// Helper to redraw the input line
+// Reverse incremental search (Ctrl-R)
+static int searching = 0;
+static char search_text[MAX_COMMAND_LENGTH];
+static int search_length = 0;
+static int search_match = -1;
+static int search_failed = 0;
+static int search_shown = 0;   // Characters drawn for the search line
+
+static void move_to(int new_pos) {
+    if (new_pos != pos) {
+        move_cursor(new_pos - pos);
+        pos = new_pos;
+    }
+}
+
+// Redraw input from 'from' (where the cursor is) to the end, blank out
+// 'stale' cells left over from a longer line, then put the cursor at
+// 'cursor'. Only the changed tail is written and the hardware cursor is
+// moved once for the write and once to come back.
+static void redraw_tail(int from, int stale, int cursor) {
+    char blanks[MAX_COMMAND_LENGTH];
+    for (int i = 0; i < stale; i++) {
+        blanks[i] = ' ';
+    }
+    write_console(&input[from], length - from);
+    write_console(blanks, stale);
+    move_cursor(cursor - (length + stale));
+    pos = cursor;
+}
+
+// Helper to redraw the input line after other output
 void redraw_input() {
-    print_char('\r');           // Move cursor to start of line
-    print_string("$ ");
-    print_string(input);
-    pos = strlen(input);
+    print_string(PROMPT);
+    pos = 0;
+    redraw_tail(0, 0, length);
 }
 
-// Handle keyboard input
-void handle_input(char c) {
-    // Arrow key handling (assuming get_arrow_key returns special codes)
-    if ((unsigned char)c == 0x80) { // Up arrow
-        if (history_count > 0) {
-            if (!navigating_history) {
-                history_pos = history_count - 1;
-                navigating_history = 1;
-            } else if (history_pos > 0) {
-                history_pos--;
-            }
-            if (history_pos >= 0 && history_pos < history_count) {
-                memset(input, 0, MAX_COMMAND_LENGTH);
-                int idx = (history_count <= HISTORY_SIZE) ? history_pos : (history_pos % HISTORY_SIZE);
-                strncpy(input, history[idx], MAX_COMMAND_LENGTH - 1);
-                input[MAX_COMMAND_LENGTH - 1] = '\0';
-                redraw_input();
-            }
+// Replace the whole line, rewriting only what differs from the old one
+static void set_input(const char* text) {
+    int common = 0;
+    while (common < length && text[common] == input[common]) common++;
+
+    int old_length = length;
+    strncpy(&input[common], &text[common], MAX_COMMAND_LENGTH - 1 - common);
+    input[MAX_COMMAND_LENGTH - 1] = '\0';
+    length = strlen(input);
+
+    move_to(common);
+    redraw_tail(common, old_length > length ? old_length - length : 0, length);
+}
+
+// Type text at the cursor as if it had been keyed in
+static void insert_text(const char* text, int count) {
+    if (count > MAX_COMMAND_LENGTH - 1 - length) {
+        count = MAX_COMMAND_LENGTH - 1 - length;
+    }
+    if (count <= 0) {
+        return;
+    }
+    memmove(&input[pos + count], &input[pos], length - pos);
+    memcpy(&input[pos], text, count);
+    length += count;
+    input[length] = '\0';
+    redraw_tail(pos, 0, pos + count);
+}
+
+// Remove the character under the cursor
+static void delete_char(void) {
+    if (pos == length) {
+        return;
+    }
+    memmove(&input[pos], &input[pos + 1], length - pos);
+    length--;
+    redraw_tail(pos, 1, pos);
+}
+
+// Wipe the prompt and line so a search line can take their place
+static void erase_input(void) {
+    move_to(length);
+    int count = PROMPT_LENGTH + length;
+    for (int i = 0; i < count; i++) {
+        print_char('\b');
+    }
+}
+
+static void erase_search(void) {
+    for (int i = 0; i < search_shown; i++) {
+        print_char('\b');
+    }
+    search_shown = 0;
+}
+
+static void show(const char* str) {
+    print_string(str);
+    search_shown += strlen(str);
+}
+
+static void draw_search(void) {
+    erase_search();
+    show(search_failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`");
+    show(search_text);
+    show("': ");
+    if (search_match >= 0) {
+        show(history_get(search_match));
+    }
+}
+
+// Look for search_text in entries older than 'before'; a miss keeps the
+// previous match on screen, as bash does
+static void search_from(int before) {
+    int match = history_search(search_text, before);
+    search_failed = (match < 0 && search_length > 0);
+    if (match >= 0) {
+        search_match = match;
+    }
+    draw_search();
+}
+
+// Leave search mode and go back to the prompt, with the match as the
+// line if 'keep' is set
+static void end_search(int keep) {
+    searching = 0;
+    erase_search();
+    if (keep && search_match >= 0) {
+        history_pos = search_match;
+        strncpy(input, history_get(search_match), MAX_COMMAND_LENGTH - 1);
+        input[MAX_COMMAND_LENGTH - 1] = '\0';
+        length = strlen(input);
+    }
+    redraw_input();
+}
+
+static void handle_search_key(char c) {
+    unsigned char key = (unsigned char)c;
+
+    if (key == KEY_CTRL('r')) {
+        // Next older match
+        if (search_match >= 0) {
+            search_from(search_match);
+        }
+    } else if (key == KEY_ESCAPE || key == KEY_CTRL('g')) {
+        // Cancel: back to the line as it was
+        end_search(0);
+    } else if (c == '\b') {
+        if (search_length > 0) {
+            search_text[--search_length] = '\0';
+            search_match = -1;
+            search_from(history_count());
         }
+    } else if (c == '\n') {
+        end_search(1);
+        handle_input('\n');
+    } else if (key >= ' ' && key < 0x7F) {
+        if (search_length < MAX_COMMAND_LENGTH - 1) {
+            search_text[search_length++] = c;
+            search_text[search_length] = '\0';
+            // Incremental: the current match may still fit
+            search_from(search_match >= 0 ? search_match + 1 : history_count());
+        }
+    } else {
+        end_search(1);
+    }
+}
+
+// Tab: complete the word before the cursor. The first word of a command
+// (also after '|') is a command name, anything else a filename. A unique
+// match is completed with a trailing space, or a '/' for a directory;
+// several are extended to their common prefix, or listed if that adds
+// nothing. Matches come in name order, so the common prefix of all of
+// them is that of the first and the last; only MAX_COMPLETIONS are
+// listed.
+static void complete(void) {
+    int start = pos;
+    while (start > 0 && input[start - 1] != ' ' && input[start - 1] != '|' &&
+           input[start - 1] != '>') {
+        start--;
+    }
+    int before = start;
+    while (before > 0 && input[before - 1] == ' ') before--;
+    int is_command = (before == 0 || input[before - 1] == '|');
+
+    char prefix[MAX_COMMAND_LENGTH];
+    int prefix_length = pos - start;
+    memcpy(prefix, &input[start], prefix_length);
+    prefix[prefix_length] = '\0';
+
+    const char* matches[MAX_COMPLETIONS];
+    const char* last = NULL;
+    int count = is_command ? complete_command(prefix, matches, MAX_COMPLETIONS, &last)
+                           : complete_filename(prefix, matches, MAX_COMPLETIONS, &last);
+    if (count == 0) {
         return;
     }
-    if ((unsigned char)c == 0x81) { // Down arrow
-        if (navigating_history && history_count > 0) {
-            if (history_pos < history_count - 1) {
-                history_pos++;
-                if (history_pos >= 0 && history_pos < history_count) {
-                    memset(input, 0, MAX_COMMAND_LENGTH);
-                    int idx = (history_count <= HISTORY_SIZE) ? history_pos : (history_pos % HISTORY_SIZE);
-                    strncpy(input, history[idx], MAX_COMMAND_LENGTH - 1);
-                    input[MAX_COMMAND_LENGTH - 1] = '\0';
-                    redraw_input();
-                }
-            } else {
-                navigating_history = 0;
-                memset(input, 0, MAX_COMMAND_LENGTH);
-                redraw_input();
+
+    // Filename matches are names within the directory part of the path,
+    // so only the text after the last '/' is being completed
+    if (!is_command) {
+        for (int i = prefix_length; i > 0; i--) {
+            if (prefix[i - 1] == '/') {
+                memmove(prefix, &prefix[i], prefix_length - i + 1);
+                prefix_length -= i;
+                break;
             }
         }
-        return;
     }
-    if (c == '\n') {
-        print_string("\n");
-        input[pos] = '\0';
-        execute_command(input);
-        // Store in history if not empty
-        if (pos > 0) {
-            strncpy(history[history_count % HISTORY_SIZE], input, MAX_COMMAND_LENGTH - 1);
-            history[history_count % HISTORY_SIZE][MAX_COMMAND_LENGTH - 1] = '\0';
-            history_count++;
+
+    int common = 0;
+    while (matches[0][common] != '\0' && last[common] == matches[0][common]) common++;
+
+    if (common > prefix_length) {
+        insert_text(matches[0] + prefix_length, common - prefix_length);
+    }
+    if (count == 1) {
+        // A directory gets a '/' so completion can carry on inside it
+        char word[MAX_COMMAND_LENGTH];
+        int word_length = pos - start;
+        memcpy(word, &input[start], word_length);
+        word[word_length] = '\0';
+        insert_text(!is_command && is_directory(word) ? "/" : " ", 1);
+    } else if (common == prefix_length) {
+        int cursor = pos;
+        move_to(length);
+        print_char('\n');
+        int shown = count < MAX_COMPLETIONS ? count : MAX_COMPLETIONS;
+        for (int i = 0; i < shown; i++) {
+            print_string(matches[i]);
+            print_string("  ");
         }
-        memset(input, 0, MAX_COMMAND_LENGTH); // Clear buffer
-        pos = 0;
-        navigating_history = 0;
+        if (count > shown) {
+            print_string("(");
+            print_int(count - shown);
+            print_string(" more)");
+        }
+        print_char('\n');
         redraw_input();
+        move_to(cursor);
+    }
+}
+
+// Handle keyboard input
+void handle_input(char c) {
+    unsigned char key = (unsigned char)c;
+
+    if (searching) {
+        handle_search_key(c);
         return;
     }
-    else if (c == '\b') {
+
+    switch (key) {
+    case KEY_CTRL('r'):
+        erase_input();
+        searching = 1;
+        search_length = 0;
+        search_text[0] = '\0';
+        search_match = -1;
+        search_failed = 0;
+        draw_search();
+        return;
+    case KEY_UP:
+        if (history_pos > 0) {
+            history_pos--;
+            set_input(history_get(history_pos));
+        }
+        return;
+    case KEY_DOWN:
+        if (history_pos < history_count()) {
+            history_pos++;
+            set_input(history_pos < history_count() ? history_get(history_pos) : "");
+        }
+        return;
+    case KEY_LEFT:
+        if (pos > 0) move_to(pos - 1);
+        return;
+    case KEY_RIGHT:
+        if (pos < length) move_to(pos + 1);
+        return;
+    case KEY_HOME:
+    case KEY_CTRL('a'):
+        move_to(0);
+        return;
+    case KEY_END:
+    case KEY_CTRL('e'):
+        move_to(length);
+        return;
+    case KEY_DELETE:
+        delete_char();
+        return;
+    case '\t':
+        complete();
+        return;
+    case '\b':
         if (pos > 0) {
-            pos--;
-            input[pos] = '\0';
-            backspace();
+            move_to(pos - 1);
+            delete_char();
         }
+        return;
+    case '\n':
+        move_to(length);
+        print_string("\n");
+        history_record(input);
+        execute_command(input);
+        sync_fs();    // One journal commit for everything the line changed
+        memset(input, 0, MAX_COMMAND_LENGTH); // Clear buffer
+        length = 0;
+        history_pos = history_count();
+        redraw_input();
+        return;
     }
-    else if (pos < MAX_COMMAND_LENGTH - 1) {
-        input[pos++] = c;
-        print_char(c);
+
+    if (key >= ' ' && key < 0x7F) {
+        insert_text(&c, 1);
     }
 }
 
@@ -103,8 +343,19 @@ void init_shell(void) {
     clear_screen();
     print_string("Welcome to AGRAN OS v0.1\n");
     print_string("Type 'help' for a list of commands\n\n");
-    print_string("$ ");
-    pos = 0;
+
+    // Pick up the history kept by an earlier 'history save'
+    history_load();
+
+    // Run the boot script, if there is one, before the first prompt
+    if (get_file_size(AUTORUN_FILE) >= 0) {
+        source_file(AUTORUN_FILE);
+        print_char('\n');
+    }
+
+    length = 0;
+    history_pos = history_count();
+    redraw_input();
 }
 
 // Run the shell
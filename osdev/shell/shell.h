@@ -7,6 +7,9 @@
 #define MAX_COMMAND_LENGTH 256
 #define MAX_ARGS 16
 
+// Script run by init_shell at boot when it exists in the fs
+#define AUTORUN_FILE "/autorun"
+
 // Shell functions
 void init_shell(void);
 void handle_input(char c);
@@ -0,0 +1,123 @@
+#include "stubs.h"
+#include "../fs/fs.h"
+#include "../process/process.h"
+#include "../shell/parse.h"
+#include <stdio.h>
+#include <time.h>
+
+// Microbenchmarks for the host build. Each one runs a fixed amount of
+// work RUNS times and reports the fastest run, which is far steadier
+// than the mean on a shared machine.
+
+#define RUNS 5
+#define FILES 1000
+#define DECISIONS 100000
+#define LINES 100000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void report(const char* name, uint64_t best, int ops) {
+    printf("%-16s %8d ops %10.1f ns/op\n", name, ops, (double)best / ops);
+}
+
+static void file_name(char* name, int i) {
+    sprintf(name, "/bench/f%04d", i);
+}
+
+static void bench_fs(void) {
+    uint64_t best[3] = {UINT64_MAX, UINT64_MAX, UINT64_MAX};
+    char name[32];
+    int size;
+
+    init_fs();
+    make_directory("/bench");
+    for (int run = 0; run < RUNS; run++) {
+        uint64_t start = now_ns();
+        for (int i = 0; i < FILES; i++) {
+            file_name(name, i);
+            create_file(name);
+        }
+        uint64_t created = now_ns();
+        for (int i = 0; i < FILES; i++) {
+            file_name(name, (i * 7919) % FILES);
+            put_file_data(get_file_data(name, &size));
+        }
+        uint64_t looked_up = now_ns();
+        for (int i = 0; i < FILES; i++) {
+            file_name(name, i);
+            delete_file(name);
+        }
+        uint64_t deleted = now_ns();
+
+        if (created - start < best[0]) best[0] = created - start;
+        if (looked_up - created < best[1]) best[1] = looked_up - created;
+        if (deleted - looked_up < best[2]) best[2] = deleted - looked_up;
+    }
+    report("fs create", best[0], FILES);
+    report("fs lookup", best[1], FILES);
+    report("fs delete", best[2], FILES);
+}
+
+// Two costs: a tick that leaves the running process alone, and a switch,
+// forced by blocking the running process and queueing it again behind
+// seven others
+static void bench_schedule(void) {
+    uint64_t best[2] = {UINT64_MAX, UINT64_MAX};
+    for (int run = 0; run < RUNS; run++) {
+        init_scheduler();
+        for (int i = 0; i < 8; i++) {
+            create_process("bench", 4 * DECISIONS);
+        }
+        uint64_t start = now_ns();
+        for (int i = 0; i < DECISIONS; i++) {
+            schedule();
+        }
+        uint64_t ticked = now_ns();
+        for (int i = 0; i < DECISIONS; i++) {
+            int pid = get_current_pid();
+            block_process(pid);
+            wake_process(pid);
+        }
+        uint64_t switched = now_ns();
+
+        if (ticked - start < best[0]) best[0] = ticked - start;
+        if (switched - ticked < best[1]) best[1] = switched - ticked;
+    }
+    init_scheduler();
+    report("schedule tick", best[0], DECISIONS);
+    report("schedule switch", best[1], DECISIONS);
+}
+
+static void bench_parse(void) {
+    static const char* lines[] = {
+        "ls",
+        "write notes.txt hello world",
+        "cat /var/log/messages | grep error > errors.txt",
+        "history>>saved",
+    };
+    static char words[2 * MAX_COMMAND_LENGTH];
+    static char* argv[MAX_ARGS];
+    volatile int words_seen = 0;
+    uint64_t best = UINT64_MAX;
+    for (int run = 0; run < RUNS; run++) {
+        uint64_t start = now_ns();
+        for (int i = 0; i < LINES; i++) {
+            words_seen += parse_command(lines[i % 4], words, argv);
+        }
+        uint64_t elapsed = now_ns() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    report("parse", best, LINES);
+}
+
+int main(void) {
+    stub_attach_disk();
+    bench_fs();
+    bench_schedule();
+    bench_parse();
+    return 0;
+}
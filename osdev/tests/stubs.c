@@ -0,0 +1,200 @@
+#include "stubs.h"
+#include "../mm/memory.h"
+#include "../mm/paging.h"
+#include "../kernel/cpu.h"
+#include "../fs/block.h"
+#include "../kernel/timer.h"
+#include <string.h>
+
+// Console
+
+static char console[STUB_CONSOLE_SIZE];
+static int console_used = 0;
+static int console_total = 0;
+
+void print_char(char c) {
+    if (console_used < STUB_CONSOLE_SIZE - 1) {
+        console[console_used++] = c;
+        console[console_used] = '\0';
+    }
+    console_total++;
+}
+
+void print_string(const char* str) {
+    while (*str) {
+        print_char(*str++);
+    }
+}
+
+void print_int(int num) {
+    char digits[12];
+    int count = 0;
+    unsigned int value = num < 0 ? 0u - (unsigned int)num : (unsigned int)num;
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    if (num < 0) {
+        print_char('-');
+    }
+    while (count > 0) {
+        print_char(digits[--count]);
+    }
+}
+
+const char* console_output(void) {
+    return console;
+}
+
+int console_length(void) {
+    return console_total;
+}
+
+void console_reset(void) {
+    console_used = 0;
+    console_total = 0;
+    console[0] = '\0';
+}
+
+// Frames
+
+static char pool[STUB_FRAMES][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static uint8_t frame_used[STUB_FRAMES];
+static int frames_used = 0;
+static int next_frame = 0;
+
+uint32_t alloc_frame(void) {
+    for (int i = 0; i < STUB_FRAMES; i++) {
+        int frame = (next_frame + i) % STUB_FRAMES;
+        if (!frame_used[frame]) {
+            frame_used[frame] = 1;
+            frames_used++;
+            next_frame = frame + 1;
+            return (uint32_t)(uintptr_t)pool[frame];
+        }
+    }
+    return 0;
+}
+
+void free_frame(uint32_t frame) {
+    int index = ((char*)(uintptr_t)frame - pool[0]) / PAGE_SIZE;
+    if (frame_used[index]) {
+        frame_used[index] = 0;
+        frames_used--;
+    }
+}
+
+int stub_frames_used(void) {
+    return frames_used;
+}
+
+// Forget every frame handed out; for tests that re-run init_fs, which
+// drops its page cache without freeing the frames
+void stub_frames_reset(void) {
+    memset(frame_used, 0, sizeof(frame_used));
+    frames_used = 0;
+    next_frame = 0;
+}
+
+// RAM disk
+
+#define DISK_SECTORS (8 * 1024 * 1024 / SECTOR_SIZE)
+
+static uint8_t disk[DISK_SECTORS * SECTOR_SIZE];
+static int disk_writes = 0;
+
+static int disk_read(uint32_t lba, uint32_t count, void* buffer) {
+    if (lba + count > DISK_SECTORS) {
+        return -1;
+    }
+    memcpy(buffer, disk + lba * SECTOR_SIZE, count * SECTOR_SIZE);
+    return 0;
+}
+
+static int disk_write(uint32_t lba, uint32_t count, const void* buffer) {
+    if (lba + count > DISK_SECTORS) {
+        return -1;
+    }
+    memcpy(disk + lba * SECTOR_SIZE, buffer, count * SECTOR_SIZE);
+    disk_writes++;
+    return 0;
+}
+
+static int disk_flush(void) {
+    return 0;
+}
+
+static int disk_batches = 0;
+
+// Scatter-gather straight from the requests' buffers, as a queued disk
+static void disk_transfer_batch(BlockTransfer* transfers, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t lba = transfers[i].lba;
+        transfers[i].status = 0;
+        for (BlockRequest* r = transfers[i].first; r != transfers[i].end; r = r->next) {
+            uint32_t sectors = r->count * SECTORS_PER_BLOCK;
+            int status = transfers[i].write ? disk_write(lba, sectors, r->buffer)
+                                            : disk_read(lba, sectors, r->buffer);
+            if (status != 0) {
+                transfers[i].status = -1;
+            }
+            lba += sectors;
+        }
+    }
+    disk_batches++;
+}
+
+static BlockDevice ram_disk = {"ramdisk", DISK_SECTORS, disk_read, disk_write, disk_flush, NULL};
+
+void stub_attach_disk(void) {
+    memset(disk, 0, sizeof(disk));
+    disk_writes = 0;
+    register_block_device(&ram_disk);
+}
+
+int stub_disk_writes(void) {
+    return disk_writes;
+}
+
+void stub_disk_batching(int on) {
+    ram_disk.transfer_batch = on ? disk_transfer_batch : NULL;
+    disk_batches = 0;
+}
+
+int stub_disk_batches(void) {
+    return disk_batches;
+}
+
+// Timer: the scheduler reads the TSC directly; its rate only scales
+// load sampling, so a nominal 1GHz will do
+
+uint32_t get_tsc_khz(void) {
+    return 1000000;
+}
+
+// Paging and user mode: the scheduler only needs them to exist
+
+void destroy_address_space(AddressSpace* space) {
+    (void)space;
+}
+
+AddressSpace* clone_address_space(AddressSpace* parent) {
+    (void)parent;
+    return NULL;
+}
+
+void switch_address_space(AddressSpace* space) {
+    (void)space;
+}
+
+// The "user program" is a host function, run in place
+int enter_user_mode(void (*entry)(void), void* user_stack) {
+    (void)user_stack;
+    entry();
+    return 0;
+}
+
+int resume_user_mode(const UserContext* context) {
+    (void)context;
+    return -1;
+}
@@ -0,0 +1,33 @@
+#ifndef STUBS_H
+#define STUBS_H
+
+#include <stdint.h>
+
+// Host stand-ins for the kernel services fs.c, process.c and parse.c
+// call into: a console that captures output, a frame allocator backed by
+// a static pool, and a RAM disk.
+
+#define STUB_FRAMES 4096          // 16MB of frames
+#define STUB_CONSOLE_SIZE 8192    // Captured output kept, the rest counted
+
+// Console output since the last console_reset(), NUL terminated and
+// truncated to STUB_CONSOLE_SIZE - 1 characters
+const char* console_output(void);
+int console_length(void);
+void console_reset(void);
+
+// Frame pool. The kernel passes frames around as uint32_t, so the pool
+// must sit below 4GB: host binaries are linked -no-pie.
+int stub_frames_used(void);
+void stub_frames_reset(void);
+
+// Register an 8MB RAM disk as the block device, zeroed
+void stub_attach_disk(void);
+int stub_disk_writes(void);
+
+// Give the RAM disk a transfer_batch hook, so the block queue hands it
+// several transfers at a time; count the batches it gets
+void stub_disk_batching(int on);
+int stub_disk_batches(void);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Minimal check harness: a failed CHECK reports and moves on, so one run
+// lists every failure
+extern int tests_run;
+extern int tests_failed;
+
+#define CHECK(cond) do { \
+    tests_run++; \
+    if (!(cond)) { \
+        tests_failed++; \
+        printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+void test_parse(void);
+void test_process(void);
+void test_fs(void);
+
+#endif
@@ -0,0 +1,297 @@
+#include "test.h"
+#include "stubs.h"
+#include "../fs/fs.h"
+#include "../fs/initrd.h"
+#include <string.h>
+
+static char buffer[MAX_CONTENT];
+
+// A file spanning direct and indirect blocks, with a recognisable pattern
+static void check_large_file(void) {
+    static char data[64 * 1024];
+    static char back[64 * 1024];
+    for (unsigned int i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 7 + i / 4096);
+    }
+    CHECK(create_file("/large") == 0);
+    CHECK(write_file_data("/large", data, sizeof(data)) == 0);
+    CHECK(get_file_size("/large") == (int)sizeof(data));
+    CHECK(read_file_at("/large", 0, back, sizeof(back)) == (int)sizeof(back));
+    CHECK(memcmp(data, back, sizeof(data)) == 0);
+
+    // Unaligned access across a page boundary
+    CHECK(write_file_at("/large", 4090, "boundary", 8) == 8);
+    CHECK(read_file_at("/large", 4090, back, 8) == 8);
+    CHECK(memcmp(back, "boundary", 8) == 0);
+    CHECK(read_file_at("/large", sizeof(data) - 4, back, 100) == 4);
+}
+
+// An initrd with /etc/motd and /bin/script
+static void check_initrd(void) {
+    static uint32_t image[256];
+    InitrdHeader* header = (InitrdHeader*)image;
+    InitrdEntry* entries = (InitrdEntry*)(header + 1);
+    char* data = (char*)(entries + 2);
+    memset(image, 0, sizeof(image));
+    header->magic = INITRD_MAGIC;
+    header->count = 2;
+    strcpy(entries[0].path, "etc/motd");
+    entries[0].offset = data - (char*)image;
+    entries[0].size = 5;
+    memcpy(data, "hello", 5);
+    strcpy(entries[1].path, "bin/script");
+    entries[1].offset = entries[0].offset + 16;
+    entries[1].size = 4;
+    memcpy(data + 16, "echo", 4);
+    header->size = entries[1].offset + 4;
+
+    CHECK(init_initrd(image, header->size - 1) < 0);    // Cut short by the loader
+    CHECK(init_initrd(image, sizeof(image)) == 2);
+    stub_frames_reset();
+    init_fs();
+    CHECK(is_directory("/etc"));
+    CHECK(read_file("/bin/script", buffer) == 0);
+    CHECK(strcmp(buffer, "echo") == 0);
+    int size = 0;
+    CHECK(get_file_data("/etc/motd", &size) == data && size == 5);
+
+    // The first write copies the file out; the copy is what survives
+    CHECK(append_file_data("/etc/motd", " world", 6) == 0);
+    CHECK(read_file("/etc/motd", buffer) == 0);
+    CHECK(strcmp(buffer, "hello world") == 0);
+    CHECK(memcmp(data, "hello", 5) == 0);
+    CHECK(sync_fs() == 0);
+    stub_frames_reset();
+    init_fs();
+    CHECK(read_file("/etc/motd", buffer) == 0);
+    CHECK(strcmp(buffer, "hello world") == 0);
+    CHECK(get_file_size("/bin/script") == 4);
+
+    // A corrupt image is refused
+    entries[1].size = 1000;
+    CHECK(init_initrd(image, sizeof(image)) < 0);
+    stub_frames_reset();
+    init_fs();
+    CHECK(get_file_size("/bin/script") < 0);
+    CHECK(delete_file("/etc/motd") == 0);
+}
+
+// Pages lent out for mapping are the cache's own; writes through them
+// reach the disk once marked dirty, and the file stays put meanwhile
+static void check_mapped_pages(void) {
+    CHECK(create_file("/mapped") == 0);
+    CHECK(write_file("/mapped", "mapped text") == 0);
+    int file = open_file("/mapped");
+    CHECK(file >= 0);
+    char* page = get_file_page(file, 0, 1);
+    CHECK(page != NULL && memcmp(page, "mapped text", 12) == 0);
+    CHECK(get_file_page(file, 0, 1) == page);
+    page[0] = 'M';
+    dirty_file_page(file, 0);
+    CHECK(delete_file("/mapped") != 0);
+    CHECK(write_file("/mapped", "other") != 0);
+    put_file_page(file, 0, page);
+    CHECK(drop_file_cache("/mapped") != 0);    // One mapping is left
+    put_file_page(file, 0, page);
+
+    CHECK(drop_file_cache("/mapped") == 0);
+    CHECK(read_file("/mapped", buffer) == 0);
+    CHECK(strcmp(buffer, "Mapped text") == 0);
+
+    // Borrowed bytes outlive a rewrite; the old page goes when returned
+    int size = 0;
+    const char* data = get_file_data("/mapped", &size);
+    CHECK(data != NULL && size == 11);
+    int frames = stub_frames_used();
+    CHECK(write_file("/mapped", "new text") == 0);
+    CHECK(memcmp(data, "Mapped text", 11) == 0);
+    CHECK(stub_frames_used() == frames + 1);
+    put_file_data(data);
+    CHECK(stub_frames_used() == frames);
+
+    // A mapping whose pages were never touched holds the file too
+    hold_file(file);
+    CHECK(delete_file("/mapped") != 0);
+    CHECK(write_file_data("/mapped", "", 0) != 0);
+    release_file(file);
+    CHECK(delete_file("/mapped") == 0);
+}
+
+// Completion counts every match, even past the names it stores
+static void check_completion(void) {
+    char name[16];
+    int done = 0;
+    CHECK(make_directory("/c") == 0);
+    for (int i = 0; i < 40; i++) {
+        sprintf(name, "/c/log%03d", i * 5);
+        done += create_file(name) == 0;
+    }
+    CHECK(done == 40);
+    const char* names[8];
+    const char* last = NULL;
+    CHECK(complete_filename("/c/l", names, 8, &last) == 40);
+    CHECK(strcmp(names[0], "log000") == 0 && strcmp(names[7], "log035") == 0);
+    CHECK(last != NULL && strcmp(last, "log195") == 0);
+    CHECK(complete_filename("/c/log1", names, 8, &last) == 20);
+    done = 0;
+    for (int i = 0; i < 40; i++) {
+        sprintf(name, "/c/log%03d", i * 5);
+        done += delete_file(name) == 0;
+    }
+    CHECK(done == 40);
+    CHECK(remove_directory("/c") == 0);
+}
+
+// send_file sink gathering what it is handed; takes at most limit bytes
+static char sent[16 * 1024];
+static int sent_length;
+static int sent_limit;
+
+static int gather_sink(const char* data, int length, void* context) {
+    (void)context;
+    if (length > sent_limit - sent_length) {
+        length = sent_limit - sent_length;
+    }
+    memcpy(sent + sent_length, data, length);
+    sent_length += length;
+    return length;
+}
+
+// Transfers hand out whole cache pages and stop when the sink is full;
+// a copy is independent of its source
+static void check_transfer(void) {
+    static char data[10000];
+    for (unsigned int i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 13 + i / 4096);
+    }
+    CHECK(create_file("/src") == 0);
+    CHECK(set_file_compression("/src", 1) == 0);
+    CHECK(write_file_data("/src", data, sizeof(data)) == 0);
+
+    sent_length = 0;
+    sent_limit = sizeof(sent);
+    CHECK(send_file("/src", 100, sizeof(data), gather_sink, NULL) == (int)sizeof(data) - 100);
+    CHECK(memcmp(sent, data + 100, sizeof(data) - 100) == 0);
+    sent_length = 0;
+    sent_limit = 5000;
+    CHECK(send_file("/src", 0, sizeof(data), gather_sink, NULL) == 5000);
+    CHECK(send_file("/missing", 0, 1, gather_sink, NULL) < 0);
+
+    CHECK(copy_file("/src", "/dst") == 0);
+    CHECK(get_file_compression("/dst") == 1);
+    CHECK(write_file_at("/src", 0, "changed", 7) == 7);
+    CHECK(copy_file("/src", "/src") != 0);
+    CHECK(copy_file("/missing", "/dst") != 0);
+    CHECK(sync_fs() == 0);
+    stub_frames_reset();
+    init_fs();
+    static char back[sizeof(data)];
+    CHECK(get_file_size("/dst") == (int)sizeof(data));
+    CHECK(read_file_at("/dst", 0, back, sizeof(back)) == (int)sizeof(back));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+
+    // Copying over a file replaces it
+    CHECK(write_file("/src", "short") == 0);
+    CHECK(copy_file("/src", "/dst") == 0);
+    CHECK(read_file("/dst", buffer) == 0);
+    CHECK(strcmp(buffer, "short") == 0);
+    CHECK(delete_file("/src") == 0);
+    CHECK(delete_file("/dst") == 0);
+}
+
+void test_fs(void) {
+    stub_attach_disk();
+    console_reset();
+    init_fs();
+
+    CHECK(create_file("notes") == 0);
+    CHECK(write_file("notes", "hello") == 0);
+    CHECK(read_file("notes", buffer) == 0);
+    CHECK(strcmp(buffer, "hello") == 0);
+    CHECK(append_file_data("notes", " world", 7) == 0);
+    CHECK(read_file("/notes", buffer) == 0);
+    CHECK(strcmp(buffer, "hello world") == 0);
+
+    // Errors are reported, not fatal
+    console_reset();
+    CHECK(create_file("notes") != 0);
+    CHECK(strstr(console_output(), "Error:") != NULL);
+    CHECK(read_file("missing", buffer) != 0);
+    CHECK(delete_file("missing") != 0);
+
+    // Directories and relative paths
+    CHECK(make_directory("a") == 0);
+    CHECK(make_directory("a/b") == 0);
+    CHECK(create_file("/a/b/f") == 0);
+    CHECK(write_file("a/b/f", "deep") == 0);
+    CHECK(change_directory("a/b") == 0);
+    char cwd[MAX_PATH];
+    get_cwd(cwd, sizeof(cwd));
+    CHECK(strcmp(cwd, "/a/b") == 0);
+    CHECK(read_file("../b/./f", buffer) == 0);
+    CHECK(strcmp(buffer, "deep") == 0);
+    CHECK(remove_directory("/a") != 0);
+    CHECK(change_directory("/") == 0);
+    CHECK(is_directory("a/b"));
+    CHECK(!is_directory("a/b/f"));
+    CHECK(delete_file("a/b/f") == 0);
+    CHECK(remove_directory("a/b") == 0);
+    CHECK(remove_directory("a") == 0);
+
+    check_large_file();
+
+    // Compression is transparent to readers
+    CHECK(create_file("/log") == 0);
+    CHECK(set_file_compression("/log", 1) == 0);
+    static char text[32 * 1024];
+    for (unsigned int i = 0; i < sizeof(text); i++) {
+        text[i] = "0123456789 repeated text\n"[i % 25];
+    }
+    CHECK(write_file_data("/log", text, sizeof(text)) == 0);
+    CHECK(get_file_compression("/log") == 1);
+
+    // Everything survives a sync and a remount from the disk
+    int writes = stub_disk_writes();
+    CHECK(sync_fs() == 0);
+    CHECK(stub_disk_writes() > writes);
+    stub_frames_reset();
+    init_fs();
+    CHECK(read_file("/notes", buffer) == 0);
+    CHECK(strcmp(buffer, "hello world") == 0);
+    CHECK(!is_directory("/a"));
+    CHECK(get_file_size("/large") == 64 * 1024);
+    CHECK(read_file_at("/large", 4090, buffer, 8) == 8);
+    CHECK(memcmp(buffer, "boundary", 8) == 0);
+    static char back[32 * 1024];
+    CHECK(read_file_at("/log", 0, back, sizeof(back)) == (int)sizeof(back));
+    CHECK(memcmp(text, back, sizeof(text)) == 0);
+
+    // Deleting gives the frames back
+    CHECK(drop_file_cache("/large") == 0);
+    int frames = stub_frames_used();
+    CHECK(read_file_at("/large", 0, buffer, sizeof(buffer)) == (int)sizeof(buffer));
+    CHECK(stub_frames_used() > frames);
+    CHECK(delete_file("/large") == 0);
+    CHECK(stub_frames_used() <= frames);
+    CHECK(delete_file("/log") == 0);
+
+    // A disk that takes batches sees the same data
+    stub_disk_batching(1);
+    check_large_file();
+    CHECK(sync_fs() == 0);
+    CHECK(stub_disk_batches() > 0);
+    stub_frames_reset();
+    init_fs();
+    CHECK(read_file_at("/large", 4090, buffer, 8) == 8);
+    CHECK(memcmp(buffer, "boundary", 8) == 0);
+    CHECK(delete_file("/large") == 0);
+    stub_disk_batching(0);
+
+    check_initrd();
+    check_mapped_pages();
+    check_transfer();
+    check_completion();
+
+    CHECK(delete_file("/notes") == 0);
+    CHECK(sync_fs() == 0);
+}
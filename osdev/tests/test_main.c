@@ -0,0 +1,26 @@
+#include "test.h"
+#include "stubs.h"
+
+int tests_run = 0;
+int tests_failed = 0;
+
+int main(void) {
+    static const struct {
+        const char* name;
+        void (*run)(void);
+    } suites[] = {
+        {"parse", test_parse},
+        {"process", test_process},
+        {"fs", test_fs},
+    };
+
+    for (unsigned int i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+        int failed = tests_failed;
+        int run = tests_run;
+        suites[i].run();
+        printf("%-8s %4d checks, %d failed\n", suites[i].name,
+               tests_run - run, tests_failed - failed);
+    }
+    printf("%s: %d checks, %d failed\n", tests_failed ? "FAIL" : "PASS", tests_run, tests_failed);
+    return tests_failed ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+#include "test.h"
+#include "../shell/parse.h"
+#include <string.h>
+
+static char words[2 * MAX_COMMAND_LENGTH];
+static char* argv[MAX_ARGS];
+
+void test_parse(void) {
+    CHECK(parse_command("", words, argv) == 0);
+    CHECK(parse_command("   ", words, argv) == 0);
+
+    int argc = parse_command("  echo   hello  world ", words, argv);
+    CHECK(argc == 3);
+    CHECK(strcmp(argv[0], "echo") == 0);
+    CHECK(strcmp(argv[1], "hello") == 0);
+    CHECK(strcmp(argv[2], "world") == 0);
+
+    // Operators are words without surrounding spaces
+    argc = parse_command("cat a|grep x>out", words, argv);
+    CHECK(argc == 7);
+    CHECK(strcmp(argv[2], "|") == 0);
+    CHECK(strcmp(argv[4], "x") == 0);
+    CHECK(strcmp(argv[5], ">") == 0);
+    CHECK(strcmp(argv[6], "out") == 0);
+
+    argc = parse_command("ls>>log", words, argv);
+    CHECK(argc == 3);
+    CHECK(strcmp(argv[1], ">>") == 0);
+    CHECK(strcmp(argv[2], "log") == 0);
+
+    // '>>>' is '>>' then '>'
+    argc = parse_command("a>>>b", words, argv);
+    CHECK(argc == 4);
+    CHECK(strcmp(argv[1], ">>") == 0 && strcmp(argv[2], ">") == 0);
+
+    // Arguments past MAX_ARGS are dropped
+    char line[MAX_COMMAND_LENGTH];
+    line[0] = '\0';
+    for (int i = 0; i < MAX_ARGS + 4; i++) {
+        strcat(line, "x ");
+    }
+    CHECK(parse_command(line, words, argv) == MAX_ARGS);
+
+    // The command is never read past MAX_COMMAND_LENGTH - 1 characters
+    char unterminated[MAX_COMMAND_LENGTH + 16];
+    memset(unterminated, 'a', sizeof(unterminated));
+    argc = parse_command(unterminated, words, argv);
+    CHECK(argc == 1);
+    CHECK(strlen(argv[0]) == MAX_COMMAND_LENGTH - 1);
+
+    CHECK(is_operator('|') && is_operator('>') && !is_operator('<'));
+}
@@ -0,0 +1,186 @@
+#include "test.h"
+#include "stubs.h"
+#include "../process/process.h"
+#include "../process/ipc.h"
+#include <string.h>
+
+// Stands in for a ring 3 program making the system calls that reach the
+// scheduler: spawn, then yield
+static int user_pids[3];
+
+static void user_program(void) {
+    user_pids[0] = get_current_pid();
+    user_pids[1] = create_process("child", 100);
+    schedule();
+    user_pids[2] = get_current_pid();
+}
+
+static ProcessState state_of(int pid) {
+    ProcessStats stats;
+    return get_process_stats(pid, &stats) == 0 ? stats.state : TERMINATED;
+}
+
+// Mailboxes: slots reused lap after lap, full and empty mailboxes,
+// blocked senders and receivers woken, buffers handed over
+static void check_ipc(void) {
+    init_scheduler();
+    init_ipc();
+    int a = create_process("a", 100);
+    int b = create_process("b", 100);
+    Message msg, got;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_INLINE;
+    msg.length = 4;
+    msg.buffer = -1;
+
+    CHECK(ipc_recv(b, &got, IPC_NONBLOCK) == IPC_WOULD_BLOCK);
+    int in_order = 1;
+    for (int i = 0; i < MAILBOX_CAPACITY * 3 + 5; i++) {
+        msg.data[0] = (char)i;
+        if (ipc_send(a, b, &msg, IPC_NONBLOCK) != IPC_OK ||
+            ipc_recv(b, &got, IPC_NONBLOCK) != IPC_OK ||
+            got.data[0] != (char)i || got.sender != a) {
+            in_order = 0;
+        }
+    }
+    CHECK(in_order);
+
+    // Full: a blocking send puts the sender to sleep until a slot frees
+    int sent = 0;
+    while (ipc_send(a, b, &msg, IPC_NONBLOCK) == IPC_OK) {
+        sent++;
+    }
+    CHECK(sent == MAILBOX_CAPACITY);
+    CHECK(ipc_send(a, b, &msg, IPC_NONBLOCK) == IPC_WOULD_BLOCK);
+    CHECK(get_current_pid() == a);
+    CHECK(ipc_send(a, b, &msg, 0) == IPC_BLOCKED);
+    CHECK(state_of(a) == WAITING);
+    CHECK(get_current_pid() == b);
+    CHECK(ipc_recv(b, &got, 0) == IPC_OK);
+    CHECK(state_of(a) == READY);
+    CHECK(ipc_send(a, b, &msg, IPC_NONBLOCK) == IPC_OK);
+    int received = 0;
+    while (ipc_recv(b, &got, IPC_NONBLOCK) == IPC_OK) {
+        received++;
+    }
+    CHECK(received == MAILBOX_CAPACITY);
+
+    // Empty: a blocking receive sleeps until a send wakes it
+    CHECK(ipc_recv(b, &got, 0) == IPC_BLOCKED);
+    CHECK(state_of(b) == WAITING);
+    CHECK(get_current_pid() == a);
+    msg.data[0] = 'x';
+    CHECK(ipc_send(a, b, &msg, 0) == IPC_OK);
+    CHECK(state_of(b) == READY);
+    CHECK(ipc_recv(b, &got, IPC_NONBLOCK) == IPC_OK && got.data[0] == 'x');
+
+    // A buffer belongs to one process at a time and moves with the message
+    int handle = ipc_buffer_alloc(a);
+    CHECK(handle >= 0 && ipc_buffer_data(a, handle) != NULL);
+    msg.type = MSG_BUFFER;
+    msg.buffer = handle;
+    CHECK(ipc_send(b, a, &msg, IPC_NONBLOCK) == IPC_ERROR);
+    CHECK(ipc_send(a, b, &msg, IPC_NONBLOCK) == IPC_OK);
+    CHECK(ipc_buffer_data(a, handle) == NULL);
+    CHECK(ipc_recv(b, &got, IPC_NONBLOCK) == IPC_OK && got.buffer == handle);
+    CHECK(ipc_buffer_data(b, handle) != NULL);
+    ipc_buffer_free(a, handle);
+    CHECK(ipc_buffer_data(b, handle) != NULL);
+
+    // One still queued when its receiver dies is freed with it
+    CHECK(ipc_send(b, a, &got, IPC_NONBLOCK) == IPC_OK);
+    kill_process(a);
+    CHECK(ipc_buffer_alloc(b) == handle);
+    init_scheduler();
+}
+
+void test_process(void) {
+    init_scheduler();
+    console_reset();
+    CHECK(get_running_process_count() == 0);
+
+    // The first process starts running as soon as it is created
+    int a = create_process("a", 3);
+    CHECK(a >= 0);
+    CHECK(strstr(console_output(), "Running process: a") != NULL);
+    CHECK(get_current_pid() == a);
+    int b = create_process("b", 1000);
+    CHECK(b >= 0 && b != a);
+    CHECK(get_running_process_count() == 2);
+
+    // a runs out its burst, then b takes over
+    console_reset();
+    for (int i = 0; i < 4; i++) {
+        schedule();
+    }
+    CHECK(strstr(console_output(), "Process terminated: a") != NULL);
+    CHECK(get_current_pid() == b);
+    CHECK(!is_process_alive(a));
+
+    // b has waited for a and run since; a's stats are gone with it
+    ProcessStats stats;
+    CHECK(get_process_stats(a, &stats) != 0);
+    CHECK(get_process_stats(b, &stats) == 0);
+    CHECK(stats.state == RUNNING);
+    CHECK(stats.switches == 1);
+    CHECK(stats.wait_time > 0 && stats.max_latency == stats.wait_time);
+    CHECK(stats.response >= stats.wait_time);
+    int switches = get_context_switches();
+
+    // A new process waits: the first quantum covers the whole burst
+    int c = create_process("c", 1000);
+    CHECK(get_current_pid() == b);
+    console_reset();
+    int decisions = 0;
+    while (get_current_pid() == b && decisions < 2000) {
+        schedule();
+        decisions++;
+    }
+    CHECK(strstr(console_output(), "Process terminated: b") != NULL);
+    CHECK(get_current_pid() == c);
+
+    // A blocked process leaves the CPU idle until it is woken
+    block_process(c);
+    CHECK(is_process_alive(c));
+    CHECK(get_current_pid() == -1);
+    schedule();
+    CHECK(get_current_pid() == -1);
+    wake_process(c);
+    schedule();
+    CHECK(get_current_pid() == c);
+
+    // Every trip onto the CPU counts, and blocked time is not waiting
+    CHECK(get_process_stats(c, &stats) == 0);
+    CHECK(stats.switches == 2);
+    CHECK(get_context_switches() == switches + 2);
+    CHECK(stats.run_time > 0);
+
+    kill_process(c);
+    CHECK(!is_process_alive(c));
+    CHECK(get_current_pid() == -1);
+    CHECK(get_running_process_count() == 0);
+
+    // A running user program stays the current process through spawn
+    // and yield, even with its quantum used up and others ready
+    init_scheduler();
+    int shell = create_process("shell", 100);
+    int user = create_process("user", 1);
+    static AddressSpace space;
+    attach_address_space(user, &space, (uint32_t)(uintptr_t)user_program);
+    CHECK(run_process(user) == 0);
+    CHECK(user_pids[0] == user);
+    CHECK(user_pids[1] >= 0 && user_pids[1] != user && user_pids[1] != shell);
+    CHECK(user_pids[2] == user);
+    CHECK(!is_process_alive(user));
+
+    // The table fills up at MAX_PROCESSES
+    init_scheduler();
+    int created = 0;
+    while (create_process("p", 100) >= 0) {
+        created++;
+    }
+    CHECK(created == MAX_PROCESSES);
+    init_scheduler();
+
+    check_ipc();
+}
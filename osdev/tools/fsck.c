@@ -0,0 +1,350 @@
+// Check an fs image offline: fsck [-r] [-v] <image>
+// The committed journal transaction is replayed first, as the kernel
+// would at mount. Then the inode table and every block reference are
+// checked against fs/layout.h. With -r, problems are repaired and the
+// image is written back with an empty journal. Broken entries are
+// dropped, bad block references cleared and the bitmap rebuilt.
+// Exit status: 0 clean, 1 repaired, 4 problems left, 8 unusable image.
+#include "image.h"
+#include "../fs/layout.h"
+#include "../fs/lz4.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static Inode* inodes;            // The table, in the image
+static uint8_t* bitmap;
+static uint32_t blocks;
+static uint8_t claimed[MAX_BLOCKS / 8];
+static int problems = 0;
+
+static void problem(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    printf("fsck: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    problems++;
+}
+
+static int test_bit(const uint8_t* map, uint32_t bit) {
+    return map[bit / 8] & (1 << (bit % 8));
+}
+
+static void set_bit(uint8_t* map, uint32_t bit, int on) {
+    if (on) {
+        map[bit / 8] |= 1 << (bit % 8);
+    } else {
+        map[bit / 8] &= ~(1 << (bit % 8));
+    }
+}
+
+static int valid_name(const char* name) {
+    int length = 0;
+    while (length < MAX_FILENAME && name[length] != '\0') {
+        if (name[length] == '/') {
+            return 0;
+        }
+        length++;
+    }
+    return length > 0 && length < MAX_FILENAME &&
+           strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const Inode* x = &inodes[*(const int*)a];
+    const Inode* y = &inodes[*(const int*)b];
+    if (x->parent != y->parent) {
+        return x->parent < y->parent ? -1 : 1;
+    }
+    int order = strncmp(x->name, y->name, MAX_FILENAME);
+    return order != 0 ? order : *(const int*)a - *(const int*)b;
+}
+
+// Drop entries that cannot be reached: bad type or name, a parent that
+// is not a live directory, a loop, or a name already taken in the same
+// directory. Dropping a directory orphans its entries, so repeat until
+// nothing changes.
+static void check_tree(void) {
+    static int order[MAX_INODES];
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < MAX_INODES; i++) {
+            Inode* inode = &inodes[i];
+            if (inode->type == INODE_FREE) {
+                continue;
+            }
+            const char* why = NULL;
+            if (inode->type != INODE_FILE && inode->type != INODE_DIR) {
+                why = "has a bad type";
+            } else if (!valid_name(inode->name)) {
+                why = "has a bad name";
+            } else if (inode->parent < 0 || inode->parent >= MAX_INODES ||
+                       inodes[inode->parent].type != INODE_DIR) {
+                why = "is not in a directory";
+            } else {
+                int steps = 0;
+                int j = i;
+                while (j != ROOT_INODE && steps++ < MAX_INODES) {
+                    j = inodes[j].parent;
+                }
+                if (j != ROOT_INODE) {
+                    why = "is in a directory loop";
+                }
+            }
+            if (why != NULL) {
+                problem("inode %d %s, dropped", i, why);
+                memset(inode, 0, sizeof(Inode));
+                changed = 1;
+            }
+        }
+
+        int count = 0;
+        for (int i = 1; i < MAX_INODES; i++) {
+            if (inodes[i].type != INODE_FREE) {
+                order[count++] = i;
+            }
+        }
+        qsort(order, count, sizeof(int), compare_entries);
+        for (int k = 1; k < count; k++) {
+            Inode* a = &inodes[order[k - 1]];
+            Inode* b = &inodes[order[k]];
+            if (a->parent == b->parent && strncmp(a->name, b->name, MAX_FILENAME) == 0) {
+                problem("inode %d repeats the name %.*s, dropped", order[k], MAX_FILENAME, b->name);
+                memset(b, 0, sizeof(Inode));
+                changed = 1;
+                break;    // The sort order is stale now
+            }
+        }
+    }
+}
+
+// Claim a block for inode i. Returns 0, or -1 (after reporting it) if
+// the block is out of range or already taken.
+static int claim(int i, uint32_t block, const char* what) {
+    if (block < DATA_BLOCK || block >= blocks) {
+        problem("inode %d: %s %u is out of range, cleared", i, what, block);
+        return -1;
+    }
+    if (test_bit(claimed, block)) {
+        problem("inode %d: %s %u is used twice, cleared", i, what, block);
+        return -1;
+    }
+    set_bit(claimed, block, 1);
+    return 0;
+}
+
+// Slot index of file i's block map, NULL past the indirect block
+static uint32_t* map_slot(Inode* inode, uint32_t index) {
+    if (index < DIRECT_BLOCKS) {
+        return &inode->direct[index];
+    }
+    if (inode->indirect == 0) {
+        return NULL;
+    }
+    return &((uint32_t*)get_image_block(inode->indirect))[index - DIRECT_BLOCKS];
+}
+
+// A compressed cluster must decompress; one that does not is dropped
+// (its pages read back as zeros)
+static void check_cluster(int i, Inode* inode, uint32_t first) {
+    static char packed[CLUSTER_SIZE];
+    static char out[CLUSTER_SIZE];
+    memset(packed, 0, sizeof(packed));
+    for (int k = 1; k < CLUSTER_PAGES; k++) {
+        uint32_t* slot = map_slot(inode, first + k);
+        if (slot != NULL && *slot != 0) {
+            memcpy(packed + k * BLOCK_SIZE, get_image_block(*slot), BLOCK_SIZE);
+        }
+    }
+    uint32_t length = *(uint32_t*)(packed + BLOCK_SIZE);
+    if (length <= CLUSTER_SIZE - BLOCK_SIZE - 4 &&
+        lz4_decompress(packed + BLOCK_SIZE + 4, length, out, CLUSTER_SIZE) >= 0) {
+        return;
+    }
+    problem("inode %d: compressed cluster at page %u is corrupt, cleared", i, first);
+    for (int k = 0; k < CLUSTER_PAGES; k++) {
+        uint32_t* slot = map_slot(inode, first + k);
+        if (slot != NULL) {
+            if (*slot != 0 && *slot != COMPRESSED_CLUSTER) {
+                set_bit(claimed, *slot, 0);
+            }
+            *slot = 0;
+        }
+    }
+}
+
+// Sizes and block maps
+static void check_blocks(int* files, int* directories) {
+    for (int i = 0; i < MAX_INODES; i++) {
+        Inode* inode = &inodes[i];
+        if (inode->type == INODE_DIR) {
+            (*directories)++;
+            if (inode->size != 0 || inode->indirect != 0 ||
+                inode->direct[0] || inode->direct[1] || inode->direct[2] || inode->direct[3]) {
+                problem("directory inode %d has contents, cleared", i);
+                inode->size = 0;
+                inode->indirect = 0;
+                memset(inode->direct, 0, sizeof(inode->direct));
+            }
+            continue;
+        }
+        if (inode->type != INODE_FILE) {
+            continue;
+        }
+        (*files)++;
+        if (inode->size < 0 || inode->size > MAX_FILE_SIZE) {
+            problem("inode %d has a bad size %d, cut to %d", i, inode->size,
+                    inode->size < 0 ? 0 : MAX_FILE_SIZE);
+            inode->size = inode->size < 0 ? 0 : MAX_FILE_SIZE;
+        }
+        uint32_t pages = (inode->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        if (inode->indirect != 0 && claim(i, inode->indirect, "indirect block") != 0) {
+            inode->indirect = 0;
+        }
+        for (uint32_t index = 0; index < MAX_FILE_PAGES; index++) {
+            uint32_t* slot = map_slot(inode, index);
+            if (slot == NULL) {
+                break;
+            }
+            if (*slot == 0) {
+                continue;
+            }
+            if (*slot == COMPRESSED_CLUSTER) {
+                if (index % CLUSTER_PAGES != 0 || index >= pages) {
+                    problem("inode %d: stray compressed cluster mark at page %u, cleared", i, index);
+                    *slot = 0;
+                }
+                continue;
+            }
+            if (index >= pages) {
+                problem("inode %d: block %u is past the end of the file, cleared", i, *slot);
+                *slot = 0;
+                continue;
+            }
+            if (claim(i, *slot, "block") != 0) {
+                *slot = 0;
+            }
+        }
+        for (uint32_t first = 0; first < pages; first += CLUSTER_PAGES) {
+            uint32_t* slot = map_slot(inode, first);
+            if (slot != NULL && *slot == COMPRESSED_CLUSTER) {
+                check_cluster(i, inode, first);
+            }
+        }
+    }
+}
+
+// The bitmap must mark exactly the metadata and the claimed blocks
+static void check_bitmap(void) {
+    int leaked = 0;
+    int missing = 0;
+    for (uint32_t block = 0; block < MAX_BLOCKS; block++) {
+        int used = block < DATA_BLOCK || test_bit(claimed, block);
+        if (block >= blocks) {
+            used = 0;
+        }
+        if (test_bit(bitmap, block) && !used) {
+            leaked++;
+        } else if (!test_bit(bitmap, block) && used) {
+            missing++;
+        }
+        set_bit(bitmap, block, used);
+    }
+    if (leaked > 0) {
+        problem("%d blocks marked in use belong to nothing, freed", leaked);
+    }
+    if (missing > 0) {
+        problem("%d blocks in use are marked free, marked", missing);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int repair = 0;
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-r") == 0) {
+            repair = 1;
+        } else if (strcmp(argv[arg], "-v") == 0) {
+            set_verbose(1);
+        } else {
+            break;
+        }
+        arg++;
+    }
+    if (argc - arg != 1) {
+        fprintf(stderr, "usage: fsck [-r] [-v] <image>\n");
+        return 8;
+    }
+    const char* path = argv[arg];
+    if (load_image(path) != 0) {
+        return 8;
+    }
+
+    SuperBlock* sb = (SuperBlock*)get_image_block(SUPER_BLOCK);
+    uint32_t available = get_image_blocks() < MAX_BLOCKS ? get_image_blocks() : MAX_BLOCKS;
+    if (get_image_blocks() <= DATA_BLOCK || sb->magic != FS_MAGIC || sb->version != FS_VERSION ||
+        sb->inodes != MAX_INODES || sb->blocks <= DATA_BLOCK || sb->blocks > available) {
+        fprintf(stderr, "fsck: %s holds no file system (bad superblock)\n", path);
+        return 8;
+    }
+    blocks = sb->blocks;
+    inodes = (Inode*)get_image_block(INODE_BLOCK);
+    bitmap = get_image_block(BITMAP_BLOCK);
+
+    init_journal(JOURNAL_BLOCK);
+    int restored = replay_journal();
+    if (restored < 0) {
+        fprintf(stderr, "fsck: could not replay the journal\n");
+        return 8;
+    }
+    if (restored > 0) {
+        printf("fsck: journal replayed, %d blocks restored\n", restored);
+    }
+
+    // Initrd files left in the table are not part of the disk's tree
+    for (int i = 1; i < MAX_INODES; i++) {
+        if (inodes[i].flags & INODE_INITRD) {
+            memset(&inodes[i], 0, sizeof(Inode));
+        }
+    }
+    if (inodes[ROOT_INODE].type != INODE_DIR || inodes[ROOT_INODE].parent != ROOT_INODE) {
+        problem("the root is not a directory, made one");
+        inodes[ROOT_INODE].type = INODE_DIR;
+        inodes[ROOT_INODE].parent = ROOT_INODE;
+        strcpy(inodes[ROOT_INODE].name, "/");
+    }
+
+    int files = 0;
+    int directories = 0;
+    check_tree();
+    check_blocks(&files, &directories);
+    check_bitmap();
+
+    int used = 0;
+    for (uint32_t block = 0; block < blocks; block++) {
+        used += test_bit(bitmap, block) != 0;
+    }
+    printf("fsck: %s: %d files, %d directories, %d of %u blocks used, %d problems\n",
+           path, files, directories - 1, used, blocks, problems);
+
+    if (!repair) {
+        if (problems > 0) {
+            printf("fsck: nothing written; run fsck -r to make these repairs\n");
+        }
+        return problems > 0 ? 4 : 0;
+    }
+    if (problems == 0 && restored == 0) {
+        return 0;
+    }
+    // The journal's last transaction must not be replayed over the repairs
+    clear_journal();
+    if (save_image(path) != 0) {
+        return 8;
+    }
+    return problems > 0 ? 1 : 0;
+}
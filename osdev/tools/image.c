@@ -0,0 +1,153 @@
+#include "image.h"
+#include "../fs/block.h"
+#include "../mm/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_FRAMES 8192        // 32MB for the page cache and indirect blocks
+
+static uint8_t* image = NULL;
+static uint32_t image_size = 0;
+static int verbose = 0;
+
+// Block device
+
+static int image_read(uint32_t lba, uint32_t count, void* buffer) {
+    if ((uint64_t)(lba + count) * SECTOR_SIZE > image_size) {
+        return -1;
+    }
+    memcpy(buffer, image + (uint64_t)lba * SECTOR_SIZE, count * SECTOR_SIZE);
+    return 0;
+}
+
+static int image_write(uint32_t lba, uint32_t count, const void* buffer) {
+    if ((uint64_t)(lba + count) * SECTOR_SIZE > image_size) {
+        return -1;
+    }
+    memcpy(image + (uint64_t)lba * SECTOR_SIZE, buffer, count * SECTOR_SIZE);
+    return 0;
+}
+
+static int image_flush(void) {
+    return 0;
+}
+
+static BlockDevice image_device = {"image", 0, image_read, image_write, image_flush, NULL};
+
+static int attach(uint32_t bytes) {
+    image_size = bytes;
+    image_device.sectors = image_size / SECTOR_SIZE;
+    register_block_device(&image_device);
+    return 0;
+}
+
+int new_image(uint32_t bytes) {
+    image = calloc(1, bytes);
+    if (image == NULL) {
+        perror("image");
+        return -1;
+    }
+    return attach(bytes);
+}
+
+int load_image(const char* path) {
+    FILE* in = fopen(path, "rb");
+    if (in == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    if (size < BLOCK_SIZE || size > 0xFFFFFFFFL) {
+        fprintf(stderr, "%s: not an fs image (%ld bytes)\n", path, size);
+        fclose(in);
+        return -1;
+    }
+    image = malloc(size);
+    if (image == NULL || fread(image, 1, size, in) != (size_t)size) {
+        perror(path);
+        fclose(in);
+        return -1;
+    }
+    fclose(in);
+    return attach((uint32_t)size);
+}
+
+int save_image(const char* path) {
+    FILE* out = fopen(path, "wb");
+    if (out == NULL || fwrite(image, 1, image_size, out) != image_size || fclose(out) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t get_image_blocks(void) {
+    return image_size / BLOCK_SIZE;
+}
+
+uint8_t* get_image_block(uint32_t block) {
+    return image + (uint64_t)block * BLOCK_SIZE;
+}
+
+// Kernel console
+
+static char line[256];
+static int line_length = 0;
+
+void set_verbose(int on) {
+    verbose = on;
+}
+
+void print_char(char c) {
+    if (line_length < (int)sizeof(line) - 1) {
+        line[line_length++] = c;
+    }
+    if (c != '\n') {
+        return;
+    }
+    line[line_length] = '\0';
+    if (strncmp(line, "Error", 5) == 0) {
+        fputs(line, stderr);
+    } else if (verbose) {
+        fputs(line, stdout);
+    }
+    line_length = 0;
+}
+
+void print_string(const char* str) {
+    while (*str) {
+        print_char(*str++);
+    }
+}
+
+void print_int(int num) {
+    char digits[16];
+    snprintf(digits, sizeof(digits), "%d", num);
+    print_string(digits);
+}
+
+// Frames: a static pool, since the kernel passes frames around as
+// uint32_t (the tools are linked -no-pie, so it sits below 4GB)
+
+static char pool[IMAGE_FRAMES][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static uint8_t frame_used[IMAGE_FRAMES];
+static int next_frame = 0;
+
+uint32_t alloc_frame(void) {
+    for (int i = 0; i < IMAGE_FRAMES; i++) {
+        int frame = (next_frame + i) % IMAGE_FRAMES;
+        if (!frame_used[frame]) {
+            frame_used[frame] = 1;
+            next_frame = frame + 1;
+            return (uint32_t)(uintptr_t)pool[frame];
+        }
+    }
+    return 0;
+}
+
+void free_frame(uint32_t frame) {
+    frame_used[((char*)(uintptr_t)frame - pool[0]) / PAGE_SIZE] = 0;
+}
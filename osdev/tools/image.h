@@ -0,0 +1,24 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+
+// Shared by the host tools that work on fs images (mkfs, fsck): the
+// image is held in memory and registered as the block device, and the
+// kernel services fs.c and journal.c call are provided here. Nothing
+// reaches the file until save_image.
+
+// A zeroed image of the given size, or the contents of a file. Return 0,
+// or -1 after printing why.
+int new_image(uint32_t bytes);
+int load_image(const char* path);
+int save_image(const char* path);
+
+uint32_t get_image_blocks(void);
+uint8_t* get_image_block(uint32_t block);
+
+// Kernel console output goes to stdout only when verbose; lines starting
+// "Error" always go to stderr
+void set_verbose(int on);
+
+#endif
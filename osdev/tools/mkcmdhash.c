@@ -0,0 +1,84 @@
+// Host tool: searches for a hash seed that maps every command name in
+// shell/commands.def to its own slot, and writes the slot table as a C
+// header on stdout, along with the table's order by name (for tab
+// completion). Run by the Makefile to produce shell/command_hash.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../shell/cmdhash.h"
+
+#define COMMAND(name, handler, min_args, usage, help, group) name,
+#define FILTER(name, input, finish, min_args, usage, help, group) name,
+static const char* names[] = {
+#include "../shell/commands.def"
+};
+#undef COMMAND
+#undef FILTER
+
+#define NAME_COUNT ((int)(sizeof(names) / sizeof(names[0])))
+#define MAX_SLOTS 1024
+#define MAX_SEED_TRIES 1000000u
+
+static int slots[MAX_SLOTS];
+static int sorted[NAME_COUNT];
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(names[*(const int*)a], names[*(const int*)b]);
+}
+
+// Fills slots[] for the given seed; returns 0 on the first collision
+static int try_seed(uint32_t seed, int size) {
+    for (int i = 0; i < size; i++) {
+        slots[i] = -1;
+    }
+    for (int i = 0; i < NAME_COUNT; i++) {
+        int slot = command_hash(names[i], seed) & (size - 1);
+        if (slots[slot] >= 0) {
+            return 0;
+        }
+        slots[slot] = i;
+    }
+    return 1;
+}
+
+int main(void) {
+    for (int i = 0; i < NAME_COUNT; i++) {
+        sorted[i] = i;
+    }
+    qsort(sorted, NAME_COUNT, sizeof(sorted[0]), compare_names);
+
+    // Start at twice the command count so a seed turns up quickly
+    int size = 1;
+    while (size < NAME_COUNT * 2) {
+        size <<= 1;
+    }
+
+    for (; size <= MAX_SLOTS; size <<= 1) {
+        for (uint32_t seed = 0; seed < MAX_SEED_TRIES; seed++) {
+            if (!try_seed(seed, size)) {
+                continue;
+            }
+
+            printf("// Generated by tools/mkcmdhash.c from shell/commands.def - do not edit\n");
+            printf("#ifndef COMMAND_HASH_H\n#define COMMAND_HASH_H\n\n");
+            printf("#define COMMAND_HASH_SEED 0x%08xu\n", seed);
+            printf("#define COMMAND_HASH_SIZE %d\n\n", size);
+            printf("// Index into the command table, or -1 for an empty slot\n");
+            printf("static const signed char command_slots[COMMAND_HASH_SIZE] = {");
+            for (int i = 0; i < size; i++) {
+                printf("%s%d,", (i % 16) ? " " : "\n    ", slots[i]);
+            }
+            printf("\n};\n\n");
+            printf("// Command table indexes in name order\n");
+            printf("static const signed char command_sorted[%d] = {", NAME_COUNT);
+            for (int i = 0; i < NAME_COUNT; i++) {
+                printf("%s%d,", (i % 16) ? " " : "\n    ", sorted[i]);
+            }
+            printf("\n};\n\n#endif\n");
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "mkcmdhash: no collision-free seed for %d commands\n", NAME_COUNT);
+    return 1;
+}
@@ -0,0 +1,142 @@
+// Build an fs image on the host: mkfs [-z] [-v] <image> <megabytes> [directory]
+// The kernel's own fs code formats the image and imports the directory
+// tree into it, so the result is exactly what the kernel would have
+// written; -z stores the imported files compressed.
+#include "image.h"
+#include "../fs/fs.h"
+#include "../fs/layout.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static int compress = 0;
+static int files = 0;
+static int directories = 0;
+static long bytes = 0;
+
+static int import_file(const char* source, const char* path, long size) {
+    if (size > MAX_FILE_SIZE) {
+        fprintf(stderr, "mkfs: %s is larger than %d bytes\n", source, MAX_FILE_SIZE);
+        return -1;
+    }
+    char* data = malloc(size > 0 ? size : 1);
+    FILE* in = fopen(source, "rb");
+    if (data == NULL || in == NULL || fread(data, 1, size, in) != (size_t)size) {
+        perror(source);
+        free(data);
+        if (in != NULL) {
+            fclose(in);
+        }
+        return -1;
+    }
+    fclose(in);
+
+    int result = create_file(path);
+    if (result == 0 && compress) {
+        result = set_file_compression(path, 1);
+    }
+    if (result == 0) {
+        result = write_file_data(path, data, (int)size);
+    }
+    free(data);
+    if (result != 0) {
+        fprintf(stderr, "mkfs: could not import %s\n", source);
+        return -1;
+    }
+    files++;
+    bytes += size;
+    return 0;
+}
+
+// Copy everything under source into the fs directory path ("" for the root)
+static int import_tree(const char* source, const char* path) {
+    DIR* dir = opendir(source);
+    if (dir == NULL) {
+        perror(source);
+        return -1;
+    }
+    int result = 0;
+    struct dirent* item;
+    while (result == 0 && (item = readdir(dir)) != NULL) {
+        if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) {
+            continue;
+        }
+        if (strlen(item->d_name) >= MAX_FILENAME) {
+            fprintf(stderr, "mkfs: name longer than %d characters: %s\n",
+                    MAX_FILENAME - 1, item->d_name);
+            result = -1;
+            break;
+        }
+        char from[4096];
+        char to[MAX_PATH];
+        snprintf(from, sizeof(from), "%s/%s", source, item->d_name);
+        if (snprintf(to, sizeof(to), "%s/%s", path, item->d_name) >= MAX_PATH) {
+            fprintf(stderr, "mkfs: path longer than %d characters: %s\n", MAX_PATH - 1, to);
+            result = -1;
+            break;
+        }
+
+        struct stat info;
+        if (stat(from, &info) != 0) {
+            perror(from);
+            result = -1;
+        } else if (S_ISDIR(info.st_mode)) {
+            if (make_directory(to) != 0) {
+                result = -1;
+            } else {
+                directories++;
+                result = import_tree(from, to);
+            }
+        } else if (S_ISREG(info.st_mode)) {
+            result = import_file(from, to, info.st_size);
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-z") == 0) {
+            compress = 1;
+        } else if (strcmp(argv[arg], "-v") == 0) {
+            set_verbose(1);
+        } else {
+            break;
+        }
+        arg++;
+    }
+    if (argc - arg < 2 || argc - arg > 3) {
+        fprintf(stderr, "usage: mkfs [-z] [-v] <image> <megabytes> [directory]\n");
+        return 1;
+    }
+    const char* path = argv[arg];
+    long megabytes = atol(argv[arg + 1]);
+    long blocks = megabytes * 1024 * 1024 / BLOCK_SIZE;
+    if (blocks <= DATA_BLOCK || blocks > MAX_BLOCKS) {
+        fprintf(stderr, "mkfs: size must be 1 to %d MB\n", MAX_BLOCKS / 256);
+        return 1;
+    }
+
+    if (new_image((uint32_t)(blocks * BLOCK_SIZE)) != 0) {
+        return 1;
+    }
+    init_fs();    // Finds no superblock, so formats
+    if (argc - arg == 3 && import_tree(argv[arg + 2], "") != 0) {
+        return 1;
+    }
+    if (sync_fs() != 0 || save_image(path) != 0) {
+        return 1;
+    }
+
+    const char* name;
+    int total;
+    int used;
+    get_disk_stats(&name, &total, &used);
+    printf("mkfs: %s, %d files and %d directories (%ld bytes), %d of %d blocks used\n",
+           path, files, directories, bytes, used, total);
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Pack the files under a directory into an initrd image (fs/initrd.h)
+// for boot.asm to load after the kernel: mkinitrd <directory> <image>.
+// Files are stored in path order, so the image only changes with them.
+#include "../fs/initrd.h"
+#include "../fs/fs.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define MAX_FILES 1024
+
+static InitrdEntry entries[MAX_FILES];
+static char sources[MAX_FILES][1024];
+static int count = 0;
+
+static int compare_entries(const void* a, const void* b) {
+    return strcmp(((const InitrdEntry*)a)->path, ((const InitrdEntry*)b)->path);
+}
+
+// Add the files under root/relative, recursing into directories
+static int scan(const char* root, const char* relative) {
+    char directory[1024];
+    if (snprintf(directory, sizeof(directory), "%s/%s", root, relative) >= (int)sizeof(directory)) {
+        fprintf(stderr, "mkinitrd: path too long: %s/%s\n", root, relative);
+        return -1;
+    }
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        perror(directory);
+        return -1;
+    }
+
+    struct dirent* item;
+    while ((item = readdir(dir)) != NULL) {
+        if (item->d_name[0] == '.') {
+            continue;    // ".", ".." and hidden files
+        }
+        if (strlen(item->d_name) >= MAX_FILENAME) {
+            fprintf(stderr, "mkinitrd: name longer than %d characters: %s\n",
+                    MAX_FILENAME - 1, item->d_name);
+            closedir(dir);
+            return -1;
+        }
+        // Nothing under a directory whose path is already too long fits
+        char path[INITRD_PATH];
+        if (snprintf(path, sizeof(path), "%s%s%s", relative, relative[0] ? "/" : "",
+                     item->d_name) >= (int)sizeof(path)) {
+            fprintf(stderr, "mkinitrd: path longer than %d characters: %s/%s\n",
+                    INITRD_PATH - 1, relative, item->d_name);
+            closedir(dir);
+            return -1;
+        }
+        char source[1024];
+        if (snprintf(source, sizeof(source), "%s/%s", root, path) >= (int)sizeof(source)) {
+            fprintf(stderr, "mkinitrd: path too long: %s/%s\n", root, path);
+            closedir(dir);
+            return -1;
+        }
+
+        struct stat info;
+        if (stat(source, &info) != 0) {
+            perror(source);
+            closedir(dir);
+            return -1;
+        }
+        if (S_ISDIR(info.st_mode)) {
+            if (scan(root, path) != 0) {
+                closedir(dir);
+                return -1;
+            }
+            continue;
+        }
+        if (!S_ISREG(info.st_mode)) {
+            continue;
+        }
+        if (count == MAX_FILES) {
+            fprintf(stderr, "mkinitrd: more than %d files\n", MAX_FILES);
+            closedir(dir);
+            return -1;
+        }
+        memset(&entries[count], 0, sizeof(InitrdEntry));
+        strcpy(entries[count].path, path);
+        entries[count].size = (uint32_t)info.st_size;
+        // The source path rides along in offset's place until layout
+        entries[count].offset = (uint32_t)count;
+        strcpy(sources[count], source);
+        count++;
+    }
+    closedir(dir);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: mkinitrd <directory> <image>\n");
+        return 1;
+    }
+    if (scan(argv[1], "") != 0) {
+        return 1;
+    }
+    qsort(entries, count, sizeof(InitrdEntry), compare_entries);
+
+    // Lay the data out after the table
+    uint32_t size = sizeof(InitrdHeader) + count * sizeof(InitrdEntry);
+    int source_of[MAX_FILES];
+    for (int i = 0; i < count; i++) {
+        size = (size + INITRD_ALIGN - 1) & ~(INITRD_ALIGN - 1);
+        source_of[i] = (int)entries[i].offset;
+        entries[i].offset = size;
+        size += entries[i].size;
+    }
+    if (size > INITRD_MAX_SIZE) {
+        fprintf(stderr, "mkinitrd: image is %u bytes, boot.asm loads at most %u\n",
+                (unsigned)size, (unsigned)INITRD_MAX_SIZE);
+        return 1;
+    }
+
+    char* image = calloc(1, size);
+    if (image == NULL) {
+        perror("mkinitrd");
+        return 1;
+    }
+    InitrdHeader header = {INITRD_MAGIC, (uint32_t)count, size, 0};
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + sizeof(header), entries, count * sizeof(InitrdEntry));
+    for (int i = 0; i < count; i++) {
+        FILE* in = fopen(sources[source_of[i]], "rb");
+        if (in == NULL || fread(image + entries[i].offset, 1, entries[i].size, in) != entries[i].size) {
+            perror(sources[source_of[i]]);
+            return 1;
+        }
+        fclose(in);
+    }
+
+    FILE* out = fopen(argv[2], "wb");
+    if (out == NULL || fwrite(image, 1, size, out) != size || fclose(out) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+    free(image);
+    printf("mkinitrd: %d files, %u bytes\n", count, (unsigned)size);
+    return 0;
+}
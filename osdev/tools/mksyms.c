@@ -0,0 +1,62 @@
+// Turn `nm -n kernel.elf` output (on stdin) into the C symbol table the
+// profiler resolves sample addresses with (kernel/symbols.h). Only text
+// symbols are kept, so the table can be linked into a second pass of the
+// kernel without moving any of them.
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_SYMBOLS 4096
+#define MAX_NAME 128
+
+static unsigned int addresses[MAX_SYMBOLS];
+static char names[MAX_SYMBOLS][MAX_NAME];
+
+int main(void) {
+    char line[512];
+    int count = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        unsigned int address;
+        char type;
+        char name[MAX_NAME];
+        if (sscanf(line, "%x %c %127s", &address, &type, name) != 3) {
+            continue;
+        }
+        if (type != 'T' && type != 't') {
+            continue;
+        }
+        // Aliases at one address: keep the first name
+        if (count > 0 && addresses[count - 1] == address) {
+            continue;
+        }
+        if (count == MAX_SYMBOLS) {
+            fprintf(stderr, "mksyms: more than %d symbols\n", MAX_SYMBOLS);
+            return 1;
+        }
+        addresses[count] = address;
+        strcpy(names[count], name);
+        count++;
+    }
+
+    printf("// Generated by tools/mksyms from nm -n kernel.elf - do not edit\n");
+    printf("#include \"kernel/symbols.h\"\n\n");
+    printf("const int kernel_symbol_count = %d;\n\n", count);
+
+    printf("const KernelSymbol kernel_symbols[] = {\n");
+    unsigned int offset = 0;
+    for (int i = 0; i < count; i++) {
+        printf("    {0x%08x, %u},\n", addresses[i], offset);
+        offset += strlen(names[i]) + 1;
+    }
+    if (count == 0) {
+        printf("    {0, 0},\n");
+    }
+    printf("};\n\n");
+
+    printf("const char kernel_symbol_names[] =\n");
+    for (int i = 0; i < count; i++) {
+        printf("    \"%s\\0\"\n", names[i]);
+    }
+    printf("    \"\";\n");
+    return 0;
+}
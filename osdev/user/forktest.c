@@ -0,0 +1,28 @@
+#include "ulib.h"
+
+// Shared copy-on-write after the fork; each side writes its own copy
+int value = 1;
+
+void __attribute__((section(".text.start"))) _start(void) {
+    int pid = syscall0(SYS_FORK);
+    if (pid < 0) {
+        print("fork failed\n");
+        exit(1);
+    }
+
+    if (pid == 0) {
+        value = 2;
+        print("Child: value is ");
+        print_number(value);
+        print("\n");
+        exit(0);
+    }
+
+    value = 3;
+    print("Parent: forked PID ");
+    print_number(pid);
+    print(", value is ");
+    print_number(value);
+    print("\n");
+    exit(0);
+}
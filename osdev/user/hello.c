@@ -0,0 +1,26 @@
+#include "ulib.h"
+
+#define TABLE_SIZE 4096
+
+// Spans four pages of .bss, none of which exist until touched
+int squares[TABLE_SIZE];
+static int runs = 1;
+
+void __attribute__((section(".text.start"))) _start(void) {
+    print("Hello from an ELF program, PID ");
+    print_number(syscall0(SYS_GETPID));
+    print("\n");
+
+    int sum = 0;
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        squares[i] = i * i;
+        sum += squares[i] % 7;
+    }
+    print("Checksum over .bss table: ");
+    print_number(sum);
+    print(", run ");
+    print_number(runs++);
+    print("\n");
+
+    exit(0);
+}
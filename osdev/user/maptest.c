@@ -0,0 +1,38 @@
+#include "ulib.h"
+
+#define FILE_NAME "maptest.txt"
+
+// Prints a file straight from its mapping, then edits it in place; msync
+// writes the change back without a read or write buffer in between
+void __attribute__((section(".text.start"))) _start(void) {
+    syscall1(SYS_CREATE, FILE_NAME);
+    syscall2(SYS_WRITE_FILE, FILE_NAME, "mapped pages are the page cache's own\n");
+
+    int size = 0;
+    char* data = (char*)syscall3(SYS_MMAP, (uint32_t)FILE_NAME, 1, (uint32_t)&size);
+    if (data == 0) {
+        print("mmap failed\n");
+        exit(1);
+    }
+    print("Mapped ");
+    print_number(size);
+    print(" bytes: ");
+    print(data);      // Zeros follow the file's end in its last page
+
+    for (int i = 0; i < size; i++) {
+        if (data[i] >= 'a' && data[i] <= 'z') {
+            data[i] -= 'a' - 'A';
+        }
+    }
+    if (syscall1(SYS_MSYNC, data) != 0 || syscall1(SYS_MUNMAP, data) != 0) {
+        print("msync failed\n");
+        exit(1);
+    }
+
+    static char buffer[4096];
+    syscall3(SYS_READ_FILE, (uint32_t)FILE_NAME, (uint32_t)buffer, sizeof(buffer));
+    print("Read back: ");
+    print(buffer);
+    syscall1(SYS_DELETE, FILE_NAME);
+    exit(0);
+}
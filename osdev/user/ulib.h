@@ -0,0 +1,28 @@
+#ifndef ULIB_H
+#define ULIB_H
+
+#include "syscall.h"
+
+// Console helpers for user programs, which have no libc
+
+static inline void print(const char* str) {
+    syscall1(SYS_WRITE, str);
+}
+
+static inline void print_number(int num) {
+    char str[12];
+    int i = sizeof(str) - 1;
+
+    str[i] = '\0';
+    do {
+        str[--i] = '0' + (num % 10);
+        num /= 10;
+    } while (num > 0 && i > 0);
+    print(&str[i]);
+}
+
+static inline void exit(int code) {
+    syscall1(SYS_EXIT, code);
+}
+
+#endif